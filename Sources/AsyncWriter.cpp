@@ -0,0 +1,64 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "AsyncWriter.h"
+
+#include <algorithm>
+
+AsyncWriter::AsyncWriter (size_t maxNumOfPendingWrites) :
+	m_maxNumOfPendingWrites (std::max (maxNumOfPendingWrites, size_t (1))),
+	m_thread (&AsyncWriter::run, this) {}
+
+AsyncWriter::~AsyncWriter () {
+	flush ();
+	{
+		std::lock_guard<std::mutex> lock (m_mutex);
+		m_quit = true;
+	}
+	m_condition.notify_all ();
+	m_thread.join ();
+}
+
+void AsyncWriter::submit (std::function<bool ()> write) {
+	std::unique_lock<std::mutex> lock (m_mutex);
+	// The running write does not count as pending
+	m_condition.wait (lock, [this] () { return m_writes.size () - (m_writing ? 1 : 0) < m_maxNumOfPendingWrites; });
+	m_writes.push_back (std::move (write));
+	m_condition.notify_all ();
+}
+
+bool AsyncWriter::flush () {
+	std::unique_lock<std::mutex> lock (m_mutex);
+	m_condition.wait (lock, [this] () { return m_writes.empty (); });
+	bool succeeded = !m_failed;
+	m_failed = false;
+	return succeeded;
+}
+
+bool AsyncWriter::busy () const {
+	std::lock_guard<std::mutex> lock (m_mutex);
+	return !m_writes.empty ();
+}
+
+void AsyncWriter::run () {
+	std::unique_lock<std::mutex> lock (m_mutex);
+	for (;;) {
+		m_condition.wait (lock, [this] () { return m_quit || !m_writes.empty (); });
+		if (m_writes.empty ())
+			return;
+		m_writing = true;
+		std::function<bool ()> & write = m_writes.front ();
+		lock.unlock ();
+		bool succeeded = write ();
+		lock.lock ();
+		m_failed |= !succeeded;
+		m_writes.pop_front ();
+		m_writing = false;
+		m_condition.notify_all ();
+	}
+}
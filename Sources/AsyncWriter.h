@@ -0,0 +1,46 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <functional>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/// Runs file writes on a thread of its own, in submission order, so that the caller keeps tracing meanwhile. Writes
+/// own a copy of their data: at most maxNumOfPendingWrites of them wait, beyond which submit blocks, bounding memory.
+class AsyncWriter {
+public:
+	AsyncWriter (size_t maxNumOfPendingWrites = 1);
+
+	/// Waits for the submitted writes.
+	virtual ~AsyncWriter ();
+
+	/// Queue a write, which returns whether it succeeded.
+	void submit (std::function<bool ()> write);
+
+	/// Wait for the submitted writes. Returns false if any failed since the last flush.
+	bool flush ();
+
+	/// Whether a write is pending or running, e.g., to skip a periodic write rather than wait for the previous one.
+	bool busy () const;
+
+private:
+	void run ();
+
+	size_t m_maxNumOfPendingWrites;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::deque<std::function<bool ()>> m_writes; // Pending, the first one running if m_writing
+	bool m_writing = false;
+	bool m_failed = false;
+	bool m_quit = false;
+	std::thread m_thread; // Last, started once the state above is initialized
+};
@@ -0,0 +1,75 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "BRDFBatch.h"
+
+#include <cmath>
+
+// Function multiversioning: the compiler emits one clone of the kernel per target, and the loader binds the best
+// one for the running CPU. Targets are microarchitecture levels rather than CPU models, which dispatch on features
+// and thus also hold in virtual machines: x86-64-v4 has AVX-512, x86-64-v3 AVX2 and FMA. Elsewhere, the kernel
+// is compiled for the baseline instruction set only.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11 && defined(__x86_64__) && defined(__linux__)
+#define BRDF_TARGET_CLONES __attribute__ ((target_clones ("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#else
+#define BRDF_TARGET_CLONES
+#endif
+
+/// Same terms as evaluateBRDF, written on plain floats with selects instead of branches so that the loop vectorizes.
+/// Requires sqrt not to set errno and compares not to trap (see CMakeLists.txt), otherwise the loop keeps branches.
+BRDF_TARGET_CLONES
+static void evaluateBRDFKernel (size_t n, const float * __restrict nx, const float * __restrict ny, const float * __restrict nz,
+								const float * __restrict wox, const float * __restrict woy, const float * __restrict woz,
+								const float * __restrict wix, const float * __restrict wiy, const float * __restrict wiz,
+								const float * __restrict alpha,
+								const float * __restrict f0r, const float * __restrict f0g, const float * __restrict f0b,
+								const float * __restrict diffuseR, const float * __restrict diffuseG, const float * __restrict diffuseB,
+								float * __restrict r, float * __restrict g, float * __restrict b) {
+	#pragma omp simd
+	for (size_t i = 0; i < n; i++) {
+		float hx = wox[i] + wix[i];
+		float hy = woy[i] + wiy[i];
+		float hz = woz[i] + wiz[i];
+		float invLength = 1.f / std::sqrt (hx * hx + hy * hy + hz * hz);
+		hx *= invLength;
+		hy *= invLength;
+		hz *= invLength;
+		float NoV = std::fabs (nx[i] * wox[i] + ny[i] * woy[i] + nz[i] * woz[i]) + 1e-5f;
+		float NoL = nx[i] * wix[i] + ny[i] * wiy[i] + nz[i] * wiz[i];
+		NoL = NoL < 0.f ? 0.f : (NoL > 1.f ? 1.f : NoL);
+		float NoH = nx[i] * hx + ny[i] * hy + nz[i] * hz;
+		NoH = NoH < 0.f ? 0.f : (NoH > 1.f ? 1.f : NoH);
+		float LoH = wix[i] * hx + wiy[i] * hy + wiz[i] * hz;
+		LoH = LoH < 0.f ? 0.f : (LoH > 1.f ? 1.f : LoH);
+		// GGX distribution
+		float a2 = alpha[i] * alpha[i];
+		float f = (NoH * a2 - NoH) * NoH + 1.f;
+		float D = a2 / (PI * f * f);
+		// Height correlated Smith visibility
+		float GGXL = NoV * std::sqrt ((-NoL * a2 + NoL) * NoL + a2);
+		float GGXV = NoL * std::sqrt ((-NoV * a2 + NoV) * NoV + a2);
+		float V = 0.5f / (GGXV + GGXL);
+		// Fresnel-Schlick
+		float c = 1.f - LoH;
+		float c2 = c * c;
+		float c5 = c2 * c2 * c;
+		float DV = D * V;
+		r[i] = diffuseR[i] + DV * (f0r[i] + (1.f - f0r[i]) * c5);
+		g[i] = diffuseG[i] + DV * (f0g[i] + (1.f - f0g[i]) * c5);
+		b[i] = diffuseB[i] + DV * (f0b[i] + (1.f - f0b[i]) * c5);
+	}
+}
+
+void evaluateBRDFs (size_t n, const float * nx, const float * ny, const float * nz,
+					const float * wox, const float * woy, const float * woz,
+					const float * wix, const float * wiy, const float * wiz,
+					const float * alpha, const float * f0r, const float * f0g, const float * f0b,
+					const float * diffuseR, const float * diffuseG, const float * diffuseB,
+					float * r, float * g, float * b) {
+	evaluateBRDFKernel (n, nx, ny, nz, wox, woy, woz, wix, wiy, wiz, alpha, f0r, f0g, f0b, diffuseR, diffuseG, diffuseB, r, g, b);
+}
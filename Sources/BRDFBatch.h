@@ -0,0 +1,72 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+#include "Shading.h"
+
+/// Number of evaluations in a BRDF batch of the wavefront engine, which gathers the shadow rays of many shading points.
+/// The megakernel only batches the light samples of a single shading point, at most MAX_LIGHT_SAMPLES.
+const size_t BRDF_BATCH_SIZE = 256;
+
+/// Evaluate the n BRDFs stored in planes, with the same model as evaluateBRDF. The kernel is compiled for several
+/// instruction sets (AVX-512, AVX2 and the baseline) and the widest one supported by the CPU is selected at runtime.
+void evaluateBRDFs (size_t n, const float * nx, const float * ny, const float * nz,
+					const float * wox, const float * woy, const float * woz,
+					const float * wix, const float * wiy, const float * wiz,
+					const float * alpha, const float * f0r, const float * f0g, const float * f0b,
+					const float * diffuseR, const float * diffuseG, const float * diffuseB,
+					float * r, float * g, float * b);
+
+/// Structure of arrays batch of at most Capacity BRDF evaluations, e.g., the unoccluded light samples of many shading
+/// points. The whole batch is evaluated at once by evaluateBRDFBatch, so that the GGX, Smith visibility and Fresnel
+/// terms of 8 or 16 entries are computed together in SIMD registers. Entries are not initialized: a batch can
+/// live on the stack of a shading routine, which sizes it to its own maximum.
+template<size_t Capacity>
+struct BRDFBatch {
+	size_t size = 0;
+	float nx[Capacity], ny[Capacity], nz[Capacity]; // Shading normals
+	float wox[Capacity], woy[Capacity], woz[Capacity]; // Outgoing directions
+	float wix[Capacity], wiy[Capacity], wiz[Capacity]; // Incident directions
+	// Material terms, copied per entry so that the kernel only reads contiguous planes
+	float alpha[Capacity];
+	float f0r[Capacity], f0g[Capacity], f0b[Capacity];
+	float diffuseR[Capacity], diffuseG[Capacity], diffuseB[Capacity];
+	float r[Capacity], g[Capacity], b[Capacity]; // Results
+
+	inline bool full () const { return size == Capacity; }
+
+	/// Queue the evaluation of the BRDF of the material at a point of shading normal n, for the directions wo and wi.
+	/// Returns its entry.
+	inline size_t add (const glm::vec3 & n, const MaterialTerms & m, const glm::vec3 & wo, const glm::vec3 & wi) {
+		size_t i = size++;
+		nx[i] = n.x; ny[i] = n.y; nz[i] = n.z;
+		wox[i] = wo.x; woy[i] = wo.y; woz[i] = wo.z;
+		wix[i] = wi.x; wiy[i] = wi.y; wiz[i] = wi.z;
+		alpha[i] = m.alpha;
+		f0r[i] = m.f0.r; f0g[i] = m.f0.g; f0b[i] = m.f0.b;
+		diffuseR[i] = m.diffuse.r; diffuseG[i] = m.diffuse.g; diffuseB[i] = m.diffuse.b;
+		return i;
+	}
+
+	inline size_t add (const SurfacePoint & sp, const glm::vec3 & wo, const glm::vec3 & wi) { return add (sp.normal, sp.material, wo, wi); }
+
+	inline glm::vec3 result (size_t i) const { return glm::vec3 (r[i], g[i], b[i]); }
+};
+
+/// Evaluate every entry of the batch (see evaluateBRDFs).
+template<size_t Capacity>
+inline void evaluateBRDFBatch (BRDFBatch<Capacity> & batch) {
+	evaluateBRDFs (batch.size, batch.nx, batch.ny, batch.nz, batch.wox, batch.woy, batch.woz, batch.wix, batch.wiy, batch.wiz,
+				   batch.alpha, batch.f0r, batch.f0g, batch.f0b, batch.diffuseR, batch.diffuseG, batch.diffuseB,
+				   batch.r, batch.g, batch.b);
+}
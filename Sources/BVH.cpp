@@ -0,0 +1,403 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "BVH.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+#include "Console.h"
+
+static const unsigned int NUM_OF_BINS = 32;
+static const unsigned int MAX_LEAF_SIZE = 8;
+static const unsigned int MAX_DEPTH = 64;
+static const float TRAVERSAL_COST = 1.f;
+static const float INTERSECTION_COST = 1.f;
+static const float SPATIAL_SPLIT_ALPHA = 1e-5f; // Overlap threshold (relative to the root area) to try spatial splits
+
+static AABB triangleBounds (const BVH::Triangle & t) {
+	AABB b;
+	b.extend (t.p0);
+	b.extend (t.p1);
+	b.extend (t.p2);
+	return b;
+}
+
+/// Bounds of the part of the triangle lying in the slab [lo, hi] along axis.
+static AABB clipTriangle (const BVH::Triangle & t, int axis, float lo, float hi) {
+	const glm::vec3 v[3] = { t.p0, t.p1, t.p2 };
+	AABB b;
+	for (int i = 0; i < 3; i++) {
+		const glm::vec3 & a = v[i];
+		const glm::vec3 & c = v[(i+1)%3];
+		if (a[axis] >= lo && a[axis] <= hi)
+			b.extend (a);
+		for (float plane : { lo, hi }) {
+			if ((a[axis] < plane && c[axis] > plane) || (a[axis] > plane && c[axis] < plane)) {
+				float s = (plane - a[axis]) / (c[axis] - a[axis]);
+				glm::vec3 p = glm::mix (a, c, s);
+				p[axis] = plane;
+				b.extend (p);
+			}
+		}
+	}
+	return b;
+}
+
+static inline unsigned int binIndex (float x, float lo, float invBinWidth) {
+	int i = static_cast<int> ((x - lo) * invBinWidth);
+	return static_cast<unsigned int> (glm::clamp (i, 0, int (NUM_OF_BINS) - 1));
+}
+
+void BVH::clear () {
+	m_nodes.clear ();
+	m_references.clear ();
+	m_triangles.clear ();
+	m_splittable.clear ();
+}
+
+void BVH::build (const std::shared_ptr<Scene> scenePtr) {
+	std::chrono::high_resolution_clock clock;
+	std::chrono::time_point<std::chrono::high_resolution_clock> before = clock.now();
+	clear ();
+	for (size_t m = 0; m < scenePtr->numOfMeshes (); m++) {
+		const auto meshPtr = scenePtr->mesh (m);
+		const auto & P = meshPtr->vertexPositions ();
+		const auto & T = meshPtr->triangleIndices ();
+		glm::mat4 modelMatrix = meshPtr->computeTransformMatrix ();
+		bool splittable = (m_buildMode == BVHBuildMode::Spatial || meshPtr->spatialSplits ());
+		for (size_t simp = 0; simp < T.size (); simp++) {
+			Triangle t;
+			t.p0 = glm::vec3 (modelMatrix * glm::vec4 (P[T[simp][0]], 1.0));
+			t.p1 = glm::vec3 (modelMatrix * glm::vec4 (P[T[simp][1]], 1.0));
+			t.p2 = glm::vec3 (modelMatrix * glm::vec4 (P[T[simp][2]], 1.0));
+			t.meshIndex = static_cast<int> (m);
+			t.simpIndex = static_cast<int> (simp);
+			m_triangles.push_back (t);
+			m_splittable.push_back (splittable);
+		}
+	}
+	if (m_triangles.empty ())
+		return;
+
+	std::vector<Reference> references (m_triangles.size ());
+	AABB rootBounds;
+	for (size_t i = 0; i < m_triangles.size (); i++) {
+		references[i].bounds = triangleBounds (m_triangles[i]);
+		references[i].triangle = static_cast<unsigned int> (i);
+		rootBounds.extend (references[i].bounds);
+	}
+	m_rootArea = rootBounds.surfaceArea ();
+	m_remainingDuplicates = static_cast<size_t> (m_duplicationBudget * m_triangles.size ());
+	m_nodes.reserve (2 * m_triangles.size ());
+	m_nodes.push_back (Node ());
+	m_nodes[0].bounds = rootBounds;
+	buildNode (0, references, 0);
+
+	std::chrono::time_point<std::chrono::high_resolution_clock> after = clock.now();
+	double elapsedTime = (double)std::chrono::duration_cast<std::chrono::milliseconds>(after - before).count();
+	Console::print ("BVH built in " + std::to_string (elapsedTime) + "ms: "
+					+ std::to_string (m_nodes.size ()) + " nodes, "
+					+ std::to_string (m_triangles.size ()) + " triangles, "
+					+ std::to_string (m_references.size ()) + " references");
+}
+
+void BVH::makeLeaf (unsigned int nodeIndex, const std::vector<Reference> & references) {
+	Node & node = m_nodes[nodeIndex];
+	node.offset = static_cast<unsigned int> (m_references.size ());
+	node.count = static_cast<unsigned int> (references.size ());
+	for (const auto & r : references)
+		m_references.push_back (r.triangle);
+}
+
+void BVH::buildNode (unsigned int nodeIndex, std::vector<Reference> & references, unsigned int depth) {
+	const AABB nodeBounds = m_nodes[nodeIndex].bounds;
+	const size_t n = references.size ();
+	if (n <= 1 || depth >= MAX_DEPTH) {
+		makeLeaf (nodeIndex, references);
+		return;
+	}
+	const float invArea = 1.f / std::max (nodeBounds.surfaceArea (), std::numeric_limits<float>::min ());
+
+	// Object split: binned SAH over the reference centroids
+	AABB centroidBounds;
+	for (const auto & r : references)
+		centroidBounds.extend (r.bounds.centroid ());
+	float bestObjectCost = std::numeric_limits<float>::max ();
+	int objectAxis = -1;
+	unsigned int objectBin = 0;
+	AABB objectLeft, objectRight;
+	for (int axis = 0; axis < 3; axis++) {
+		float lo = centroidBounds.pMin[axis];
+		float extent = centroidBounds.pMax[axis] - lo;
+		if (extent <= 0.f)
+			continue;
+		float invBinWidth = NUM_OF_BINS / extent;
+		AABB bins[NUM_OF_BINS];
+		unsigned int counts[NUM_OF_BINS] = { 0 };
+		for (const auto & r : references) {
+			unsigned int b = binIndex (r.bounds.centroid ()[axis], lo, invBinWidth);
+			bins[b].extend (r.bounds);
+			counts[b]++;
+		}
+		AABB rightBounds[NUM_OF_BINS];
+		unsigned int rightCounts[NUM_OF_BINS];
+		AABB acc;
+		unsigned int accCount = 0;
+		for (unsigned int b = NUM_OF_BINS - 1; b > 0; b--) {
+			acc.extend (bins[b]);
+			accCount += counts[b];
+			rightBounds[b] = acc;
+			rightCounts[b] = accCount;
+		}
+		acc = AABB ();
+		accCount = 0;
+		for (unsigned int b = 1; b < NUM_OF_BINS; b++) {
+			acc.extend (bins[b-1]);
+			accCount += counts[b-1];
+			if (accCount == 0 || rightCounts[b] == 0)
+				continue;
+			float cost = TRAVERSAL_COST + INTERSECTION_COST * invArea * (acc.surfaceArea () * accCount + rightBounds[b].surfaceArea () * rightCounts[b]);
+			if (cost < bestObjectCost) {
+				bestObjectCost = cost;
+				objectAxis = axis;
+				objectBin = b;
+				objectLeft = acc;
+				objectRight = rightBounds[b];
+			}
+		}
+	}
+
+	// Spatial split: binned over the node bounds, clipping splittable references into every bin they overlap
+	float bestSpatialCost = std::numeric_limits<float>::max ();
+	int spatialAxis = -1;
+	unsigned int spatialBin = 0;
+	bool hasSplittable = false;
+	for (const auto & r : references)
+		if (m_splittable[r.triangle]) {
+			hasSplittable = true;
+			break;
+		}
+	float overlap = (objectAxis >= 0 ? objectLeft.intersection (objectRight).surfaceArea () : m_rootArea);
+	if (hasSplittable && m_remainingDuplicates > 0 && overlap > SPATIAL_SPLIT_ALPHA * m_rootArea) {
+		for (int axis = 0; axis < 3; axis++) {
+			float lo = nodeBounds.pMin[axis];
+			float extent = nodeBounds.pMax[axis] - lo;
+			if (extent <= 0.f)
+				continue;
+			float binWidth = extent / NUM_OF_BINS;
+			float invBinWidth = 1.f / binWidth;
+			AABB bins[NUM_OF_BINS];
+			unsigned int entries[NUM_OF_BINS] = { 0 };
+			unsigned int exits[NUM_OF_BINS] = { 0 };
+			for (const auto & r : references) {
+				if (!m_splittable[r.triangle]) {
+					unsigned int b = binIndex (r.bounds.centroid ()[axis], lo, invBinWidth);
+					bins[b].extend (r.bounds);
+					entries[b]++;
+					exits[b]++;
+					continue;
+				}
+				unsigned int first = binIndex (r.bounds.pMin[axis], lo, invBinWidth);
+				unsigned int last = binIndex (r.bounds.pMax[axis], lo, invBinWidth);
+				for (unsigned int b = first; b <= last; b++) {
+					AABB clipped = clipTriangle (m_triangles[r.triangle], axis, lo + b * binWidth, lo + (b+1) * binWidth).intersection (r.bounds);
+					if (!clipped.isEmpty ())
+						bins[b].extend (clipped);
+				}
+				entries[first]++;
+				exits[last]++;
+			}
+			AABB rightBounds[NUM_OF_BINS];
+			unsigned int rightCounts[NUM_OF_BINS];
+			AABB acc;
+			unsigned int accCount = 0;
+			for (unsigned int b = NUM_OF_BINS - 1; b > 0; b--) {
+				acc.extend (bins[b]);
+				accCount += exits[b];
+				rightBounds[b] = acc;
+				rightCounts[b] = accCount;
+			}
+			acc = AABB ();
+			accCount = 0;
+			for (unsigned int b = 1; b < NUM_OF_BINS; b++) {
+				acc.extend (bins[b-1]);
+				accCount += entries[b-1];
+				if (accCount == 0 || rightCounts[b] == 0)
+					continue;
+				size_t duplicates = accCount + rightCounts[b] - n;
+				if (duplicates > m_remainingDuplicates)
+					continue;
+				float cost = TRAVERSAL_COST + INTERSECTION_COST * invArea * (acc.surfaceArea () * accCount + rightBounds[b].surfaceArea () * rightCounts[b]);
+				if (cost < bestSpatialCost) {
+					bestSpatialCost = cost;
+					spatialAxis = axis;
+					spatialBin = b;
+				}
+			}
+		}
+	}
+
+	float bestCost = std::min (bestObjectCost, bestSpatialCost);
+	float leafCost = INTERSECTION_COST * n;
+	if ((objectAxis < 0 && spatialAxis < 0) || (n <= MAX_LEAF_SIZE && leafCost <= bestCost)) {
+		makeLeaf (nodeIndex, references);
+		return;
+	}
+
+	std::vector<Reference> left, right;
+	AABB leftBounds, rightBounds;
+	if (bestSpatialCost < bestObjectCost) {
+		int axis = spatialAxis;
+		float lo = nodeBounds.pMin[axis];
+		float binWidth = (nodeBounds.pMax[axis] - lo) / NUM_OF_BINS;
+		float invBinWidth = 1.f / binWidth;
+		float plane = lo + spatialBin * binWidth;
+		for (const auto & r : references) {
+			if (!m_splittable[r.triangle]) {
+				if (binIndex (r.bounds.centroid ()[axis], lo, invBinWidth) < spatialBin)
+					left.push_back (r);
+				else
+					right.push_back (r);
+			} else if (r.bounds.pMax[axis] <= plane) {
+				left.push_back (r);
+			} else if (r.bounds.pMin[axis] >= plane) {
+				right.push_back (r);
+			} else {
+				const Triangle & t = m_triangles[r.triangle];
+				Reference lr = r, rr = r;
+				lr.bounds = clipTriangle (t, axis, r.bounds.pMin[axis], plane).intersection (r.bounds);
+				rr.bounds = clipTriangle (t, axis, plane, r.bounds.pMax[axis]).intersection (r.bounds);
+				if (!lr.bounds.isEmpty ())
+					left.push_back (lr);
+				if (!rr.bounds.isEmpty ())
+					right.push_back (rr);
+			}
+		}
+		size_t duplicates = left.size () + right.size () - n;
+		m_remainingDuplicates -= std::min (m_remainingDuplicates, duplicates);
+	} else {
+		int axis = objectAxis;
+		float lo = centroidBounds.pMin[axis];
+		float invBinWidth = NUM_OF_BINS / (centroidBounds.pMax[axis] - lo);
+		for (const auto & r : references) {
+			if (binIndex (r.bounds.centroid ()[axis], lo, invBinWidth) < objectBin)
+				left.push_back (r);
+			else
+				right.push_back (r);
+		}
+	}
+	if (left.empty () || right.empty ()) {
+		makeLeaf (nodeIndex, references);
+		return;
+	}
+	for (const auto & r : left)
+		leftBounds.extend (r.bounds);
+	for (const auto & r : right)
+		rightBounds.extend (r.bounds);
+	references.clear ();
+	references.shrink_to_fit ();
+
+	unsigned int leftIndex = static_cast<unsigned int> (m_nodes.size ());
+	m_nodes.push_back (Node ());
+	m_nodes.push_back (Node ());
+	m_nodes[leftIndex].bounds = leftBounds;
+	m_nodes[leftIndex+1].bounds = rightBounds;
+	m_nodes[nodeIndex].offset = leftIndex;
+	m_nodes[nodeIndex].count = 0;
+	buildNode (leftIndex, left, depth + 1);
+	buildNode (leftIndex + 1, right, depth + 1);
+}
+
+/// Slab test. Returns the entry distance, or infinity if the box is missed within ]0, tMax[.
+static inline float intersectBox (const AABB & b, const glm::vec3 & origin, const glm::vec3 & invDirection, float tMax) {
+	glm::vec3 t0 = (b.pMin - origin) * invDirection;
+	glm::vec3 t1 = (b.pMax - origin) * invDirection;
+	glm::vec3 tNear = glm::min (t0, t1);
+	glm::vec3 tFar = glm::max (t0, t1);
+	float tEnter = std::max (std::max (tNear.x, tNear.y), std::max (tNear.z, 0.f));
+	float tExit = std::min (std::min (tFar.x, tFar.y), std::min (tFar.z, tMax));
+	return (tEnter <= tExit ? tEnter : std::numeric_limits<float>::infinity ());
+}
+
+bool BVH::intersect (const Ray & ray, Hit & hit) const {
+	if (m_nodes.empty ())
+		return false;
+	const glm::vec3 invDirection = 1.f / ray.direction;
+	unsigned int stack[MAX_DEPTH + 1];
+	float stackEntry[MAX_DEPTH + 1];
+	int stackSize = 0;
+	bool found = false;
+	float tRoot = intersectBox (m_nodes[0].bounds, ray.origin, invDirection, hit.t);
+	if (tRoot == std::numeric_limits<float>::infinity ())
+		return false;
+	stack[stackSize] = 0;
+	stackEntry[stackSize++] = tRoot;
+	while (stackSize > 0) {
+		--stackSize;
+		if (stackEntry[stackSize] >= hit.t)
+			continue; // A closer hit was found since this node was pushed
+		const Node & node = m_nodes[stack[stackSize]];
+		if (node.count > 0) {
+			for (unsigned int i = 0; i < node.count; i++) {
+				const Triangle & t = m_triangles[m_references[node.offset + i]];
+				if (ray.rayTriangleIntersection (t.p0, t.p1, t.p2, hit)) {
+					hit.setMesh (t.meshIndex);
+					hit.setSimp (t.simpIndex);
+					found = true;
+				}
+			}
+			continue;
+		}
+		// Visit the nearest child first: push the farthest one below it
+		unsigned int nearChild = node.offset, farChild = node.offset + 1;
+		float tNear = intersectBox (m_nodes[nearChild].bounds, ray.origin, invDirection, hit.t);
+		float tFar = intersectBox (m_nodes[farChild].bounds, ray.origin, invDirection, hit.t);
+		if (tFar < tNear) {
+			std::swap (nearChild, farChild);
+			std::swap (tNear, tFar);
+		}
+		if (tFar != std::numeric_limits<float>::infinity ()) {
+			stack[stackSize] = farChild;
+			stackEntry[stackSize++] = tFar;
+		}
+		if (tNear != std::numeric_limits<float>::infinity ()) {
+			stack[stackSize] = nearChild;
+			stackEntry[stackSize++] = tNear;
+		}
+	}
+	return found;
+}
+
+bool BVH::occluded (const Ray & ray, float tMax) const {
+	if (m_nodes.empty ())
+		return false;
+	const glm::vec3 invDirection = 1.f / ray.direction;
+	unsigned int stack[MAX_DEPTH + 1];
+	int stackSize = 0;
+	if (intersectBox (m_nodes[0].bounds, ray.origin, invDirection, tMax) == std::numeric_limits<float>::infinity ())
+		return false;
+	stack[stackSize++] = 0;
+	Hit hit (ray.origin, ray.direction, tMax);
+	while (stackSize > 0) {
+		const Node & node = m_nodes[stack[--stackSize]];
+		if (node.count > 0) {
+			for (unsigned int i = 0; i < node.count; i++) {
+				const Triangle & t = m_triangles[m_references[node.offset + i]];
+				if (ray.rayTriangleIntersection (t.p0, t.p1, t.p2, hit))
+					return true;
+			}
+			continue;
+		}
+		for (unsigned int child = node.offset; child < node.offset + 2; child++)
+			if (intersectBox (m_nodes[child].bounds, ray.origin, invDirection, tMax) != std::numeric_limits<float>::infinity ())
+				stack[stackSize++] = child;
+	}
+	return false;
+}
@@ -0,0 +1,119 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <limits>
+
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+
+#include "Ray.h"
+#include "Hit.h"
+#include "Scene.h"
+
+/// Axis aligned bounding box. Empty (inverted) by default.
+struct AABB {
+	glm::vec3 pMin = glm::vec3 (std::numeric_limits<float>::max ());
+	glm::vec3 pMax = glm::vec3 (-std::numeric_limits<float>::max ());
+
+	inline void extend (const glm::vec3 & p) { pMin = glm::min (pMin, p); pMax = glm::max (pMax, p); }
+	inline void extend (const AABB & b) { pMin = glm::min (pMin, b.pMin); pMax = glm::max (pMax, b.pMax); }
+	inline bool isEmpty () const { return pMin.x > pMax.x || pMin.y > pMax.y || pMin.z > pMax.z; }
+	inline glm::vec3 centroid () const { return 0.5f * (pMin + pMax); }
+	inline float surfaceArea () const {
+		if (isEmpty ())
+			return 0.f;
+		glm::vec3 d = pMax - pMin;
+		return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+	inline AABB intersection (const AABB & b) const {
+		AABB r;
+		r.pMin = glm::max (pMin, b.pMin);
+		r.pMax = glm::min (pMax, b.pMax);
+		return r;
+	}
+};
+
+/// Build strategies for the ray tracing acceleration structure.
+enum class BVHBuildMode {
+	Binned, ///< Binned SAH object splits. Only meshes flagged with Mesh::setSpatialSplits get their triangles clipped.
+	Spatial ///< Split BVH (SBVH) for the whole scene: any triangle reference may be clipped by a spatial split.
+};
+
+/// Bounding volume hierarchy over the world space triangles of a scene.
+/// Supports the SBVH construction of Stich et al. 2009, where triangle references
+/// straddling a split plane are clipped and duplicated on both sides, within a budget.
+class BVH {
+public:
+	struct Node {
+		AABB bounds;
+		unsigned int offset; // First reference for leaves, left child otherwise (the right child is offset+1)
+		unsigned int count; // Number of references in a leaf, 0 for interior nodes
+	};
+
+	struct Triangle {
+		glm::vec3 p0, p1, p2;
+		int meshIndex;
+		int simpIndex;
+	};
+
+	inline BVH () {}
+	virtual ~BVH () {}
+
+	inline BVHBuildMode buildMode () const { return m_buildMode; }
+	inline void setBuildMode (BVHBuildMode mode) { m_buildMode = mode; }
+
+	/// Maximum number of extra references created by spatial splits, as a ratio of the triangle count.
+	inline float duplicationBudget () const { return m_duplicationBudget; }
+	inline void setDuplicationBudget (float ratio) { m_duplicationBudget = std::max (0.f, ratio); }
+
+	inline bool isEmpty () const { return m_nodes.empty (); }
+	inline size_t numOfNodes () const { return m_nodes.size (); }
+	inline size_t numOfReferences () const { return m_references.size (); }
+	inline size_t numOfTriangles () const { return m_triangles.size (); }
+	inline const std::vector<Node> & nodes () const { return m_nodes; }
+
+	/// Bytes of the hierarchy and of its world space triangles.
+	inline size_t memoryUsage () const {
+		return m_nodes.capacity () * sizeof (Node) + m_references.capacity () * sizeof (unsigned int)
+			+ m_triangles.capacity () * sizeof (Triangle) + m_splittable.capacity () / 8;
+	}
+
+	/// Gather the scene triangles in world space and build the hierarchy.
+	void build (const std::shared_ptr<Scene> scenePtr);
+
+	void clear ();
+
+	/// Closest intersection along the ray with t in ]0, hit.t[. Updates hit on success.
+	bool intersect (const Ray & ray, Hit & hit) const;
+
+	/// Any intersection along the ray with t in ]0, tMax[, for shadow rays.
+	bool occluded (const Ray & ray, float tMax) const;
+
+private:
+	struct Reference {
+		AABB bounds;
+		unsigned int triangle;
+	};
+
+	void buildNode (unsigned int nodeIndex, std::vector<Reference> & references, unsigned int depth);
+	void makeLeaf (unsigned int nodeIndex, const std::vector<Reference> & references);
+
+	BVHBuildMode m_buildMode = BVHBuildMode::Binned;
+	float m_duplicationBudget = 0.3f;
+	float m_rootArea = 0.f;
+	size_t m_remainingDuplicates = 0;
+
+	std::vector<Node> m_nodes;
+	std::vector<unsigned int> m_references; // Triangle index of each leaf reference
+	std::vector<Triangle> m_triangles;
+	std::vector<bool> m_splittable; // Per triangle, whether spatial splits may clip it
+};
@@ -0,0 +1,457 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+
+// Headless ray tracing: builds the scene of the interactive program, or reads a scene description, renders it and
+// writes the image, or a numbered image per frame along a camera path. Renders either here or on a render server,
+// which this program also runs. Uses neither GLFW nor OpenGL, so that it runs on servers without display.
+
+#include <cstdlib>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <exception>
+#include <functional>
+#include <cstdio>
+#include <csignal>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+#include "Resources.h"
+#include "Console.h"
+#include "MeshLoader.h"
+#include "EnvironmentMap.h"
+#include "Scene.h"
+#include "SceneDescription.h"
+#include "RayTracer.h"
+#include "RenderSettings.h"
+#include "Framebuffer.h"
+#include "CameraPath.h"
+#include "AsyncWriter.h"
+#include "Socket.h"
+#include "RenderServer.h"
+
+// Input
+static std::string meshFilename;
+static std::string environmentMapFilename;
+static std::string sceneFilename; // Scene description to render instead of the mesh, if any
+static std::string cameraPathFilename; // Camera path of a sequence, if any
+static unsigned int numOfTurntableFrames = 0; // Frames of a turntable sequence, if any
+static unsigned int numOfFrames = 0; // Frames of the sequence, up to the last keyframe of its path if 0
+
+// Output
+static std::string outputFilename ("render.ppm");
+static std::string sceneOutputFilename; // Where to write the description of the rendered scene, if anywhere
+
+// Render
+static std::shared_ptr<RayTracer> rayTracerPtr;
+static RenderSettings settings;
+static double timeBudget = 0.0;
+static bool spatialSplits = false;
+static std::string checkpointFilename; // Where to checkpoint a single image render, if anywhere
+static double checkpointInterval = 60.0;
+static volatile std::sig_atomic_t interrupted = 0;
+
+// Render server
+static std::string serveAddress; // Where to serve renders instead of rendering, if anywhere
+static std::string serverAddress; // Server to render on, if any
+static size_t cacheBudget = SceneCache::DEFAULT_MEMORY_BUDGET;
+static std::shared_ptr<RenderServer> serverPtr;
+
+void usage (const char * command) {
+	Console::print ("Usage : " + std::string (command) + " [options] [<meshfile.off> [<environment.hdr>]]\n"
+					+ "        " + std::string (command) + " [options] --scene <scene.txt>\n"
+					+ "        " + std::string (command) + " --serve <address> [--cache-budget <MB>] [--sbvh]\n"
+					+ "Options:\n"
+					+ "\t--output <image.ppm|image.exr>: image to write, render.ppm by default. EXR images include the AOVs\n"
+					+ "\t--size <width> <height>: resolution, 1024x768 by default\n"
+					+ "\t--samples <n>: samples per pixel\n"
+					+ "\t--bounces <n>: number of bounces\n"
+					+ "\t--light-samples <n>: light samples per shading point\n"
+					+ "\t--mode <megakernel|wavefront|visibility>: ray tracing mode\n"
+					+ "\t--sampler <sobol|bluenoise|random>: sampler\n"
+					+ "\t--seed <n>: seed of the sampler\n"
+					+ "\t--adaptive <threshold>: adaptive sampling, to the given relative error\n"
+					+ "\t--time-budget <seconds>: stop sampling after this time\n"
+					+ "\t--denoise: denoise the image\n"
+					+ "\t--sbvh: build the BVH with spatial splits\n"
+					+ "\t--checkpoint <file>: save the progress of the render to the file, and resume from it if it exists\n"
+					+ "\t--checkpoint-interval <seconds>: time between checkpoints, 60 by default\n"
+					+ "\t--serve <address>: serve renders to the clients connecting at the address, host:port or unix:<path>, until interrupted\n"
+					+ "\t--cache-budget <MB>: memory of the meshes and BVHs kept by the server across renders, 1024 by default\n"
+					+ "\t--server <address>: render on the server at the address, to PPM images only\n"
+					+ "\t--write-scene <scene.txt>: write the description of the rendered scene, to edit it and render it with --scene\n"
+					+ "\t--turntable <n>: render a sequence of n frames orbiting the camera around the main mesh\n"
+					+ "\t--camera-path <path.txt>: render a sequence along the camera keyframes of the file (see CameraPath)\n"
+					+ "\t--frames <n>: number of frames of the camera path sequence, up to its last keyframe by default\n"
+					+ "Sequences write one image per frame, numbered after the output filename, e.g., render_0000.ppm.\n"
+					+ "Interrupted checkpointed renders, e.g., by Ctrl-C, checkpoint their progress and resume when run again.");
+	std::exit (EXIT_FAILURE);
+}
+
+void parseCommandLine (int argc, char ** argv) {
+	settings = RenderSettings::capture (*rayTracerPtr, 1024, 768);
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		// The n values following the option, skipped by the loop
+		auto values = [&] (int n) {
+			if (i + n >= argc)
+				usage (argv[0]);
+			char ** v = argv + i + 1;
+			i += n;
+			return v;
+		};
+		if (arg == "--output")
+			outputFilename = values (1)[0];
+		else if (arg == "--scene")
+			sceneFilename = values (1)[0];
+		else if (arg == "--write-scene")
+			sceneOutputFilename = values (1)[0];
+		else if (arg == "--turntable")
+			numOfTurntableFrames = unsigned (std::atoi (values (1)[0]));
+		else if (arg == "--camera-path")
+			cameraPathFilename = values (1)[0];
+		else if (arg == "--frames")
+			numOfFrames = unsigned (std::atoi (values (1)[0]));
+		else if (arg == "--size") {
+			char ** v = values (2);
+			settings.width = std::strtoul (v[0], nullptr, 10);
+			settings.height = std::strtoul (v[1], nullptr, 10);
+		} else if (arg == "--samples")
+			settings.numOfSamples = unsigned (std::atoi (values (1)[0]));
+		else if (arg == "--bounces")
+			settings.numOfBounces = unsigned (std::atoi (values (1)[0]));
+		else if (arg == "--light-samples")
+			settings.numOfLightSamples = unsigned (std::atoi (values (1)[0]));
+		else if (arg == "--mode") {
+			std::string mode = values (1)[0];
+			if (mode == "megakernel")
+				settings.renderMode = RenderMode::Megakernel;
+			else if (mode == "wavefront")
+				settings.renderMode = RenderMode::Wavefront;
+			else if (mode == "visibility")
+				settings.renderMode = RenderMode::VisibilityBuffer;
+			else
+				usage (argv[0]);
+		} else if (arg == "--sampler") {
+			std::string type = values (1)[0];
+			if (type == "sobol")
+				settings.samplerType = SamplerType::Sobol;
+			else if (type == "bluenoise")
+				settings.samplerType = SamplerType::BlueNoise;
+			else if (type == "random")
+				settings.samplerType = SamplerType::Random;
+			else
+				usage (argv[0]);
+		} else if (arg == "--seed")
+			settings.seed = uint32_t (std::strtoul (values (1)[0], nullptr, 10));
+		else if (arg == "--adaptive") {
+			settings.adaptiveSampling = true;
+			settings.adaptiveThreshold = float (std::atof (values (1)[0]));
+		} else if (arg == "--time-budget")
+			timeBudget = std::atof (values (1)[0]);
+		else if (arg == "--denoise")
+			settings.denoising = true;
+		else if (arg == "--sbvh")
+			spatialSplits = true;
+		else if (arg == "--checkpoint")
+			checkpointFilename = values (1)[0];
+		else if (arg == "--checkpoint-interval")
+			checkpointInterval = std::atof (values (1)[0]);
+		else if (arg == "--serve")
+			serveAddress = values (1)[0];
+		else if (arg == "--server")
+			serverAddress = values (1)[0];
+		else if (arg == "--cache-budget")
+			cacheBudget = size_t (std::strtoull (values (1)[0], nullptr, 10)) << 20;
+		else if (arg.compare (0, 2, "--") == 0)
+			usage (argv[0]);
+		else
+			files.push_back (arg);
+	}
+	if (files.size () > 2 || (!sceneFilename.empty () && !files.empty ()) || settings.width == 0 || settings.height == 0
+		|| (numOfTurntableFrames > 0 && !cameraPathFilename.empty ())
+		|| (!checkpointFilename.empty () && (numOfTurntableFrames > 0 || !cameraPathFilename.empty ()))
+		|| (!serverAddress.empty () && (!checkpointFilename.empty () || timeBudget > 0.0
+										|| (outputFilename.size () >= 4 && outputFilename.compare (outputFilename.size () - 4, 4, ".exr") == 0))))
+		usage (argv[0]);
+	meshFilename = (files.size () >= 1 ? files[0] : DEFAULT_MESH_FILENAME);
+	environmentMapFilename = (files.size () >= 2 ? files[1] : "");
+}
+
+/// Scene of the interactive program: the mesh above a square, lit by three lights and framed by the camera.
+std::shared_ptr<Scene> initScene () {
+	auto scenePtr = std::make_shared<Scene> ();
+	scenePtr->setBackgroundColor (glm::vec3 (0.1f, 0.5f, 0.95f));
+	if (!environmentMapFilename.empty ()) {
+		auto environmentMapPtr = std::make_shared<EnvironmentMap> ();
+		if (environmentMapPtr->load (environmentMapFilename))
+			scenePtr->setEnvironmentMap (environmentMapPtr);
+	}
+
+	auto meshPtr = std::make_shared<Mesh> ();
+	MeshLoader::loadOFF (meshFilename, meshPtr);
+	meshPtr->setScale (0.5f);
+	glm::vec3 center;
+	float meshScale;
+	meshPtr->computeBoundingSphere (center, meshScale);
+	meshPtr->material ().setTextureScale (0.5f * meshScale);
+	scenePtr->add (meshPtr);
+
+	auto squareMeshPtr = std::make_shared<Mesh> ();
+	MeshLoader::loadSquare (squareMeshPtr);
+	squareMeshPtr->setTranslation (glm::vec3 (0.f, 0.f, -0.5f));
+	squareMeshPtr->setSpatialSplits (true);
+	scenePtr->add (squareMeshPtr);
+
+	auto & lightSources = scenePtr->lightSources ();
+	float scaleAwareIntensity = meshScale * 6.f;
+	scaleAwareIntensity *= scaleAwareIntensity;
+	glm::vec3 positions[3] = {
+		normalize (glm::vec3 (0.f, 2.f, 2.f)),
+		normalize (glm::vec3 (-2.f, 0.f, 0.f)),
+		normalize (glm::vec3 (2.f, 0.f, 0.f))
+	};
+	glm::vec3 colors[3] = {
+		glm::vec3 (1.f),
+		glm::vec3 (0.f, 0.4f, 0.8f),
+		glm::vec3 (0.9f, 0.3f, 0.f)
+	};
+	lightSources.reserve (3);
+	for (int i = 0; i < 3; i++) {
+		lightSources.emplace_back ();
+		LightSource & light = lightSources.back ();
+		light.setTranslation (center + positions[i] * meshScale * 3.f);
+		light.setColor (colors[i]);
+		light.setIntensity (scaleAwareIntensity);
+	}
+
+	auto cameraPtr = std::make_shared<Camera> ();
+	cameraPtr->setAspectRatio (float (settings.width) / float (settings.height));
+	cameraPtr->setTranslation (center + glm::vec3 (0.0, 0.0, 3.0 * meshScale));
+	cameraPtr->setNear (0.1f);
+	cameraPtr->setFar (100.f * meshScale);
+	scenePtr->set (cameraPtr);
+	return scenePtr;
+}
+
+/// Description of the scene file, with the aspect ratio of the output.
+SceneDescription readScene () {
+	std::ifstream in (sceneFilename);
+	SceneDescription description;
+	if (!in || !description.read (in)) {
+		Console::print ("Cannot read scene description " + sceneFilename);
+		std::exit (EXIT_FAILURE);
+	}
+	description.camera.aspectRatio = float (settings.width) / float (settings.height);
+	return description;
+}
+
+/// Write the description of the rendered scene, if asked to. Returns false on failure.
+bool writeScene (const SceneDescription & description) {
+	if (sceneOutputFilename.empty ())
+		return true;
+	std::ofstream out (sceneOutputFilename);
+	if (!out) {
+		Console::print ("Cannot write scene description " + sceneOutputFilename);
+		return false;
+	}
+	description.write (out);
+	return true;
+}
+
+/// Center of the main mesh, in world space.
+glm::vec3 sceneCenter (const Scene & scene) {
+	glm::vec3 center;
+	float radius;
+	scene.mesh (0)->computeBoundingSphere (center, radius);
+	return glm::vec3 (scene.mesh (0)->computeTransformMatrix () * glm::vec4 (center, 1.f));
+}
+
+/// Camera path of the file, if any.
+CameraPath readCameraPath () {
+	CameraPath path;
+	if (!cameraPathFilename.empty ()) {
+		std::ifstream in (cameraPathFilename);
+		if (!in || !path.read (in) || path.empty ()) {
+			Console::print ("Cannot read camera path " + cameraPathFilename);
+			std::exit (EXIT_FAILURE);
+		}
+	}
+	return path;
+}
+
+/// Camera path of the sequence to render, empty for a single image.
+CameraPath initCameraPath (const Scene & scene) {
+	if (numOfTurntableFrames > 0)
+		return CameraPath::turntable (*scene.camera (), sceneCenter (scene), numOfTurntableFrames);
+	return readCameraPath ();
+}
+
+/// Output filename of a frame: the frame number inserted before the extension.
+std::string frameFilename (unsigned int frame) {
+	char number[16];
+	std::snprintf (number, sizeof (number), "_%04u", frame);
+	size_t dot = outputFilename.rfind ('.');
+	size_t slash = outputFilename.find_last_of ("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return outputFilename + number;
+	return outputFilename.substr (0, dot) + number + outputFilename.substr (dot);
+}
+
+/// Write of the last render to the file, on a copy of its image or AOVs, so that the next render may start meanwhile.
+std::function<bool ()> imageWrite (const std::string & filename) {
+	if (rayTracerPtr->framebuffer ()) {
+		auto framebufferPtr = std::make_shared<Framebuffer> (*rayTracerPtr->framebuffer ());
+		return [framebufferPtr, filename] () { return framebufferPtr->saveEXR (filename); };
+	}
+	auto imagePtr = std::make_shared<Image> (*rayTracerPtr->image ());
+	return [imagePtr, filename] () {
+		imagePtr->savePPM (filename);
+		Console::print ("Image written to " + filename);
+		return true;
+	};
+}
+
+/// Cancel the render, which checkpoints its progress, or stop the server, instead of terminating.
+void interrupt (int) {
+	interrupted = 1;
+	if (serverPtr)
+		serverPtr->stop ();
+	else
+		rayTracerPtr->cancel ();
+}
+
+/// Render the frames of the path, or the scene if there is none, on the server, which queues them, and write their
+/// images as they arrive. Returns false on failure.
+bool renderOnServer (SceneDescription description, const CameraPath & path) {
+	Socket socket = Socket::connect (serverAddress);
+	if (!socket.valid ()) {
+		Console::print ("Cannot connect to the render server at " + serverAddress);
+		return false;
+	}
+	Camera camera;
+	camera.setScale (description.camera.scale);
+	unsigned int n = path.empty () ? 1 : (numOfFrames > 0 ? numOfFrames : path.numOfFrames ());
+	for (unsigned int frame = 0; frame < n; frame++) {
+		if (!path.empty ()) {
+			path.apply (float (frame), camera);
+			description.camera.translation = camera.getTranslation ();
+			description.camera.rotation = camera.getRotation ();
+			description.camera.fov = camera.getFoV ();
+		}
+		if (!socket.send ("render " + std::to_string (frame) + "\n" + settings.toString () + "\n" + description.toString ()))
+			break;
+	}
+	unsigned int numOfDoneFrames = 0;
+	std::string message;
+	while (numOfDoneFrames < n && socket.receive (message)) {
+		size_t headerSize = message.find ('\n');
+		std::istringstream header (message.substr (0, headerSize));
+		std::string keyword;
+		unsigned int frame = 0;
+		header >> keyword >> frame;
+		if (keyword == "error") {
+			std::string error;
+			std::getline (header, error);
+			Console::print ("Render server failed:" + error);
+			return false;
+		} else if (keyword != "done")
+			continue;
+		Image image (settings.width, settings.height);
+		size_t payloadSize = image.pixels ().size () * sizeof (glm::vec3);
+		if (headerSize == std::string::npos || message.size () - headerSize - 1 != payloadSize) {
+			Console::print ("Malformed image from the render server");
+			return false;
+		}
+		std::memcpy (&image[0], message.data () + headerSize + 1, payloadSize);
+		std::string filename = path.empty () ? outputFilename : frameFilename (frame);
+		image.savePPM (filename);
+		Console::print ("Image written to " + filename);
+		numOfDoneFrames++;
+	}
+	if (numOfDoneFrames < n)
+		Console::print ("Connection to the render server lost");
+	return numOfDoneFrames == n;
+}
+
+int main (int argc, char ** argv) {
+	rayTracerPtr = std::make_shared<RayTracer> ();
+	parseCommandLine (argc, argv);
+	if (!serveAddress.empty ()) {
+		serverPtr = std::make_shared<RenderServer> (cacheBudget);
+		if (spatialSplits)
+			serverPtr->setBVHBuildMode (BVHBuildMode::Spatial);
+		std::signal (SIGINT, interrupt);
+		std::signal (SIGTERM, interrupt);
+		return serverPtr->run (serveAddress) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	// The meshes of scene files are left to the render server, unless the turntable needs their center
+	if (!serverAddress.empty () && !sceneFilename.empty () && numOfTurntableFrames == 0) {
+		SceneDescription description = readScene ();
+		return writeScene (description) && renderOnServer (description, readCameraPath ()) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	TextureCache textureCache;
+	std::shared_ptr<Scene> scenePtr;
+	try {
+		scenePtr = sceneFilename.empty () ? initScene () : readScene ().build (textureCache);
+	} catch (std::exception & e) {
+		Console::print (std::string ("[Error loading mesh]") + e.what ());
+		return EXIT_FAILURE;
+	}
+	SceneDescription description;
+	if ((!sceneOutputFilename.empty () || !serverAddress.empty ()) && !description.describe (*scenePtr)) {
+		Console::print ("Cannot describe the scene, its meshes were not all loaded from files");
+		return EXIT_FAILURE;
+	}
+	if (!writeScene (description))
+		return EXIT_FAILURE;
+	CameraPath path = initCameraPath (*scenePtr);
+	if (!serverAddress.empty ())
+		return renderOnServer (description, path) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	settings.apply (*rayTracerPtr);
+	rayTracerPtr->setTimeBudget (timeBudget);
+	if (spatialSplits)
+		rayTracerPtr->setBVHBuildMode (BVHBuildMode::Spatial);
+	if (outputFilename.size () >= 4 && outputFilename.compare (outputFilename.size () - 4, 4, ".exr") == 0)
+		rayTracerPtr->setFramebuffer (std::make_shared<Framebuffer> ());
+	// The BVH is built once: along camera paths, only the camera moves
+	rayTracerPtr->init (scenePtr);
+	if (path.empty ()) {
+		if (!checkpointFilename.empty ()) {
+			rayTracerPtr->setCheckpointFilename (checkpointFilename);
+			rayTracerPtr->setCheckpointInterval (checkpointInterval);
+			std::signal (SIGINT, interrupt);
+			std::signal (SIGTERM, interrupt);
+		}
+		rayTracerPtr->render (scenePtr);
+		// The image of an interrupted render is written all the same, but the render is not complete
+		bool written = imageWrite (outputFilename) ();
+		if (interrupted)
+			Console::print ("Render interrupted, progress saved to " + checkpointFilename);
+		return written && !interrupted ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// Frames are rendered from scratch, the history of the previous frame would leak into the next one
+	rayTracerPtr->setTemporalReprojection (false);
+	unsigned int n = (numOfFrames > 0 ? numOfFrames : path.numOfFrames ());
+	AsyncWriter writer;
+	for (unsigned int frame = 0; frame < n; frame++) {
+		Console::print ("Frame " + std::to_string (frame + 1) + "/" + std::to_string (n));
+		path.apply (float (frame), *scenePtr->camera ());
+		rayTracerPtr->render (scenePtr);
+		// Written while the next frame is traced
+		writer.submit (imageWrite (frameFilename (frame)));
+	}
+	return writer.flush () ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -19,6 +19,39 @@
 #include "Transform.h"
 #include "Ray.h"
 
+/// Camera basis and image plane extent, computed once to generate many primary rays.
+struct CameraFrame {
+	glm::vec3 eye;
+	glm::vec3 right;
+	glm::vec3 up;
+	glm::vec3 front;
+	float w; // Image plane height at unit distance
+	float aspectRatio;
+	glm::vec2 windowOrigin = glm::vec2 (0.f); // Rendered sub-rectangle of the image plane, see Camera::setWindow
+	glm::vec2 windowSize = glm::vec2 (1.f);
+
+	/// Direction of the ray through the normalized image coordinates (x, y) of the window
+	inline glm::vec3 directionAt (float x, float y) const {
+		x = windowOrigin.x + x * windowSize.x;
+		y = windowOrigin.y + y * windowSize.y;
+		return normalize (front + ((x - 0.5f) * aspectRatio * w) * right + ((1.f-y) - 0.5f) * w * up);
+	}
+
+	inline Ray rayAt (float x, float y) const { return Ray (eye, directionAt (x, y)); }
+
+	/// Normalized image coordinates xy of the ray through the point p, the inverse of directionAt. Returns false if p
+	/// lies behind the camera.
+	inline bool project (const glm::vec3 & p, glm::vec2 & xy) const {
+		glm::vec3 d = p - eye;
+		float z = dot (d, front);
+		if (z <= 0.f)
+			return false;
+		xy.x = (dot (d, right) / (z * aspectRatio * w) + 0.5f - windowOrigin.x) / windowSize.x;
+		xy.y = (0.5f - dot (d, up) / (z * w) - windowOrigin.y) / windowSize.y;
+		return true;
+	}
+};
+
 /// Basic camera model
 class Camera : public Transform {
 public:
@@ -30,6 +63,14 @@ public:
 	inline void setNear (float n) { m_near = n; }
 	inline float getFar () const { return m_far; }
 	inline void setFar (float n) { m_far = n; }
+
+	/// Sub-rectangle of the image plane rendered by the ray tracer, in the normalized image coordinates of
+	/// CameraFrame::directionAt, with y pointing up. The whole image by default. Rendering a window at the resolution
+	/// of the corresponding pixels of the whole image traces the same rays, e.g., for the tiles of a distributed render.
+	/// The rasterizer ignores it.
+	inline const glm::vec2 & windowOrigin () const { return m_windowOrigin; }
+	inline const glm::vec2 & windowSize () const { return m_windowSize; }
+	inline void setWindow (const glm::vec2 & origin, const glm::vec2 & size) { m_windowOrigin = origin; m_windowSize = size; }
 	
 	/**
 	 *  The view matrix is the inverse of the camera model matrix, 
@@ -44,11 +85,16 @@ public:
 	inline glm::mat4 computeProjectionMatrix () const {	return glm::perspective (glm::radians (m_fov), m_aspectRatio, m_near, m_far); }
 	Ray rayAt(float x, float y) const ;
 
+	/// Frame used by rayAt. Prefer it to rayAt when generating rays for a whole image.
+	CameraFrame computeFrame () const;
+
 private:
 	float m_fov = 45.f; // Vertical field of view, in degrees
 	float m_aspectRatio = 1.f; // Ratio between the width and the height of the image
 	float m_near = 0.1f; // Distance before which geometry is excluded fromt he rasterization process
 	float m_far = 10.f; // Distance after which the geometry is excluded fromt he rasterization process
+	glm::vec2 m_windowOrigin = glm::vec2 (0.f);
+	glm::vec2 m_windowSize = glm::vec2 (1.f);
 	glm::quat curQuat;
 	glm::quat lastQuat;
 };
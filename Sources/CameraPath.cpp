@@ -0,0 +1,113 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "CameraPath.h"
+
+#include <sstream>
+#include <limits>
+#include <algorithm>
+
+#include <glm/ext.hpp>
+#include <glm/gtx/euler_angles.hpp>
+
+/// Orientation and eye position of a pose, for a camera of the given scale (see Transform::computeTransformMatrix).
+static void worldPose (const CameraKeyframe & keyframe, float scale, glm::mat3 & orientation, glm::vec3 & eye) {
+	orientation = glm::mat3 (glm::eulerAngleXYZ (keyframe.rotation.x, keyframe.rotation.y, keyframe.rotation.z));
+	eye = scale * (orientation * keyframe.translation);
+}
+
+/// Camera translation and rotation of a world pose.
+static void cameraPose (const glm::mat3 & orientation, const glm::vec3 & eye, float scale, CameraKeyframe & keyframe) {
+	glm::extractEulerAngleXYZ (glm::mat4 (orientation), keyframe.rotation.x, keyframe.rotation.y, keyframe.rotation.z);
+	keyframe.translation = transpose (orientation) * eye / scale;
+}
+
+void CameraPath::add (const CameraKeyframe & keyframe) {
+	auto it = std::upper_bound (m_keyframes.begin (), m_keyframes.end (), keyframe.frame,
+								[] (float frame, const CameraKeyframe & k) { return frame < k.frame; });
+	m_keyframes.insert (it, keyframe);
+}
+
+void CameraPath::apply (float frame, Camera & camera) const {
+	if (m_keyframes.empty ())
+		return;
+	// Segment [i, i + 1] of the frame, a single keyframe outside of the path
+	size_t i = std::upper_bound (m_keyframes.begin (), m_keyframes.end (), frame,
+								 [] (float f, const CameraKeyframe & k) { return f < k.frame; }) - m_keyframes.begin ();
+	size_t last = m_keyframes.size () - 1;
+	i = (i > 0 ? i - 1 : 0);
+	size_t next = std::min (i + 1, last);
+	float span = m_keyframes[next].frame - m_keyframes[i].frame;
+	float u = (span > 0.f ? glm::clamp ((frame - m_keyframes[i].frame) / span, 0.f, 1.f) : 0.f);
+
+	float scale = camera.getScale ();
+	glm::mat3 orientations[4];
+	glm::vec3 eyes[4];
+	size_t indices[4] = { i > 0 ? i - 1 : i, i, next, std::min (next + 1, last) };
+	for (int k = 0; k < 4; k++)
+		worldPose (m_keyframes[indices[k]], scale, orientations[k], eyes[k]);
+	// Uniform Catmull-Rom spline through the eyes
+	glm::vec3 eye = 0.5f * (2.f * eyes[1]
+							+ (eyes[2] - eyes[0]) * u
+							+ (2.f * eyes[0] - 5.f * eyes[1] + 4.f * eyes[2] - eyes[3]) * u * u
+							+ (3.f * eyes[1] - eyes[0] - 3.f * eyes[2] + eyes[3]) * u * u * u);
+	glm::quat orientation = glm::slerp (glm::quat_cast (orientations[1]), glm::quat_cast (orientations[2]), u);
+	CameraKeyframe pose;
+	cameraPose (glm::mat3_cast (orientation), eye, scale, pose);
+	camera.setTranslation (pose.translation);
+	camera.setRotation (pose.rotation);
+	camera.setFoV (glm::mix (m_keyframes[i].fov, m_keyframes[next].fov, u));
+}
+
+CameraPath CameraPath::turntable (const Camera & camera, const glm::vec3 & center, unsigned int numOfFrames, float degrees) {
+	CameraKeyframe start;
+	start.translation = camera.getTranslation ();
+	start.rotation = camera.getRotation ();
+	start.fov = camera.getFoV ();
+	float scale = camera.getScale ();
+	glm::mat3 orientation;
+	glm::vec3 eye;
+	worldPose (start, scale, orientation, eye);
+	CameraPath path;
+	for (unsigned int f = 0; f < numOfFrames; f++) {
+		glm::mat3 turn = glm::mat3 (glm::rotate (glm::mat4 (1.f), glm::radians (degrees) * float (f) / float (numOfFrames), glm::vec3 (0.f, 1.f, 0.f)));
+		CameraKeyframe keyframe = start;
+		keyframe.frame = float (f);
+		cameraPose (turn * orientation, center + turn * (eye - center), scale, keyframe);
+		path.m_keyframes.push_back (keyframe);
+	}
+	return path;
+}
+
+static std::ostream & operator<< (std::ostream & out, const glm::vec3 & v) { return out << v.x << ' ' << v.y << ' ' << v.z; }
+
+static std::istream & operator>> (std::istream & in, glm::vec3 & v) { return in >> v.x >> v.y >> v.z; }
+
+void CameraPath::write (std::ostream & out) const {
+	std::streamsize precision = out.precision (std::numeric_limits<float>::max_digits10);
+	for (const CameraKeyframe & keyframe : m_keyframes)
+		out << "keyframe " << keyframe.frame << ' ' << keyframe.translation << ' ' << keyframe.rotation << ' ' << keyframe.fov << '\n';
+	out.precision (precision);
+}
+
+bool CameraPath::read (std::istream & in) {
+	m_keyframes.clear ();
+	std::string line;
+	while (std::getline (in, line)) {
+		std::istringstream entity (line);
+		std::string keyword;
+		if (!(entity >> keyword) || keyword[0] == '#')
+			continue;
+		CameraKeyframe keyframe;
+		entity >> keyframe.frame >> keyframe.translation >> keyframe.rotation >> keyframe.fov;
+		if (keyword != "keyframe" || entity.fail ())
+			return false;
+		add (keyframe);
+	}
+	return true;
+}
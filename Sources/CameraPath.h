@@ -0,0 +1,55 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+
+/// Pose of the camera at a frame of a sequence, in the terms of Camera: translation, rotation and field of view.
+struct CameraKeyframe {
+	float frame = 0.f;
+	glm::vec3 translation = glm::vec3 (0.f);
+	glm::vec3 rotation = glm::vec3 (0.f);
+	float fov = 45.f;
+};
+
+/// Camera animation of a sequence render. Between keyframes, the eye follows a Catmull-Rom spline, the orientation is
+/// spherically interpolated and the field of view linearly. Written as text, one "keyframe <frame> <translation>
+/// <rotation> <fov>" line per keyframe; lines starting with '#' are comments.
+class CameraPath {
+public:
+	inline const std::vector<CameraKeyframe> & keyframes () const { return m_keyframes; }
+	inline bool empty () const { return m_keyframes.empty (); }
+
+	/// Number of frames up to the last keyframe.
+	inline unsigned int numOfFrames () const { return m_keyframes.empty () ? 0 : unsigned (m_keyframes.back ().frame) + 1; }
+
+	/// Insert the keyframe, in frame order.
+	void add (const CameraKeyframe & keyframe);
+
+	/// Pose the camera at the frame, held before the first keyframe and after the last one.
+	void apply (float frame, Camera & camera) const;
+
+	/// Orbit of the camera around the vertical axis through the center, by the given angle over the frames, e.g., a
+	/// full turn without the repeated last frame by default. One keyframe per frame, so that the orbit is exact.
+	static CameraPath turntable (const Camera & camera, const glm::vec3 & center, unsigned int numOfFrames, float degrees = 360.f);
+
+	void write (std::ostream & out) const;
+
+	/// Returns false on a malformed path.
+	bool read (std::istream & in);
+
+private:
+	std::vector<CameraKeyframe> m_keyframes;
+};
@@ -0,0 +1,237 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "Denoiser.h"
+
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+
+#include "Console.h"
+
+static const float MIN_ALBEDO = 1e-2f;
+static const float EPSILON = 1e-6f;
+static const int ROW_SPAN = 256; // Pixels per work item of the filter
+
+/// Exponential for non-positive arguments, written to vectorize: 2^t is split in an integer power, set through the
+/// float exponent bits, and a polynomial of the fraction in (-1, 0] (truncation rounds up for t <= 0). Relative error
+/// below 1e-4. Results under 2^-40 are flushed to zero: such filter weights are negligible, and their products would
+/// otherwise reach the denormal range, which is very slow. The flush is an integer select, since a float comparison
+/// could trap and would keep a branch in the loop.
+static inline float fastExp (float x) {
+	float t = x * 1.44269504f;
+	int32_t i = int32_t (t);
+	float f = t - float (i);
+	float p = 1.f + f * (0.69314718f + f * (0.24022651f + f * (0.05550411f + f * (0.00961813f + f * (0.00133336f + f * 0.00015404f)))));
+	int32_t bits = i > -40 ? (i + 127) << 23 : 0;
+	float scale;
+	std::memcpy (&scale, &bits, sizeof (float));
+	return p * scale;
+}
+
+static inline float luminance (float r, float g, float b) { return 0.2126f * r + 0.7152f * g + 0.0722f * b; }
+
+void Denoiser::denoise (size_t width, size_t height,
+						const std::vector<glm::vec3> & color, const std::vector<float> & variance,
+						const std::vector<glm::vec3> & albedo, const std::vector<glm::vec3> & normal, const std::vector<float> & depth,
+						Image & output) {
+	std::chrono::high_resolution_clock clock;
+	std::chrono::time_point<std::chrono::high_resolution_clock> before = clock.now();
+	m_width = int (width);
+	m_height = int (height);
+	size_t numOfPixels = width * height;
+	for (int i = 0; i < 2; i++) {
+		m_r[i].resize (numOfPixels);
+		m_g[i].resize (numOfPixels);
+		m_b[i].resize (numOfPixels);
+		m_variance[i].resize (numOfPixels);
+	}
+	m_filteredVariance.resize (numOfPixels);
+	m_nx.resize (numOfPixels);
+	m_ny.resize (numOfPixels);
+	m_nz.resize (numOfPixels);
+	m_depth.resize (numOfPixels);
+	m_depthGradient.resize (numOfPixels);
+
+	// Demodulate the albedo, and convert to planes
+	#pragma omp parallel for
+	for (long long i = 0; i < (long long)numOfPixels; i++) {
+		glm::vec3 a = glm::max (albedo[i], glm::vec3 (MIN_ALBEDO));
+		glm::vec3 c = color[i] / a;
+		m_r[0][i] = c.r;
+		m_g[0][i] = c.g;
+		m_b[0][i] = c.b;
+		m_nx[i] = normal[i].x;
+		m_ny[i] = normal[i].y;
+		m_nz[i] = normal[i].z;
+		m_depth[i] = depth[i];
+	}
+
+	// Depth gradients, and spatial variance estimate where none is given
+	#pragma omp parallel for
+	for (int y = 0; y < m_height; y++)
+		for (int x = 0; x < m_width; x++) {
+			size_t i = size_t (y) * width + x;
+			float gradient = 0.f;
+			if (x > 0 && x < m_width - 1)
+				gradient = std::max (gradient, 0.5f * std::abs (m_depth[i+1] - m_depth[i-1]));
+			if (y > 0 && y < m_height - 1)
+				gradient = std::max (gradient, 0.5f * std::abs (m_depth[i+width] - m_depth[i-width]));
+			m_depthGradient[i] = std::isfinite (gradient) ? gradient : 0.f;
+			float a = std::max (MIN_ALBEDO, luminance (albedo[i].r, albedo[i].g, albedo[i].b));
+			if (variance[i] >= 0.f) {
+				m_variance[0][i] = variance[i] / (a * a);
+				continue;
+			}
+			float sum = 0.f, sumSq = 0.f, count = 0.f;
+			for (int dy = -1; dy <= 1; dy++)
+				for (int dx = -1; dx <= 1; dx++) {
+					int xx = x + dx, yy = y + dy;
+					if (xx < 0 || yy < 0 || xx >= m_width || yy >= m_height)
+						continue;
+					size_t j = size_t (yy) * width + xx;
+					float l = luminance (m_r[0][j], m_g[0][j], m_b[0][j]);
+					sum += l;
+					sumSq += l * l;
+					count += 1.f;
+				}
+			float mean = sum / count;
+			m_variance[0][i] = std::max (0.f, sumSq / count - mean * mean);
+		}
+
+	int src = 0;
+	for (unsigned int iteration = 0; iteration < m_numOfIterations; iteration++) {
+		filter (1 << iteration, src);
+		src = 1 - src;
+	}
+
+	#pragma omp parallel for
+	for (long long i = 0; i < (long long)numOfPixels; i++) {
+		if (normal[i] == glm::vec3 (0.f))
+			output[i] = color[i];
+		else
+			output[i] = glm::max (albedo[i], glm::vec3 (MIN_ALBEDO)) * glm::vec3 (m_r[src][i], m_g[src][i], m_b[src][i]);
+	}
+	std::chrono::time_point<std::chrono::high_resolution_clock> after = clock.now();
+	double elapsedTime = (double)std::chrono::duration_cast<std::chrono::milliseconds>(after - before).count();
+	Console::print ("Denoising executed in " + std::to_string (elapsedTime) + "ms");
+}
+
+void Denoiser::filter (int step, int src) {
+	static const float kernel[5] = { 1.f/16.f, 1.f/4.f, 3.f/8.f, 1.f/4.f, 1.f/16.f };
+	int dst = 1 - src;
+	const int width = m_width;
+	const int height = m_height;
+	const float * r = m_r[src].data ();
+	const float * g = m_g[src].data ();
+	const float * b = m_b[src].data ();
+	const float * var = m_variance[src].data ();
+	const float * nx = m_nx.data ();
+	const float * ny = m_ny.data ();
+	const float * nz = m_nz.data ();
+	const float * z = m_depth.data ();
+	const float * zGradient = m_depthGradient.data ();
+	float * filteredVariance = m_filteredVariance.data ();
+	const float normalSigma = m_normalSigma;
+
+	// The luminance weights are steered by the variance, blurred by a separable 3x3 binomial filter to be robust to its own noise
+	#pragma omp parallel
+	{
+		std::vector<float> blurred (width);
+		#pragma omp for
+		for (int y = 0; y < height; y++) {
+			const float * above = var + size_t (std::max (y - 1, 0)) * width;
+			const float * center = var + size_t (y) * width;
+			const float * below = var + size_t (std::min (y + 1, height - 1)) * width;
+			#pragma omp simd
+			for (int x = 0; x < width; x++)
+				blurred[x] = 0.25f * above[x] + 0.5f * center[x] + 0.25f * below[x];
+			float * row = filteredVariance + size_t (y) * width;
+			row[0] = 0.75f * blurred[0] + 0.25f * blurred[std::min (1, width - 1)];
+			row[width - 1] = 0.75f * blurred[width - 1] + 0.25f * blurred[std::max (width - 2, 0)];
+			#pragma omp simd
+			for (int x = 1; x < width - 1; x++)
+				row[x] = 0.25f * blurred[x-1] + 0.5f * blurred[x] + 0.25f * blurred[x+1];
+		}
+	}
+
+	// Rows are processed by spans, so that the accumulators and the rows of the 25 taps stay in the L1 cache
+	const int numOfSpans = (width + ROW_SPAN - 1) / ROW_SPAN;
+	#pragma omp parallel
+	{
+		// Per thread accumulators
+		float sumR[ROW_SPAN], sumG[ROW_SPAN], sumB[ROW_SPAN], sumVar[ROW_SPAN], sumW[ROW_SPAN];
+		float centerL[ROW_SPAN], invLumSigma[ROW_SPAN], invDepthSigma[ROW_SPAN];
+		#pragma omp for schedule(dynamic, 4)
+		for (int k = 0; k < height * numOfSpans; k++) {
+			const int y = k / numOfSpans;
+			const int xBegin = (k % numOfSpans) * ROW_SPAN;
+			const int spanWidth = std::min (ROW_SPAN, width - xBegin);
+			const size_t row = size_t (y) * width + xBegin;
+			const float centerWeight = kernel[2] * kernel[2];
+			for (int x = 0; x < spanWidth; x++) {
+				size_t p = row + x;
+				centerL[x] = luminance (r[p], g[p], b[p]);
+				invLumSigma[x] = 1.f / (m_colorSigma * std::sqrt (filteredVariance[p]) + EPSILON);
+				invDepthSigma[x] = 1.f / (m_depthSigma * zGradient[p] * step + EPSILON);
+				sumR[x] = centerWeight * r[p];
+				sumG[x] = centerWeight * g[p];
+				sumB[x] = centerWeight * b[p];
+				sumVar[x] = centerWeight * centerWeight * var[p];
+				sumW[x] = centerWeight;
+			}
+			for (int ty = -2; ty <= 2; ty++) {
+				int yy = y + ty * step;
+				if (yy < 0 || yy >= height)
+					continue;
+				for (int tx = -2; tx <= 2; tx++) {
+					if (tx == 0 && ty == 0)
+						continue;
+					const float h = kernel[tx+2] * kernel[ty+2];
+					const float invDistance = 1.f / std::sqrt (float (tx * tx + ty * ty));
+					const int dx = tx * step;
+					// Span of x, relative to xBegin, whose tap lies in the image
+					const int x0 = std::max (0, -dx - xBegin);
+					const int x1 = std::min (spanWidth, width - dx - xBegin);
+					const size_t q0 = size_t (yy) * width + xBegin + dx;
+					#pragma omp simd
+					for (int x = x0; x < x1; x++) {
+						size_t p = row + x;
+						size_t q = q0 + x;
+						float cosine = nx[p] * nx[q] + ny[p] * ny[q] + nz[p] * nz[q];
+						float lq = luminance (r[q], g[q], b[q]);
+						// normalSigma * (cosine - 1) ~ log (cosine^normalSigma), and stays a strong rejection for back facing normals
+						float exponent = normalSigma * (cosine - 1.f)
+							- std::abs (z[p] - z[q]) * invDepthSigma[x] * invDistance
+							- std::abs (centerL[x] - lq) * invLumSigma[x];
+						float w = h * fastExp (exponent);
+						sumR[x] += w * r[q];
+						sumG[x] += w * g[q];
+						sumB[x] += w * b[q];
+						sumVar[x] += w * w * var[q];
+						sumW[x] += w;
+					}
+				}
+			}
+			float * dr = m_r[dst].data () + row;
+			float * dg = m_g[dst].data () + row;
+			float * db = m_b[dst].data () + row;
+			float * dv = m_variance[dst].data () + row;
+			#pragma omp simd
+			for (int x = 0; x < spanWidth; x++) {
+				float invW = 1.f / sumW[x];
+				dr[x] = sumR[x] * invW;
+				dg[x] = sumG[x] * invW;
+				db[x] = sumB[x] * invW;
+				dv[x] = sumVar[x] * invW * invW;
+			}
+		}
+	}
+}
@@ -0,0 +1,65 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Image.h"
+
+/// Edge-avoiding a-trous wavelet denoiser (Dammertz et al. 2010), with the variance-guided luminance
+/// weights of SVGF (Schied et al. 2017). The noisy color is demodulated by the albedo, filtered by
+/// iterations of a 5x5 B3-spline kernel with doubling step size, whose taps are weighted by the
+/// similarity of their normals, depths and luminances, and finally modulated back by the albedo.
+/// Buffers are stored as planes of floats, and each tap is applied to whole rows at once to vectorize.
+class Denoiser {
+public:
+	inline Denoiser () {}
+	virtual ~Denoiser () {}
+
+	inline unsigned int numOfIterations () const { return m_numOfIterations; }
+	inline void setNumOfIterations (unsigned int n) { m_numOfIterations = n; }
+
+	/// Tolerance of the luminance weights, in standard deviations of the noise.
+	inline float colorSigma () const { return m_colorSigma; }
+	inline void setColorSigma (float sigma) { m_colorSigma = sigma; }
+
+	/// Exponent of the normal weights.
+	inline float normalSigma () const { return m_normalSigma; }
+	inline void setNormalSigma (float sigma) { m_normalSigma = sigma; }
+
+	/// Tolerance of the depth weights, relative to the local depth gradient.
+	inline float depthSigma () const { return m_depthSigma; }
+	inline void setDepthSigma (float sigma) { m_depthSigma = sigma; }
+
+	/// Denoise a width x height frame into the output image. variance is the per pixel variance of the color
+	/// luminance estimate (a spatial estimate is used where it is negative, e.g., with too few samples).
+	/// Pixels with a zero normal (background) are copied unfiltered and ignored by their neighbors.
+	void denoise (size_t width, size_t height,
+				  const std::vector<glm::vec3> & color, const std::vector<float> & variance,
+				  const std::vector<glm::vec3> & albedo, const std::vector<glm::vec3> & normal, const std::vector<float> & depth,
+				  Image & output);
+
+private:
+	/// One a-trous iteration with the given step, from the m_r/g/b/variance planes of index src to those of 1-src.
+	void filter (int step, int src);
+
+	unsigned int m_numOfIterations = 5;
+	float m_colorSigma = 2.f;
+	float m_normalSigma = 128.f;
+	float m_depthSigma = 1.f;
+
+	int m_width = 0, m_height = 0;
+	// Ping-pong planes of the demodulated color and its variance
+	std::vector<float> m_r[2], m_g[2], m_b[2], m_variance[2];
+	std::vector<float> m_filteredVariance; // 3x3 blurred variance, steering the luminance weights
+	// Guides
+	std::vector<float> m_nx, m_ny, m_nz, m_depth, m_depthGradient;
+};
@@ -0,0 +1,247 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "EnvironmentMap.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <unistd.h>
+
+#include "stb_image.h" // Implemented in Texture.cpp
+
+#include "Console.h"
+
+namespace fs = std::filesystem;
+
+static const float PI = 3.1415926535897932384626433832795f;
+
+static inline float luminance (const glm::vec3 & c) { return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b; }
+
+/// Temporary name of a table file being written, unique across the processes loading the same map at the same time
+static std::string temporaryTableFilename (const std::string & filename) {
+	static std::atomic<unsigned int> counter (0);
+	return filename + "." + std::to_string (getpid ()) + "_" + std::to_string (counter++) + ".tmp";
+}
+
+/// Header of a table file, followed by the marginal table, then the conditional tables.
+struct AliasTableFileHeader {
+	char magic[8];
+	uint32_t width, height;
+	uint64_t sourceSize;
+	int64_t sourceTime; // Modification time of the image, the tables are rebuilt when it changes
+	float totalWeight;
+	uint32_t padding;
+};
+
+static const char ALIAS_TABLE_FILE_MAGIC[8] = {'I', 'N', 'F', '5', '8', '4', 'A', '1'};
+
+bool EnvironmentMap::load (const std::string & filename, const std::string & cacheDirectory) {
+	m_filename = filename;
+	int width, height, numOfComponents;
+	float * data = stbi_loadf (filename.c_str (), &width, &height, &numOfComponents, 3);
+	if (!data) {
+		Console::print ("Cannot decode environment map " + filename + ": " + stbi_failure_reason ());
+		return false;
+	}
+	m_width = static_cast<unsigned int> (width);
+	m_height = static_cast<unsigned int> (height);
+	m_radiance.resize (size_t (m_width) * m_height);
+	for (size_t i = 0; i < m_radiance.size (); i++)
+		m_radiance[i] = glm::vec3 (data[3*i], data[3*i+1], data[3*i+2]);
+	stbi_image_free (data);
+
+	std::error_code error;
+	uint64_t sourceSize = static_cast<uint64_t> (fs::file_size (filename, error));
+	int64_t sourceTime = static_cast<int64_t> (fs::last_write_time (filename, error).time_since_epoch ().count ());
+	std::string tableFilename = cacheFilename (cacheDirectory);
+	auto start = std::chrono::high_resolution_clock::now ();
+	bool cached = readTables (tableFilename, sourceSize, sourceTime);
+	if (!cached) {
+		if (!buildTables ()) {
+			Console::print ("Environment map " + filename + " carries no light");
+			return false;
+		}
+		writeTables (tableFilename, sourceSize, sourceTime);
+	}
+	auto end = std::chrono::high_resolution_clock::now ();
+	float elapsed = std::chrono::duration<float, std::milli> (end - start).count ();
+	Console::print ("Environment map " + filename + ": " + std::to_string (m_width) + "x" + std::to_string (m_height)
+					+ ", sampling tables " + (cached ? "read back" : "built") + " in " + std::to_string (elapsed) + "ms");
+	return true;
+}
+
+float EnvironmentMap::weight (unsigned int x, unsigned int y) const {
+	return luminance (m_radiance[size_t (y) * m_width + x]) * std::sin (PI * (y + 0.5f) / m_height);
+}
+
+void EnvironmentMap::buildAliasTable (const float * weights, size_t n, AliasEntry * table) {
+	double sum = 0.0;
+	for (size_t i = 0; i < n; i++)
+		sum += weights[i];
+	for (size_t i = 0; i < n; i++)
+		table[i] = AliasEntry { 1.f, static_cast<uint32_t> (i) };
+	if (sum <= 0.0)
+		return;
+	// Vose: pair each underfull bucket with an overfull one, which gives it the rest of its unit mass
+	std::vector<double> scaled (n);
+	std::vector<uint32_t> small, large;
+	for (size_t i = 0; i < n; i++) {
+		scaled[i] = weights[i] * n / sum;
+		(scaled[i] < 1.0 ? small : large).push_back (static_cast<uint32_t> (i));
+	}
+	while (!small.empty () && !large.empty ()) {
+		uint32_t s = small.back ();
+		small.pop_back ();
+		uint32_t l = large.back ();
+		table[s] = AliasEntry { static_cast<float> (scaled[s]), l };
+		scaled[l] -= 1.0 - scaled[s];
+		if (scaled[l] < 1.0) {
+			large.pop_back ();
+			small.push_back (l);
+		}
+	}
+	// Leftovers only differ from a unit mass by rounding
+}
+
+uint32_t EnvironmentMap::sampleAliasTable (const AliasEntry * table, size_t n, float & u) {
+	float scaled = u * n;
+	uint32_t i = std::min (static_cast<uint32_t> (scaled), static_cast<uint32_t> (n - 1));
+	float f = scaled - i;
+	const AliasEntry & entry = table[i];
+	if (f < entry.threshold) {
+		u = std::min (f / entry.threshold, 0x1.fffffep-1f);
+		return i;
+	}
+	u = std::min ((f - entry.threshold) / (1.f - entry.threshold), 0x1.fffffep-1f);
+	return entry.alias;
+}
+
+bool EnvironmentMap::buildTables () {
+	m_marginal.resize (m_height);
+	m_conditional.resize (size_t (m_width) * m_height);
+	std::vector<float> rowWeights (m_height);
+	#pragma omp parallel
+	{
+		std::vector<float> weights (m_width);
+		#pragma omp for schedule(dynamic, 16)
+		for (int y = 0; y < int (m_height); y++) {
+			double sum = 0.0;
+			for (unsigned int x = 0; x < m_width; x++) {
+				weights[x] = weight (x, y);
+				sum += weights[x];
+			}
+			rowWeights[y] = static_cast<float> (sum);
+			buildAliasTable (weights.data (), m_width, &m_conditional[size_t (y) * m_width]);
+		}
+	}
+	double total = 0.0;
+	for (float w : rowWeights)
+		total += w;
+	m_totalWeight = static_cast<float> (total);
+	buildAliasTable (rowWeights.data (), m_height, m_marginal.data ());
+	return m_totalWeight > 0.f;
+}
+
+std::string EnvironmentMap::cacheFilename (const std::string & cacheDirectory) const {
+	std::error_code error;
+	fs::path directory = cacheDirectory.empty () ? fs::temp_directory_path (error) / "INF584EnvironmentTables" : fs::path (cacheDirectory);
+	std::ostringstream name;
+	name << std::hex << std::hash<std::string> () (fs::absolute (m_filename, error).string ()) << ".alias";
+	return (directory / name.str ()).string ();
+}
+
+bool EnvironmentMap::readTables (const std::string & filename, uint64_t sourceSize, int64_t sourceTime) {
+	std::ifstream file (filename, std::ios::binary);
+	AliasTableFileHeader header;
+	if (!file.read (reinterpret_cast<char *> (&header), sizeof (header))
+		|| !std::equal (header.magic, header.magic + 8, ALIAS_TABLE_FILE_MAGIC)
+		|| header.width != m_width || header.height != m_height
+		|| header.sourceSize != sourceSize || header.sourceTime != sourceTime)
+		return false;
+	m_marginal.resize (m_height);
+	m_conditional.resize (size_t (m_width) * m_height);
+	m_totalWeight = header.totalWeight;
+	return m_totalWeight > 0.f
+		&& file.read (reinterpret_cast<char *> (m_marginal.data ()), std::streamsize (m_marginal.size () * sizeof (AliasEntry)))
+		&& file.read (reinterpret_cast<char *> (m_conditional.data ()), std::streamsize (m_conditional.size () * sizeof (AliasEntry)));
+}
+
+void EnvironmentMap::writeTables (const std::string & filename, uint64_t sourceSize, int64_t sourceTime) const {
+	AliasTableFileHeader header;
+	std::copy_n (ALIAS_TABLE_FILE_MAGIC, 8, header.magic);
+	header.width = m_width;
+	header.height = m_height;
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+	header.totalWeight = m_totalWeight;
+	header.padding = 0;
+	// Written under a name of its own next to the final one and renamed once complete, so that no reader ever opens a
+	// partial file, even while other processes write the same tables
+	std::error_code error;
+	fs::create_directories (fs::path (filename).parent_path (), error);
+	std::string temporaryFilename = temporaryTableFilename (filename);
+	std::ofstream file (temporaryFilename, std::ios::binary);
+	file.write (reinterpret_cast<const char *> (&header), sizeof (header));
+	file.write (reinterpret_cast<const char *> (m_marginal.data ()), std::streamsize (m_marginal.size () * sizeof (AliasEntry)));
+	file.write (reinterpret_cast<const char *> (m_conditional.data ()), std::streamsize (m_conditional.size () * sizeof (AliasEntry)));
+	file.close ();
+	if (!file) {
+		Console::print ("Cannot cache the sampling tables of " + m_filename + " to " + filename);
+		fs::remove (temporaryFilename, error);
+		return;
+	}
+	fs::rename (temporaryFilename, filename, error);
+	if (error) {
+		std::string message = error.message ();
+		fs::remove (temporaryFilename, error);
+		// Another process loading the same map may have published the same tables meanwhile
+		if (fs::exists (filename, error))
+			return;
+		Console::print ("Cannot cache the sampling tables of " + m_filename + " to " + filename + ": " + message);
+	}
+}
+
+size_t EnvironmentMap::texelIndex (const glm::vec3 & wi) const {
+	float u = std::atan2 (wi.z, wi.x) / (2.f * PI) + 0.5f;
+	float v = std::acos (glm::clamp (wi.y, -1.f, 1.f)) / PI;
+	unsigned int x = std::min (static_cast<unsigned int> (std::max (0.f, u * m_width)), m_width - 1);
+	unsigned int y = std::min (static_cast<unsigned int> (std::max (0.f, v * m_height)), m_height - 1);
+	return size_t (y) * m_width + x;
+}
+
+float EnvironmentMap::pdf (const glm::vec3 & wi) const {
+	float sinTheta = std::sqrt (std::max (0.f, 1.f - wi.y * wi.y));
+	if (sinTheta <= 0.f)
+		return 0.f;
+	size_t i = texelIndex (wi);
+	unsigned int x = static_cast<unsigned int> (i % m_width), y = static_cast<unsigned int> (i / m_width);
+	// Texel probability, uniform over its (u, v) domain, over the Jacobian of the latitude-longitude mapping
+	float texelPdf = weight (x, y) / m_totalWeight;
+	return texelPdf * m_width * m_height / (2.f * PI * PI * sinTheta);
+}
+
+glm::vec3 EnvironmentMap::sample (float u1, float u2, glm::vec3 & wi, float & pdf) const {
+	unsigned int y = sampleAliasTable (m_marginal.data (), m_height, u1);
+	unsigned int x = sampleAliasTable (&m_conditional[size_t (y) * m_width], m_width, u2);
+	// The remapped numbers place the direction uniformly in the texel
+	float phi = 2.f * PI * ((x + u2) / m_width - 0.5f);
+	float theta = PI * (y + u1) / m_height;
+	float sinTheta = std::sin (theta);
+	wi = glm::vec3 (sinTheta * std::cos (phi), std::cos (theta), sinTheta * std::sin (phi));
+	if (sinTheta <= 0.f) {
+		pdf = 0.f;
+		return glm::vec3 (0.f);
+	}
+	pdf = weight (x, y) / m_totalWeight * m_width * m_height / (2.f * PI * PI * sinTheta);
+	return m_radiance[size_t (y) * m_width + x];
+}
@@ -0,0 +1,74 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+/// Latitude-longitude HDR image of the radiance incident from infinitely far away, the y axis pointing to the zenith.
+/// It is importance sampled with a 2D alias table: a marginal table selecting a row, then the conditional table of
+/// that row selecting a texel, both in constant time (Walker's alias method, with the construction of Vose). Texels
+/// are weighted by their luminance times sin(theta), proportional to the solid angle they subtend, so that samples
+/// follow the incident power. The tables are cached to disk, keyed by the image file and its modification time.
+class EnvironmentMap {
+public:
+	inline EnvironmentMap () {}
+	virtual ~EnvironmentMap () {}
+
+	/// Decode an HDR image, e.g., a Radiance .hdr file, and build its sampling tables, or read them back from the cache
+	/// directory, by default a subdirectory of the system temporary directory. Returns false if the image cannot be
+	/// decoded or carries no light.
+	bool load (const std::string & filename, const std::string & cacheDirectory = "");
+
+	inline const std::string & filename () const { return m_filename; }
+	inline unsigned int width () const { return m_width; }
+	inline unsigned int height () const { return m_height; }
+
+	/// Radiance incident along the direction -wi, i.e., seen when looking towards wi. Texels are not filtered, so that
+	/// the radiance is exactly proportional to the sampling density over each texel.
+	inline glm::vec3 radiance (const glm::vec3 & wi) const { return m_radiance[texelIndex (wi)]; }
+
+	/// Solid angle density with which sample generates wi.
+	float pdf (const glm::vec3 & wi) const;
+
+	/// Direction wi drawn from the uniform numbers (u1, u2), with its solid angle density. Returns its radiance.
+	glm::vec3 sample (float u1, float u2, glm::vec3 & wi, float & pdf) const;
+
+private:
+	/// Bucket of an alias table: the bucket itself is picked with probability threshold, its alias otherwise.
+	struct AliasEntry {
+		float threshold;
+		uint32_t alias;
+	};
+
+	static void buildAliasTable (const float * weights, size_t n, AliasEntry * table);
+
+	/// Bucket picked by the uniform number u, which is remapped to a fresh uniform number in [0,1).
+	static uint32_t sampleAliasTable (const AliasEntry * table, size_t n, float & u);
+
+	/// Sampling weight of a texel: luminance times sin(theta), at the center of its row.
+	float weight (unsigned int x, unsigned int y) const;
+
+	size_t texelIndex (const glm::vec3 & wi) const;
+
+	std::string cacheFilename (const std::string & cacheDirectory) const;
+	bool readTables (const std::string & filename, uint64_t sourceSize, int64_t sourceTime);
+	void writeTables (const std::string & filename, uint64_t sourceSize, int64_t sourceTime) const;
+	bool buildTables ();
+
+	std::string m_filename;
+	unsigned int m_width = 0, m_height = 0;
+	std::vector<glm::vec3> m_radiance; // Scanlines, top (zenith) first
+	std::vector<AliasEntry> m_marginal; // One bucket per row
+	std::vector<AliasEntry> m_conditional; // One table per row, one bucket per texel
+	float m_totalWeight = 0.f;
+};
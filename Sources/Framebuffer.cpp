@@ -0,0 +1,141 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "Framebuffer.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <algorithm>
+
+#include "Console.h"
+
+void Framebuffer::resize (size_t width, size_t height) {
+	m_width = width;
+	m_height = height;
+	for (int c = 0; c < NumOfChannels; c++)
+		m_planes[c].resize (width * height);
+	clear ();
+}
+
+void Framebuffer::clear () {
+	for (int c = 0; c < NumOfChannels; c++) {
+		float value = 0.f;
+		if (c == Depth)
+			value = std::numeric_limits<float>::infinity ();
+		else if (c == MeshIndex || c == TriangleIndex)
+			value = -1.f;
+		std::fill (m_planes[c].begin (), m_planes[c].end (), value);
+	}
+}
+
+const char * Framebuffer::channelName (Channel channel) {
+	static const char * names[NumOfChannels] = {
+		"R", "G", "B",
+		"Z",
+		"N.X", "N.Y", "N.Z",
+		"albedo.R", "albedo.G", "albedo.B",
+		"meshIndex",
+		"triangleIndex",
+		"barycentric.u", "barycentric.v"
+	};
+	return names[channel];
+}
+
+// OpenEXR is little endian, as are the platforms we target
+template<typename T>
+static void put (std::vector<char> & buffer, T value) {
+	const char * bytes = reinterpret_cast<const char *> (&value);
+	buffer.insert (buffer.end (), bytes, bytes + sizeof (T));
+}
+
+static void putString (std::vector<char> & buffer, const std::string & s) {
+	buffer.insert (buffer.end (), s.begin (), s.end ());
+	buffer.push_back ('\0');
+}
+
+static void putAttribute (std::vector<char> & buffer, const std::string & name, const std::string & type, const std::vector<char> & value) {
+	putString (buffer, name);
+	putString (buffer, type);
+	put<int32_t> (buffer, static_cast<int32_t> (value.size ()));
+	buffer.insert (buffer.end (), value.begin (), value.end ());
+}
+
+bool Framebuffer::saveEXR (const std::string & filename) const {
+	std::ofstream out (filename.c_str (), std::ios::binary);
+	if (!out) {
+		Console::print ("Cannot open file " + filename);
+		return false;
+	}
+	// Channels must be stored in alphabetical order of their names
+	std::vector<int> channels (NumOfChannels);
+	for (int c = 0; c < NumOfChannels; c++)
+		channels[c] = c;
+	std::sort (channels.begin (), channels.end (), [] (int a, int b) {
+		return std::strcmp (channelName (Channel (a)), channelName (Channel (b))) < 0;
+	});
+
+	std::vector<char> header;
+	put<uint32_t> (header, 20000630u); // Magic number
+	put<uint32_t> (header, 2u); // Version 2, single part scanline file
+	std::vector<char> value;
+	for (int c : channels) {
+		putString (value, channelName (Channel (c)));
+		put<int32_t> (value, 2); // FLOAT
+		put<uint32_t> (value, 0u); // pLinear and reserved bytes
+		put<int32_t> (value, 1); // x sampling
+		put<int32_t> (value, 1); // y sampling
+	}
+	value.push_back ('\0');
+	putAttribute (header, "channels", "chlist", value);
+	putAttribute (header, "compression", "compression", std::vector<char> (1, 0)); // NO_COMPRESSION
+	value.clear ();
+	put<int32_t> (value, 0);
+	put<int32_t> (value, 0);
+	put<int32_t> (value, static_cast<int32_t> (m_width) - 1);
+	put<int32_t> (value, static_cast<int32_t> (m_height) - 1);
+	putAttribute (header, "dataWindow", "box2i", value);
+	putAttribute (header, "displayWindow", "box2i", value);
+	putAttribute (header, "lineOrder", "lineOrder", std::vector<char> (1, 0)); // INCREASING_Y
+	value.clear ();
+	put<float> (value, 1.f);
+	putAttribute (header, "pixelAspectRatio", "float", value);
+	value.clear ();
+	put<float> (value, 0.f);
+	put<float> (value, 0.f);
+	putAttribute (header, "screenWindowCenter", "v2f", value);
+	value.clear ();
+	put<float> (value, 1.f);
+	putAttribute (header, "screenWindowWidth", "float", value);
+	header.push_back ('\0');
+
+	// Offset table, then one block per scanline: y, data size, and the line of each channel in turn
+	size_t lineSize = NumOfChannels * m_width * sizeof (float);
+	uint64_t offset = header.size () + m_height * sizeof (uint64_t);
+	for (size_t y = 0; y < m_height; y++) {
+		put<uint64_t> (header, offset);
+		offset += 2 * sizeof (int32_t) + lineSize;
+	}
+	out.write (header.data (), header.size ());
+	std::vector<char> block;
+	block.reserve (2 * sizeof (int32_t) + lineSize);
+	for (size_t y = 0; y < m_height; y++) {
+		block.clear ();
+		put<int32_t> (block, static_cast<int32_t> (y));
+		put<int32_t> (block, static_cast<int32_t> (lineSize));
+		for (int c : channels) {
+			const char * line = reinterpret_cast<const char *> (m_planes[c].data () + y * m_width);
+			block.insert (block.end (), line, line + m_width * sizeof (float));
+		}
+		out.write (block.data (), block.size ());
+	}
+	out.close ();
+	Console::print ("Framebuffer saved to " + filename + " (" + std::to_string (int (NumOfChannels)) + " channels)");
+	return bool (out);
+}
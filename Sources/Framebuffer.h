@@ -0,0 +1,66 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/// Multi-channel framebuffer of arbitrary output variables (AOVs) for compositing and debugging: the final color,
+/// plus the depth, world normal, albedo, mesh index, triangle index and barycentric coordinates of the primary hits.
+/// Each channel is stored as a separate plane of floats, so that a pass over one variable streams through contiguous
+/// memory. Indices are stored as floats too, exactly up to 2^24, and are -1 on the background.
+class Framebuffer {
+public:
+	enum Channel {
+		R, G, B,
+		Depth, ///< Distance along the camera ray, infinite on the background
+		NormalX, NormalY, NormalZ,
+		AlbedoR, AlbedoG, AlbedoB,
+		MeshIndex,
+		TriangleIndex,
+		BarycentricU, BarycentricV,
+		NumOfChannels
+	};
+
+	inline Framebuffer (size_t width = 0, size_t height = 0) { resize (width, height); }
+	virtual ~Framebuffer () {}
+
+	inline size_t width () const { return m_width; }
+	inline size_t height () const { return m_height; }
+
+	void resize (size_t width, size_t height);
+
+	/// Reset every channel to its background value.
+	void clear ();
+
+	/// Channel name in exported files, e.g., "N.X" for NormalX.
+	static const char * channelName (Channel channel);
+
+	inline float * channel (Channel channel) { return m_planes[channel].data (); }
+	inline const float * channel (Channel channel) const { return m_planes[channel].data (); }
+
+	inline float & operator() (Channel channel, size_t pixel) { return m_planes[channel][pixel]; }
+	inline float operator() (Channel channel, size_t pixel) const { return m_planes[channel][pixel]; }
+
+	inline void setColor (size_t pixel, const glm::vec3 & color) {
+		m_planes[R][pixel] = color.r;
+		m_planes[G][pixel] = color.g;
+		m_planes[B][pixel] = color.b;
+	}
+
+	/// Write all the channels to a single uncompressed OpenEXR file, as 32 bit floats. Returns false on failure.
+	bool saveEXR (const std::string & filename) const;
+
+private:
+	size_t m_width = 0;
+	size_t m_height = 0;
+	std::vector<float> m_planes[NumOfChannels];
+};
@@ -5,4 +5,6 @@ Hit::Hit(glm::vec3 o, glm::vec3 dir, float t)
     lightSourcePosition = o;
     lightSourceDirection = dir;
     hitPoint = o + dir * t;
+    this->t = t;
+    u = v = 0.f;
 }
\ No newline at end of file
@@ -13,6 +13,8 @@
 #include <vector>
 #include <cmath>
 #include <algorithm>
+#include <memory>
+#include <mutex>
 
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
@@ -71,4 +73,42 @@ private:
 	size_t m_width;
 	size_t m_height;
 	std::vector<glm::vec3> m_pixels;
-};
\ No newline at end of file
+};
+
+/// Image shared by a producer thread, e.g., a background render, and a consumer thread, e.g., the display. The producer
+/// fills the back image and publishes it by swapping; the consumer reads the last published one, which the producer
+/// never writes while the consumer holds it.
+class DoubleBufferedImage {
+public:
+	inline DoubleBufferedImage () : m_frontPtr (std::make_shared<Image> ()) {}
+
+	inline virtual ~DoubleBufferedImage () {}
+
+	/// Image to fill before the next publish, of the given size. Producer side: release it before publishing.
+	inline std::shared_ptr<Image> back (size_t width, size_t height) {
+		std::lock_guard<std::mutex> lock (m_mutex);
+		// A previous front image still held by the consumer is left to it
+		if (!m_backPtr || m_backPtr.use_count () > 1 || m_backPtr->width () != width || m_backPtr->height () != height)
+			m_backPtr = std::make_shared<Image> (width, height);
+		return m_backPtr;
+	}
+
+	inline void publish () {
+		std::lock_guard<std::mutex> lock (m_mutex);
+		std::swap (m_frontPtr, m_backPtr);
+		m_version++;
+	}
+
+	/// Last published image, with a version number incremented by every publish. Consumer side.
+	inline std::shared_ptr<const Image> front (unsigned long & version) const {
+		std::lock_guard<std::mutex> lock (m_mutex);
+		version = m_version;
+		return m_frontPtr;
+	}
+
+private:
+	mutable std::mutex m_mutex;
+	std::shared_ptr<Image> m_frontPtr;
+	std::shared_ptr<Image> m_backPtr;
+	unsigned long m_version = 0;
+};
@@ -0,0 +1,177 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+
+// Ray/triangle intersection benchmark: compares the watertight test of Ray against the Moller-Trumbore test it
+// replaced, on a dense jittered grid. Counts the rays aimed at shared vertices and edges which leak through the
+// surface, and measures the throughput of each test. Fails if the watertight test lets any ray through.
+
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <limits>
+#include <sstream>
+#include <iomanip>
+
+#include <glm/glm.hpp>
+
+#include "Console.h"
+#include "Ray.h"
+#include "Hit.h"
+
+// Cells per side of the grid, each split into two triangles
+static const int GRID_SIZE = 256;
+static const int NUM_OF_CRACK_RAYS = 20000;
+static const int NUM_OF_THROUGHPUT_RAYS = 2000;
+// Stride among the triangles tested by every ray of the throughput test
+static const size_t THROUGHPUT_STRIDE = 4;
+
+// Both tests are called out of line, as the traversal of the BVH calls the one of Ray
+#if defined(__GNUC__)
+#define BENCHMARK_NOINLINE __attribute__ ((noinline))
+#else
+#define BENCHMARK_NOINLINE
+#endif
+
+struct Grid {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::uvec3> triangles;
+
+	inline const glm::vec3 & vertex (int i, int j) const { return positions[j * (GRID_SIZE + 1) + i]; }
+	inline const glm::uvec3 & triangle (int i, int j, int s) const { return triangles[2 * (j * GRID_SIZE + i) + s]; }
+};
+
+/// Moller-Trumbore test which the watertight one replaced, kept as it was, with the checks of its former caller in the
+/// traversal of the BVH: it wrote a candidate hit, accepted afterwards if 0 < t < hit.t only
+BENCHMARK_NOINLINE static bool mollerTrumboreIntersection (const Ray & ray, const glm::vec3 & p0, const glm::vec3 & p1, const glm::vec3 & p2, Hit & hit) {
+	const float epsilon = 1e-6f;
+	Hit candidate (ray.origin, ray.direction, hit.t);
+	glm::vec3 e0 = p1 - p0;
+	glm::vec3 e1 = p2 - p0;
+	glm::vec3 n = glm::normalize (glm::cross (e0, e1));
+	(void)n;
+	glm::vec3 q = glm::cross (ray.direction, e1);
+	float a = glm::dot (e0, q);
+	if (fabs (a) < epsilon)
+		return false;
+	glm::vec3 s = ray.origin - p0;
+	glm::vec3 r = glm::cross (s, e0);
+	float b0 = glm::dot (s, q) / a;
+	float b1 = glm::dot (r, ray.direction) / a;
+	float t = glm::dot (e1, r) / a;
+	candidate.setHitPoint (ray.origin + t * ray.direction);
+	candidate.u = b0;
+	candidate.v = b1;
+	candidate.t = t;
+	if (b0 < 0.f || b0 > 1.f || b1 < 0.f || b1 + b0 > 1.f || candidate.t <= 0.f || candidate.t >= hit.t)
+		return false;
+	hit = candidate;
+	return true;
+}
+
+BENCHMARK_NOINLINE static bool watertightIntersection (const Ray & ray, const glm::vec3 & p0, const glm::vec3 & p1, const glm::vec3 & p2, Hit & hit) {
+	return ray.rayTriangleIntersection (p0, p1, p2, hit);
+}
+
+typedef bool (*IntersectionTest) (const Ray &, const glm::vec3 &, const glm::vec3 &, const glm::vec3 &, Hit &);
+
+/// Planar grid over [-1,1]^2, whose vertices are jittered so that no edge is axis aligned
+static Grid buildGrid (std::mt19937 & generator) {
+	std::uniform_real_distribution<float> uniform (0.f, 1.f);
+	Grid grid;
+	grid.positions.resize ((GRID_SIZE + 1) * (GRID_SIZE + 1));
+	for (int j = 0; j <= GRID_SIZE; j++)
+		for (int i = 0; i <= GRID_SIZE; i++) {
+			float x = 2.f * i / GRID_SIZE - 1.f + 0.3f * (uniform (generator) - 0.5f) / GRID_SIZE;
+			float y = 2.f * j / GRID_SIZE - 1.f + 0.3f * (uniform (generator) - 0.5f) / GRID_SIZE;
+			grid.positions[j * (GRID_SIZE + 1) + i] = glm::vec3 (x, y, 0.f);
+		}
+	for (int j = 0; j < GRID_SIZE; j++)
+		for (int i = 0; i < GRID_SIZE; i++) {
+			unsigned int a = j * (GRID_SIZE + 1) + i;
+			unsigned int b = a + 1;
+			unsigned int c = a + GRID_SIZE + 2;
+			unsigned int d = a + GRID_SIZE + 1;
+			grid.triangles.push_back (glm::uvec3 (a, b, c));
+			grid.triangles.push_back (glm::uvec3 (a, c, d));
+		}
+	return grid;
+}
+
+/// Number of rays, aimed from above at interior vertices and edge midpoints, hitting none of the triangles around
+static size_t countLeakingRays (const Grid & grid, IntersectionTest intersect) {
+	std::mt19937 generator (2);
+	std::uniform_real_distribution<float> uniform (0.f, 1.f);
+	size_t numOfLeakingRays = 0;
+	for (int k = 0; k < NUM_OF_CRACK_RAYS; k++) {
+		int i = 1 + generator () % (GRID_SIZE - 1);
+		int j = 1 + generator () % (GRID_SIZE - 1);
+		glm::vec3 target = (k % 2 == 1 ? grid.vertex (i, j) : 0.5f * (grid.vertex (i, j) + grid.vertex (i + 1, j)));
+		glm::vec3 origin (4.f * uniform (generator) - 2.f, 4.f * uniform (generator) - 2.f, 1.5f + uniform (generator));
+		Ray ray (origin, target - origin);
+		bool hitAny = false;
+		for (int cj = std::max (j - 1, 0); cj <= std::min (j + 1, GRID_SIZE - 1) && !hitAny; cj++)
+			for (int ci = std::max (i - 1, 0); ci <= std::min (i + 1, GRID_SIZE - 1) && !hitAny; ci++)
+				for (int s = 0; s < 2 && !hitAny; s++) {
+					const glm::uvec3 & t = grid.triangle (ci, cj, s);
+					Hit hit (ray.origin, ray.direction, std::numeric_limits<float>::infinity ());
+					hitAny = intersect (ray, grid.positions[t.x], grid.positions[t.y], grid.positions[t.z], hit);
+				}
+		if (!hitAny)
+			numOfLeakingRays++;
+	}
+	return numOfLeakingRays;
+}
+
+/// Millions of ray/triangle tests per second, keeping the closest hit of each ray as a traversal would
+static double measureThroughput (const Grid & grid, IntersectionTest intersect, size_t & numOfHits) {
+	std::mt19937 generator (3);
+	std::uniform_real_distribution<float> uniform (0.f, 1.f);
+	std::vector<Ray> rays;
+	for (int k = 0; k < NUM_OF_THROUGHPUT_RAYS; k++)
+		rays.push_back (Ray (glm::vec3 (2.f * uniform (generator) - 1.f, 2.f * uniform (generator) - 1.f, 2.f),
+		                     glm::vec3 (uniform (generator) - 0.5f, uniform (generator) - 0.5f, -1.f)));
+	numOfHits = 0;
+	size_t numOfTests = 0;
+	auto start = std::chrono::high_resolution_clock::now ();
+	for (const Ray & ray : rays) {
+		Hit hit (ray.origin, ray.direction, std::numeric_limits<float>::infinity ());
+		for (size_t q = 0; q < grid.triangles.size (); q += THROUGHPUT_STRIDE) {
+			const glm::uvec3 & t = grid.triangles[q];
+			if (intersect (ray, grid.positions[t.x], grid.positions[t.y], grid.positions[t.z], hit))
+				numOfHits++;
+			numOfTests++;
+		}
+	}
+	double seconds = std::chrono::duration<double> (std::chrono::high_resolution_clock::now () - start).count ();
+	return numOfTests / seconds * 1e-6;
+}
+
+static size_t benchmark (const std::string & name, const Grid & grid, IntersectionTest intersect) {
+	size_t numOfLeakingRays = countLeakingRays (grid, intersect);
+	size_t numOfHits;
+	double throughput = measureThroughput (grid, intersect, numOfHits);
+	std::ostringstream message;
+	message << std::left << std::setw (16) << name << std::right
+	        << numOfLeakingRays << "/" << NUM_OF_CRACK_RAYS << " leaking rays, "
+	        << std::fixed << std::setprecision (1) << throughput << " M tests/s (" << numOfHits << " closer hits)";
+	Console::print (message.str ());
+	return numOfLeakingRays;
+}
+
+int main () {
+	std::mt19937 generator (1);
+	Grid grid = buildGrid (generator);
+	Console::print ("Jittered grid of " + std::to_string (grid.triangles.size ()) + " triangles");
+	benchmark ("Moller-Trumbore", grid, mollerTrumboreIntersection);
+	size_t numOfLeakingRays = benchmark ("Watertight", grid, watertightIntersection);
+	return numOfLeakingRays == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
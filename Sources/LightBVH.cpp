@@ -0,0 +1,190 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "LightBVH.h"
+
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+
+#include "Console.h"
+
+static const float LIGHT_PI = 3.14159265358979f;
+
+static inline float lightPower (const LightSource & light) {
+	const glm::vec3 & c = light.getColor ();
+	return light.getIntensity () * (0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b);
+}
+
+OrientationCone OrientationCone::merge (const OrientationCone & a, const OrientationCone & b) {
+	OrientationCone full;
+	if (a.cosTheta <= -1.f || b.cosTheta <= -1.f)
+		return full;
+	float thetaA = std::acos (glm::clamp (a.cosTheta, -1.f, 1.f));
+	float thetaB = std::acos (glm::clamp (b.cosTheta, -1.f, 1.f));
+	float cosThetaD = glm::clamp (glm::dot (a.axis, b.axis), -1.f, 1.f);
+	float thetaD = std::acos (cosThetaD);
+	if (std::min (thetaD + thetaB, LIGHT_PI) <= thetaA)
+		return a;
+	if (std::min (thetaD + thetaA, LIGHT_PI) <= thetaB)
+		return b;
+	float thetaO = 0.5f * (thetaA + thetaD + thetaB);
+	if (thetaO >= LIGHT_PI)
+		return full;
+	// Rotate a's axis towards b's, in the plane of both axes
+	glm::vec3 orthogonal = b.axis - cosThetaD * a.axis;
+	float length = glm::length (orthogonal);
+	if (length < 1e-6f)
+		return full;
+	float thetaR = thetaO - thetaA;
+	OrientationCone cone;
+	cone.axis = glm::normalize (std::cos (thetaR) * a.axis + std::sin (thetaR) * orthogonal / length);
+	cone.cosTheta = std::cos (thetaO);
+	return cone;
+}
+
+void LightBVH::clear () {
+	m_nodes.clear ();
+	m_numOfLights = 0;
+}
+
+void LightBVH::build (const std::vector<LightSource> & lightSources) {
+	std::chrono::high_resolution_clock clock;
+	std::chrono::time_point<std::chrono::high_resolution_clock> before = clock.now();
+	clear ();
+	std::vector<unsigned int> lights;
+	lights.reserve (lightSources.size ());
+	for (size_t i = 0; i < lightSources.size (); i++)
+		if (lightPower (lightSources[i]) > 0.f)
+			lights.push_back (static_cast<unsigned int> (i));
+	m_numOfLights = lights.size ();
+	if (lights.empty ())
+		return;
+	m_nodes.reserve (2 * lights.size () - 1);
+	m_nodes.emplace_back ();
+	buildNode (0, lights, 0, lights.size (), lightSources);
+	std::chrono::time_point<std::chrono::high_resolution_clock> after = clock.now();
+	double elapsedTime = (double)std::chrono::duration_cast<std::chrono::milliseconds>(after - before).count();
+	Console::print ("Light BVH built in " + std::to_string (elapsedTime) + "ms: " + std::to_string (m_numOfLights) + " lights, " + std::to_string (m_nodes.size ()) + " nodes");
+}
+
+void LightBVH::buildNode (unsigned int nodeIndex, std::vector<unsigned int> & lights, size_t begin, size_t end, const std::vector<LightSource> & lightSources) {
+	Node node;
+	node.power = 0.f;
+	bool first = true;
+	for (size_t i = begin; i < end; i++) {
+		const LightSource & light = lightSources[lights[i]];
+		node.bounds.extend (light.getTranslation ());
+		node.power += lightPower (light);
+		OrientationCone cone; // Point lights emit in all directions
+		node.cone = first ? cone : OrientationCone::merge (node.cone, cone);
+		first = false;
+	}
+	if (end - begin == 1) {
+		node.offset = lights[begin];
+		node.count = 1;
+		m_nodes[nodeIndex] = node;
+		return;
+	}
+
+	// Split along the largest axis, minimizing the sum of power times surface area of the children
+	glm::vec3 extent = node.bounds.pMax - node.bounds.pMin;
+	int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+	std::sort (lights.begin () + begin, lights.begin () + end, [&] (unsigned int a, unsigned int b) {
+		return lightSources[a].getTranslation ()[axis] < lightSources[b].getTranslation ()[axis];
+	});
+	size_t n = end - begin;
+	std::vector<float> leftCost (n, 0.f);
+	AABB bounds;
+	float power = 0.f;
+	for (size_t i = 0; i < n - 1; i++) {
+		bounds.extend (lightSources[lights[begin + i]].getTranslation ());
+		power += lightPower (lightSources[lights[begin + i]]);
+		// Pad the bounds so that coincident lights do not get a null cost
+		leftCost[i] = power * (bounds.surfaceArea () + 1e-6f);
+	}
+	bounds = AABB ();
+	power = 0.f;
+	size_t split = begin + n / 2;
+	float bestCost = std::numeric_limits<float>::max ();
+	for (size_t i = n - 1; i > 0; i--) {
+		bounds.extend (lightSources[lights[begin + i]].getTranslation ());
+		power += lightPower (lightSources[lights[begin + i]]);
+		float cost = leftCost[i - 1] + power * (bounds.surfaceArea () + 1e-6f);
+		if (cost < bestCost) {
+			bestCost = cost;
+			split = begin + i;
+		}
+	}
+
+	// Children are allocated next to each other, the left one first
+	node.count = 0;
+	node.offset = static_cast<unsigned int> (m_nodes.size ());
+	m_nodes.emplace_back ();
+	m_nodes.emplace_back ();
+	m_nodes[nodeIndex] = node;
+	buildNode (node.offset, lights, begin, split, lightSources);
+	buildNode (node.offset + 1, lights, split, end, lightSources);
+}
+
+float LightBVH::importance (const Node & node, const glm::vec3 & position, const glm::vec3 & normal) const {
+	glm::vec3 center = node.bounds.centroid ();
+	glm::vec3 d = position - center;
+	float distance2 = glm::dot (d, d);
+	float radius2 = 0.25f * glm::dot (node.bounds.pMax - node.bounds.pMin, node.bounds.pMax - node.bounds.pMin);
+	if (distance2 <= radius2) // Inside the bounds, nothing can be culled
+		return node.power / std::max (distance2, 1e-8f + 0.25f * radius2);
+	float distance = std::sqrt (distance2);
+	glm::vec3 toPoint = d / distance;
+	// Half angle under which the bounds are seen from the shading point
+	float thetaU = std::asin (std::min (1.f, std::sqrt (radius2) / distance));
+	float thetaI = std::acos (glm::clamp (-glm::dot (normal, toPoint), -1.f, 1.f));
+	float cosReceiver = std::cos (std::max (0.f, thetaI - thetaU));
+	if (cosReceiver <= 0.f)
+		return 0.f;
+	float cosEmitter = 1.f;
+	if (node.cone.cosTheta > -1.f) {
+		float theta = std::acos (glm::clamp (glm::dot (node.cone.axis, toPoint), -1.f, 1.f));
+		float thetaO = std::acos (glm::clamp (node.cone.cosTheta, -1.f, 1.f));
+		float thetaPrime = std::max (0.f, theta - thetaO - thetaU);
+		if (thetaPrime >= 0.5f * LIGHT_PI)
+			return 0.f;
+		cosEmitter = std::cos (thetaPrime);
+	}
+	return node.power * cosEmitter * cosReceiver / distance2;
+}
+
+int LightBVH::sample (const glm::vec3 & position, const glm::vec3 & normal, float u, float & pmf) const {
+	pmf = 0.f;
+	if (m_nodes.empty ())
+		return -1;
+	float probability = 1.f;
+	unsigned int index = 0;
+	if (importance (m_nodes[0], position, normal) <= 0.f)
+		return -1;
+	while (m_nodes[index].count == 0) {
+		unsigned int left = m_nodes[index].offset;
+		float leftImportance = importance (m_nodes[left], position, normal);
+		float rightImportance = importance (m_nodes[left + 1], position, normal);
+		float sum = leftImportance + rightImportance;
+		if (sum <= 0.f)
+			return -1;
+		float pLeft = leftImportance / sum;
+		if (u < pLeft) {
+			u = std::min (u / pLeft, 0.99999994f);
+			probability *= pLeft;
+			index = left;
+		} else {
+			u = std::min ((u - pLeft) / (1.f - pLeft), 0.99999994f);
+			probability *= 1.f - pLeft;
+			index = left + 1;
+		}
+	}
+	pmf = probability;
+	return static_cast<int> (m_nodes[index].offset);
+}
@@ -0,0 +1,65 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "BVH.h"
+#include "LightSource.h"
+
+/// Bound on the emission directions of a set of lights: every direction within theta of the axis, with cosTheta = cos (theta).
+/// Point lights emit in every direction, i.e., cosTheta = -1.
+struct OrientationCone {
+	glm::vec3 axis = glm::vec3 (0.f, 0.f, 1.f);
+	float cosTheta = -1.f;
+
+	/// Smallest cone containing both cones.
+	static OrientationCone merge (const OrientationCone & a, const OrientationCone & b);
+};
+
+/// Light hierarchy for many-light sampling (Conty Estevez and Kulla 2018). Each node bounds the position, power
+/// and emission directions of its lights. A light is picked for a shading point by descending the tree, choosing
+/// each child with a probability proportional to a conservative estimate of its contribution, so that the cost
+/// per shading point is logarithmic in the number of lights.
+class LightBVH {
+public:
+	struct Node {
+		AABB bounds;
+		OrientationCone cone;
+		float power;
+		unsigned int offset; // Light index for leaves, left child otherwise (the right child is offset+1)
+		unsigned int count; // 1 for leaves, 0 for interior nodes
+	};
+
+	inline LightBVH () {}
+	virtual ~LightBVH () {}
+
+	inline bool isEmpty () const { return m_nodes.empty (); }
+	inline size_t numOfNodes () const { return m_nodes.size (); }
+	inline size_t numOfLights () const { return m_numOfLights; }
+	inline const std::vector<Node> & nodes () const { return m_nodes; }
+
+	void build (const std::vector<LightSource> & lightSources);
+	void clear ();
+
+	/// Pick a light for the shading point (position, normal) from the uniform number u.
+	/// Returns its index in the scene and its selection probability in pmf, or -1 if no light can contribute.
+	int sample (const glm::vec3 & position, const glm::vec3 & normal, float u, float & pmf) const;
+
+private:
+	void buildNode (unsigned int nodeIndex, std::vector<unsigned int> & lights, size_t begin, size_t end, const std::vector<LightSource> & lightSources);
+
+	/// Conservative estimate of the contribution of the node's lights to the shading point.
+	float importance (const Node & node, const glm::vec3 & position, const glm::vec3 & normal) const;
+
+	std::vector<Node> m_nodes;
+	size_t m_numOfLights = 0;
+};
@@ -4,12 +4,15 @@
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <memory>
+
 #include "Transform.h"
-#include "FboShadowMap.h"
-#include "ShaderProgram.h"
 
-#include <GLFW/glfw3.h>
+class FboShadowMap;
+class ShaderProgram;
 
+/// Point light. Its shadow map, used by the rasterizer only, is allocated on demand, so that lights can be created
+/// without an OpenGL context, e.g., by headless renders.
 class LightSource : public Transform {
 public:
 	inline const glm::vec3 & getDirection () const { return direction; }
@@ -19,16 +22,18 @@ public:
 	inline int getShadowMapTex () const { return m_shadowMapTexOnGPU; }
 	inline float getIntensity () const { return m_intensity; }
 	inline void setIntensity (float intensity) { m_intensity = intensity; }
-	void allocateShadowMapFbo(unsigned int w=800, unsigned int h=600){ m_shadowMap.allocate(w, h); }
-    void bindShadowMap(){ m_shadowMap.bindFbo(); }
+	/// Shadow map, null until allocated. The OpenGL methods below are defined by the rasterizer and require a context.
+	inline std::shared_ptr<FboShadowMap> shadowMap () const { return m_shadowMapPtr; }
+	void allocateShadowMapFbo(unsigned int w=800, unsigned int h=600);
+    void bindShadowMap();
 	glm::mat4 getProjectionViewMatrix(std::shared_ptr<ShaderProgram> shader_shadow_map_Ptr,
 		const glm::vec3 scene_center,
 		const float scene_radius);
-	FboShadowMap m_shadowMap;
 
 private:
 	glm::vec3 direction = glm::vec3(0.f, 0.f, -1.f);
 	glm::vec3 m_color = glm::vec3 (0.f, 0.f, 0.f);
 	float m_intensity = 1.f;
 	int m_shadowMapTexOnGPU;
+	std::shared_ptr<FboShadowMap> m_shadowMapPtr;
 };
\ No newline at end of file
@@ -23,6 +23,7 @@
 #include <exception>
 #include <filesystem>
 #include <random>
+#include <chrono>
 
 namespace fs = std::filesystem;
 
@@ -38,11 +39,14 @@ namespace fs = std::filesystem;
 #include "Image.h"
 #include "Rasterizer.h"
 #include "RayTracer.h"
+#include "RenderThread.h"
+#include "RenderCoordinator.h"
+#include "RenderWorker.h"
+#include "Random.h"
 
 using namespace std;
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
+#include "stb_image.h" // Implemented in Texture.cpp
 
 GLuint loadTextureFromFileToGPU(const std::string &filename)
 {
@@ -89,6 +93,7 @@ static GLFWwindow * windowPtr = nullptr;
 static std::shared_ptr<Scene> scenePtr;
 static std::shared_ptr<Rasterizer> rasterizerPtr;
 static std::shared_ptr<RayTracer> rayTracerPtr;
+static std::shared_ptr<RenderThread> renderThreadPtr; // Runs rayTracerPtr in the background
 
 // Camera control variables
 static glm::vec3 center = glm::vec3 (0.0); // To update based on the mesh position
@@ -103,10 +108,32 @@ static glm::vec3 baseRot (0.0);
 // Files
 static std::string basePath;
 static std::string meshFilename;
+static std::string environmentMapFilename; // Lat-long HDR image lighting the ray traced scene, if any
+
+// Distributed ray tracing, see RenderCoordinator: address to listen at for workers, or to serve as a worker
+static std::string coordinatorAddress;
+static std::string workerAddress;
 
 // Raytraced rendering
 static bool isDisplayRaytracing (false);
 
+// Interactive ray tracing: while the camera moves, a preview is traced at a reduced resolution, adapted to hit the
+// target frame time and upscaled by the display, then the full resolution render refines it once the camera stops.
+static bool isInteractive (true);
+static const double PREVIEW_FRAME_TIME = 1.0 / 30.0; // Target time to trace a preview, in seconds
+static const float MIN_PREVIEW_SCALE = 1.f / 16.f;
+static float previewScale (0.25f); // Preview resolution, relative to the window along each axis
+static bool isPreviewInFlight (false);
+static unsigned long previewVersion (0); // Version of the displayed image when the preview was requested
+static std::chrono::steady_clock::time_point previewStart;
+static bool isRefinementPending (false); // Whether the last view was only traced as a preview
+static glm::mat4 tracedView (0.f); // Camera of the last ray tracing request
+static glm::vec2 tracedProjection (0.f); // Field of view and aspect ratio of the last ray tracing request
+
+// Material maps, sampled by the ray tracer only
+static TextureCache textureCache;
+static int materialMapsIndex = -1; // Index of the material directory mapped on the main mesh, -1 for none
+
 void clear ();
 
 void printHelp () {
@@ -122,24 +149,89 @@ void printHelp () {
    			  + "\t* F: decrease field of view\n"
    			  + "\t* G: increase field of view\n"
    			  + "\t* TAB: switch between rasterization and ray tracing display\n"
-   			  + "\t* SPACE: execute ray tracing\n"
+   			  + "\t* I: toggle interactive ray tracing, following the camera at reduced resolution while it moves\n"
+   			  + "\t* SPACE: execute ray tracing in the background, restarting the render in flight if any\n"
+   			  + "\t* W: cycle through the ray tracing modes (megakernel, wavefront, visibility buffer)\n"
+   			  + "\t* B/N: increase/decrease the number of ray traced bounces\n"
+   			  + "\t* P/O: double/halve the number of ray traced samples per pixel\n"
+   			  + "\t* A: toggle adaptive sampling of the ray traced samples\n"
+   			  + "\t* S: cycle through the ray tracing samplers (Sobol, blue noise, random)\n"
+   			  + "\t* D: toggle denoising of the ray traced image\n"
+   			  + "\t* L: toggle adaptive subdivision of the primary rays of the interactive and single sample renders\n"
+   			  + "\t* R: toggle temporal reprojection, reusing the ray traced samples of the previous render after camera moves\n"
+   			  + "\t* E: export the last ray traced image and its AOVs to render.exr\n"
+   			  + "\t* T: cycle through the material maps of the main mesh, for ray tracing (none, then Resources/Materials/*)\n"
    			  + "\t* F1: randomize material's albedo\n"
    			  + "\t* F2/F3: increase/decrease material's roughness\n"
    			  + "\t* F4/F5: increase/decrease material's metallicness\n");
 }
 
-/// Adjust the ray tracer target resolution and runs it.
+/// Start ray tracing the current scene at the window resolution, in the background, cancelling the render in flight.
 void raytrace () {
 	int width, height;
 	glfwGetWindowSize(windowPtr, &width, &height);
-	rayTracerPtr->setResolution (width, height);
-	rayTracerPtr->render (scenePtr);
+	renderThreadPtr->request (*scenePtr, width, height);
+}
+
+/// Interactive ray tracing, called every frame: trace a new preview whenever the camera has moved and the previous
+/// preview is displayed, and refine the last one at full resolution once the camera stops.
+void updatePreview () {
+	if (!isDisplayRaytracing || !isInteractive)
+		return;
+	if (isPreviewInFlight) {
+		unsigned long version;
+		renderThreadPtr->image ()->front (version);
+		if (version != previewVersion) {
+			// Pixel count scales with the square of the resolution scale
+			double frameTime = std::chrono::duration<double> (std::chrono::steady_clock::now () - previewStart).count ();
+			double ratio = glm::clamp (PREVIEW_FRAME_TIME / std::max (frameTime, 1e-4), 0.25, 4.0);
+			previewScale = glm::clamp (previewScale * float (std::sqrt (ratio)), MIN_PREVIEW_SCALE, 1.f);
+		} else if (renderThreadPtr->busy ())
+			return;
+		isPreviewInFlight = false;
+	}
+	int width, height;
+	glfwGetWindowSize (windowPtr, &width, &height);
+	const Camera & camera = *scenePtr->camera ();
+	glm::mat4 view = camera.computeViewMatrix ();
+	glm::vec2 projection (camera.getFoV (), camera.getAspectRatio ());
+	if (view != tracedView || projection != tracedProjection) {
+		tracedView = view;
+		tracedProjection = projection;
+		renderThreadPtr->image ()->front (previewVersion);
+		previewStart = std::chrono::steady_clock::now ();
+		renderThreadPtr->request (*scenePtr, std::max (1, int (previewScale * width)), std::max (1, int (previewScale * height)), true);
+		isPreviewInFlight = true;
+		isRefinementPending = true;
+	} else if (isRefinementPending) {
+		renderThreadPtr->request (*scenePtr, width, height);
+		isRefinementPending = false;
+	}
 }
 
-inline float randf() { 
-	static thread_local std::mt19937 generator;
-	std::uniform_real_distribution<float> distribution (0.0, 1.0);
-	return distribution(generator);
+/// Ray tracer, once its background render is cancelled, so that its settings can be changed.
+RayTracer & idleRayTracer () {
+	renderThreadPtr->cancel ();
+	return *rayTracerPtr;
+}
+
+/// Map the next material directory of MATERIAL_PATH on the main mesh, in alphabetical order, or none after the last one.
+void cycleMaterialMaps () {
+	std::vector<fs::path> dirnames;
+	std::error_code error;
+	for (const auto & entry : fs::directory_iterator (basePath + MATERIAL_PATH, error))
+		if (entry.is_directory ())
+			dirnames.push_back (entry.path ());
+	std::sort (dirnames.begin (), dirnames.end ());
+	materialMapsIndex = (materialMapsIndex + 1 < int (dirnames.size ()) ? materialMapsIndex + 1 : -1);
+	Material & material = scenePtr->mesh (0)->material ();
+	if (materialMapsIndex < 0) {
+		material.clearMaps ();
+		Console::print ("Material maps: none");
+		return;
+	}
+	unsigned int numOfMaps = material.loadMaps (dirnames[materialMapsIndex].string (), textureCache);
+	Console::print ("Material maps: " + dirnames[materialMapsIndex].filename ().string () + " (" + std::to_string (numOfMaps) + " maps)");
 }
 
 /// Executed each time a key is entered.
@@ -159,6 +251,48 @@ void keyCallback (GLFWwindow * windowPtr, int key, int scancode, int action, int
 			isDisplayRaytracing = !isDisplayRaytracing;
 		} else if (action == GLFW_PRESS && key == GLFW_KEY_SPACE) {
 			raytrace ();
+		} else if (action == GLFW_PRESS && key == GLFW_KEY_W) {
+			RenderMode mode = rayTracerPtr->renderMode ();
+			mode = (mode == RenderMode::Megakernel ? RenderMode::Wavefront : (mode == RenderMode::Wavefront ? RenderMode::VisibilityBuffer : RenderMode::Megakernel));
+			idleRayTracer ().setRenderMode (mode);
+			Console::print (std::string ("Ray tracing mode: ") + renderModeName (mode));
+		} else if (action == GLFW_PRESS && (key == GLFW_KEY_B || key == GLFW_KEY_N)) {
+			unsigned int n = rayTracerPtr->numOfBounces ();
+			idleRayTracer ().setNumOfBounces (key == GLFW_KEY_B ? std::min (16u, n + 1) : (n > 0 ? n - 1 : 0));
+			Console::print ("Ray tracing bounces: " + std::to_string (rayTracerPtr->numOfBounces ()));
+		} else if (action == GLFW_PRESS && (key == GLFW_KEY_P || key == GLFW_KEY_O)) {
+			unsigned int n = rayTracerPtr->numOfSamples ();
+			idleRayTracer ().setNumOfSamples (key == GLFW_KEY_P ? std::min (4096u, 2 * n) : n / 2);
+			Console::print ("Ray tracing samples per pixel: " + std::to_string (rayTracerPtr->numOfSamples ()));
+		} else if (action == GLFW_PRESS && key == GLFW_KEY_S) {
+			SamplerType type = rayTracerPtr->samplerType ();
+			type = (type == SamplerType::Sobol ? SamplerType::BlueNoise : (type == SamplerType::BlueNoise ? SamplerType::Random : SamplerType::Sobol));
+			idleRayTracer ().setSamplerType (type);
+			Console::print (std::string ("Ray tracing sampler: ") + (type == SamplerType::Sobol ? "Sobol" : (type == SamplerType::BlueNoise ? "blue noise" : "random")));
+		} else if (action == GLFW_PRESS && key == GLFW_KEY_A) {
+			idleRayTracer ().setAdaptiveSampling (!rayTracerPtr->adaptiveSampling ());
+			Console::print (std::string ("Ray tracing adaptive sampling: ") + (rayTracerPtr->adaptiveSampling () ? "on" : "off"));
+		} else if (action == GLFW_PRESS && key == GLFW_KEY_D) {
+			idleRayTracer ().setDenoising (!rayTracerPtr->denoising ());
+			Console::print (std::string ("Ray tracing denoising: ") + (rayTracerPtr->denoising () ? "on" : "off"));
+		} else if (action == GLFW_PRESS && key == GLFW_KEY_L) {
+			idleRayTracer ().setAdaptiveSubdivision (!rayTracerPtr->adaptiveSubdivision ());
+			Console::print (std::string ("Ray tracing adaptive subdivision: ") + (rayTracerPtr->adaptiveSubdivision () ? "on" : "off"));
+		} else if (action == GLFW_PRESS && key == GLFW_KEY_R) {
+			idleRayTracer ().setTemporalReprojection (!rayTracerPtr->temporalReprojection ());
+			Console::print (std::string ("Ray tracing temporal reprojection: ") + (rayTracerPtr->temporalReprojection () ? "on" : "off"));
+		} else if (action == GLFW_PRESS && key == GLFW_KEY_E) {
+			if (renderThreadPtr->busy ())
+				Console::print ("Ray tracing in progress, export once it completes");
+			else if (rayTracerPtr->framebuffer ()->width () > 0)
+				rayTracerPtr->framebuffer ()->saveEXR ("render.exr");
+			else
+				Console::print ("Nothing to export, execute ray tracing first");
+		} else if (action == GLFW_PRESS && key == GLFW_KEY_I) {
+			isInteractive = !isInteractive;
+			Console::print (std::string ("Interactive ray tracing: ") + (isInteractive ? "on" : "off"));
+		} else if (action == GLFW_PRESS && key == GLFW_KEY_T) {
+			cycleMaterialMaps ();
 		} else if (action == GLFW_PRESS && key == GLFW_KEY_F1) {
 			scenePtr->mesh(0)->material().setAlbedo (glm::vec3 (randf(), randf(), randf()));
 		} else if (action == GLFW_PRESS && (key == GLFW_KEY_F2 || key == GLFW_KEY_F3)) {
@@ -225,7 +359,6 @@ void mouseButtonCallback (GLFWwindow * window, int button, int action, int mods)
 void windowSizeCallback (GLFWwindow * windowPtr, int width, int height) {
 	scenePtr->camera()->setAspectRatio (static_cast<float>(width) / static_cast<float>(height));
 	rasterizerPtr->setResolution (width, height);
-	rayTracerPtr->setResolution (width, height);
 }
 
 void initGLFW () {
@@ -263,6 +396,11 @@ void initGLFW () {
 void initScene () {
 	scenePtr = std::make_shared<Scene> ();
 	scenePtr->setBackgroundColor (glm::vec3 (0.1f, 0.5f, 0.95f));
+	if (!environmentMapFilename.empty ()) {
+		auto environmentMapPtr = std::make_shared<EnvironmentMap> ();
+		if (environmentMapPtr->load (environmentMapFilename))
+			scenePtr->setEnvironmentMap (environmentMapPtr);
+	}
 
 	// Mesh
 	auto meshPtr = std::make_shared<Mesh> ();
@@ -274,6 +412,7 @@ void initScene () {
 
     meshPtr->setScale(0.5f);
 	meshPtr->computeBoundingSphere (center, meshScale);
+	meshPtr->material ().setTextureScale (0.5f * meshScale); // Object space, as the bounding sphere
 	scenePtr->add (meshPtr);
 
 	auto squareMeshPtr = std::make_shared<Mesh>();
@@ -281,6 +420,7 @@ void initScene () {
 
 	glm::vec3 squareTranslation = glm::vec3(0.0f, 0.0f, -0.5f);
     squareMeshPtr->setTranslation(squareTranslation);
+    squareMeshPtr->setSpatialSplits(true); // Two huge triangles overlapping the whole model: let the SBVH clip them
 
     // Rotate the square mesh slightly
     // glm::vec3 squareRotation = glm::vec3(0.1f, 0.0f, 0.0f); // Rotate around x-axis by 0.1 radians
@@ -340,10 +480,18 @@ void init () {
 	rasterizerPtr = make_shared<Rasterizer> ();
 	rasterizerPtr->init (basePath, scenePtr); // Mut be called before creating the scene, to generate an OpenGL context and allow mesh VBOs
 	rayTracerPtr = make_shared<RayTracer> ();
+	rayTracerPtr->setFramebuffer (make_shared<Framebuffer> ());
 	rayTracerPtr->init (scenePtr);
+	renderThreadPtr = make_shared<RenderThread> (rayTracerPtr);
+	if (!coordinatorAddress.empty ()) {
+		auto coordinatorPtr = make_shared<RenderCoordinator> (coordinatorAddress);
+		if (coordinatorPtr->listening ())
+			renderThreadPtr->setCoordinator (coordinatorPtr);
+	}
 }
 
 void clear () {
+	renderThreadPtr.reset ();
 	glfwDestroyWindow (windowPtr);
 	glfwTerminate ();
 }
@@ -351,9 +499,14 @@ void clear () {
 
 // The main rendering call
 void render () {
-	if (isDisplayRaytracing)
-		rasterizerPtr->display (rayTracerPtr->image ());
-	else
+	static unsigned long displayedVersion = 0;
+	if (isDisplayRaytracing) {
+		// Latest pass published by the render thread, uploaded once
+		unsigned long version;
+		std::shared_ptr<const Image> imagePtr = renderThreadPtr->image ()->front (version);
+		rasterizerPtr->display (imagePtr, version != displayedVersion);
+		displayedVersion = version;
+	} else
 		rasterizerPtr->render (scenePtr);
 }
 
@@ -377,22 +530,42 @@ void update (float currentTime) {
 	glfwSetWindowTitle (windowPtr, titleWithFPS.c_str ());
 	lastTime = currentTime;
 	frameCount++;
+	updatePreview ();
 }
 
 void usage (const char * command) {
-	Console::print ("Usage : " + std::string(command) + " [<meshfile.off>]");
+	Console::print ("Usage : " + std::string(command) + " [--coordinator <address>] [<meshfile.off> [<environment.hdr>]]\n"
+					+ "        " + std::string(command) + " --worker <address>\n"
+					+ "Addresses are <host>:<port> or unix:<path>. The coordinator distributes full ray tracing renders to the\n"
+					+ "workers connected to it, e.g., processes started with --worker on this machine or others.");
 	std::exit (EXIT_FAILURE);
 }
 
 void parseCommandLine (int argc, char ** argv) {
-	if (argc > 3)
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if ((arg == "--coordinator" || arg == "--worker") && i + 1 < argc)
+			(arg == "--coordinator" ? coordinatorAddress : workerAddress) = argv[++i];
+		else if (arg.compare (0, 2, "--") == 0)
+			usage (argv[0]);
+		else
+			files.push_back (arg);
+	}
+	if (files.size () > 2 || (!workerAddress.empty () && (!files.empty () || !coordinatorAddress.empty ())))
 		usage (argv[0]);
 	basePath = "./";
-	meshFilename = (argc >= 2 ? argv[1] : DEFAULT_MESH_FILENAME);
+	meshFilename = (files.size () >= 1 ? files[0] : DEFAULT_MESH_FILENAME);
+	environmentMapFilename = (files.size () >= 2 ? files[1] : "");
 }
 
 int main (int argc, char ** argv) {
 	parseCommandLine (argc, argv);
+	if (!workerAddress.empty ()) {
+		// No window: the scenes come from the coordinator
+		RenderWorker worker;
+		return worker.run (workerAddress) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
 	init (); 
 
 	while (!glfwWindowShouldClose (windowPtr)) {
@@ -0,0 +1,33 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "Material.h"
+
+#include <filesystem>
+
+unsigned int Material::loadMaps (const std::string & dirname, TextureCache & cache) {
+	static const char * filenames[NumOfMaps] = {
+		"Base_Color.png",
+		"Roughness.png",
+		"Metallic.png",
+		"Normal.png",
+		"Ambient_Occlusion.png"
+	};
+	unsigned int numOfMaps = 0;
+	m_mapsDirname = dirname;
+	for (int m = 0; m < NumOfMaps; m++) {
+		std::filesystem::path path = std::filesystem::path (dirname) / filenames[m];
+		if (std::filesystem::exists (path)) {
+			m_maps[m] = cache.get (path.string (), m == BaseColorMap);
+			numOfMaps++;
+		} else {
+			m_maps[m].reset ();
+		}
+	}
+	return numOfMaps;
+}
@@ -1,7 +1,24 @@
 #pragma once
 
+#include <string>
+#include <memory>
+
+#include <glm/glm.hpp>
+
+#include "Texture.h"
+
 class Material {
 public:
+	/// Texture maps sampled by the ray tracer. A map, when present, replaces the corresponding constant.
+	enum Map {
+		BaseColorMap,
+		RoughnessMap,
+		MetallicMap,
+		NormalMap, ///< Tangent space normals, applied with the geometric normal as reference
+		AmbientOcclusionMap, ///< Attenuation of the environment light
+		NumOfMaps
+	};
+
 	inline const glm::vec3 & getAlbedo () const { return m_albedo; }
 	inline void setAlbedo (const glm::vec3 & albedo) { m_albedo = albedo; }
 	inline float getRoughness () const { return m_roughness; }
@@ -9,8 +26,40 @@ public:
 	inline float getMetallicness () const { return m_metallicness; }
 	inline void setMetallicness (float metallicness) { m_metallicness = metallicness; }
 
+	inline std::shared_ptr<Texture> map (Map m) const { return m_maps[m]; }
+	inline void setMap (Map m, std::shared_ptr<Texture> texturePtr) { m_maps[m] = texturePtr; }
+
+	inline bool hasMaps () const {
+		for (int m = 0; m < NumOfMaps; m++)
+			if (m_maps[m])
+				return true;
+		return false;
+	}
+
+	inline void clearMaps () {
+		for (int m = 0; m < NumOfMaps; m++)
+			m_maps[m].reset ();
+		m_mapsDirname.clear ();
+	}
+
+	/// Size of one repetition of the maps, in object space. OFF meshes have no texture coordinates: the maps
+	/// are projected along the three object space axes and blended according to the normal (triplanar mapping).
+	inline float getTextureScale () const { return m_textureScale; }
+	inline void setTextureScale (float scale) { m_textureScale = scale; }
+
+	/// Set the maps found in a material directory, e.g., Resources/Materials/Chesterfield/, named Base_Color.png,
+	/// Roughness.png, Metallic.png, Normal.png and Ambient_Occlusion.png. Missing files leave their map empty. Images are
+	/// only decoded when first sampled. Returns the number of maps found.
+	unsigned int loadMaps (const std::string & dirname, TextureCache & cache);
+
+	/// Material directory of the last loadMaps, empty if the maps were cleared since, or never loaded.
+	inline const std::string & mapsDirname () const { return m_mapsDirname; }
+
 private:
 	glm::vec3 m_albedo = glm::vec3 (0.5f, 0.5f, 0.5f);
 	float m_roughness = 0.01f;
 	float m_metallicness = 0.f;
-};
\ No newline at end of file
+	std::shared_ptr<Texture> m_maps[NumOfMaps];
+	float m_textureScale = 1.f;
+	std::string m_mapsDirname;
+};
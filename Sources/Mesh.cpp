@@ -48,4 +48,5 @@ void Mesh::clear () {
 	m_vertexPositions.clear ();
 	m_vertexNormals.clear ();
 	m_triangleIndices.clear ();
+	m_source.clear ();
 }
\ No newline at end of file
@@ -9,6 +9,7 @@
 #pragma once
 
 #include <vector>
+#include <string>
 #include <memory>
 
 #include <glm/glm.hpp>
@@ -34,6 +35,16 @@ public:
 	Material & material () { return m_material;}
 	const Material & material () const { return m_material;}
 
+	/// Whether the ray tracer BVH may clip and duplicate this mesh's triangles (SBVH spatial splits).
+	/// Useful for large, poorly shaped triangles overlapping the rest of the scene.
+	inline bool spatialSplits () const { return m_spatialSplits; }
+	inline void setSpatialSplits (bool s) { m_spatialSplits = s; }
+
+	/// Where the geometry was loaded from, so that other processes may load it again, e.g., the workers of a distributed
+	/// render: the OFF file, MeshLoader::SQUARE_SOURCE, or empty for meshes built otherwise.
+	inline const std::string & source () const { return m_source; }
+	inline void setSource (const std::string & source) { m_source = source; }
+
 	/// Compute the parameters of a sphere which bounds the mesh
 	void computeBoundingSphere (glm::vec3 & center, float & radius) const;
 	
@@ -48,4 +59,6 @@ private:
 	std::vector<glm::vec3> m_vertexNormals;
 	std::vector<glm::uvec3> m_triangleIndices;
 	Material m_material;
+	bool m_spatialSplits = false;
+	std::string m_source;
 };
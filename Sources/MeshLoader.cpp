@@ -47,6 +47,7 @@ void MeshLoader::loadSquare(std::shared_ptr<Mesh> meshPtr) {
     // Recompute vertex normals
     meshPtr->vertexNormals().resize(vertices.size(), glm::vec3(0.f, 0.f, 1.f));
     meshPtr->recomputePerVertexNormals();
+    meshPtr->setSource (SQUARE_SOURCE);
 }
 
 void MeshLoader::loadOFF (const std::string & filename, std::shared_ptr<Mesh> meshPtr) {
@@ -81,5 +82,13 @@ void MeshLoader::loadOFF (const std::string & filename, std::shared_ptr<Mesh> me
     in.close ();
     meshPtr->vertexNormals ().resize (P.size (), glm::vec3 (0.f, 0.f, 1.f));
     meshPtr->recomputePerVertexNormals ();
+    meshPtr->setSource (filename);
     Console::print ("Mesh <" + filename + "> loaded");
+}
+
+void MeshLoader::load (const std::string & source, std::shared_ptr<Mesh> meshPtr) {
+	if (source == SQUARE_SOURCE)
+		loadSquare (meshPtr);
+	else
+		loadOFF (source, meshPtr);
 }
\ No newline at end of file
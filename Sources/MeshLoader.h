@@ -15,7 +15,13 @@
 
 namespace MeshLoader {
 
+/// Source of the meshes made by loadSquare, see Mesh::source.
+const std::string SQUARE_SOURCE = "square";
+
 /// Loads an OFF mesh file. See https://en.wikipedia.org/wiki/OFF_(file_format)
 void loadOFF (const std::string & filename, std::shared_ptr<Mesh> meshPtr);
 void loadSquare(std::shared_ptr<Mesh> meshPtr);
+
+/// Loads the mesh from its source, an OFF file or SQUARE_SOURCE, see Mesh::source.
+void load (const std::string & source, std::shared_ptr<Mesh> meshPtr);
 }
@@ -0,0 +1,18 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <random>
+
+/// Uniform random number in [0, 1), drawn from a per-thread generator. Not reproducible: the ray tracer uses Sampler instead.
+inline float randf() { 
+	static thread_local std::mt19937 generator;
+	std::uniform_real_distribution<float> distribution (0.0, 1.0);
+	return distribution(generator);
+}
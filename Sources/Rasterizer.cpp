@@ -11,6 +11,7 @@
 #include <algorithm>
 #include "Resources.h"
 #include "Error.h"
+#include "FboShadowMap.h"
 
 bool saveShadowMapsPpm = true;
 
@@ -68,7 +69,7 @@ void Rasterizer::loadShaderProgram (const std::string & basePath) {
 	}
 }
 
-void Rasterizer::updateDisplayedImageTexture (std::shared_ptr<Image> imagePtr) {
+void Rasterizer::updateDisplayedImageTexture (std::shared_ptr<const Image> imagePtr) {
 	glBindTexture (GL_TEXTURE_2D, m_displayImageTex);
    	// Uploading the image data to GPU memory
 	glTexImage2D (
@@ -120,6 +121,16 @@ void Draw(std::shared_ptr<ShaderProgram> shader, std::shared_ptr<Scene> scenePtr
 
 }
 
+void LightSource::allocateShadowMapFbo (unsigned int w, unsigned int h) {
+	if (!m_shadowMapPtr)
+		m_shadowMapPtr = std::make_shared<FboShadowMap> ();
+	m_shadowMapPtr->allocate (w, h);
+}
+
+void LightSource::bindShadowMap () {
+	m_shadowMapPtr->bindFbo ();
+}
+
 glm::mat4 LightSource::getProjectionViewMatrix(
     std::shared_ptr<ShaderProgram> shader_shadow_map_Ptr,
     const glm::vec3 scene_center,
@@ -148,6 +159,8 @@ void Rasterizer::render (std::shared_ptr<Scene> scenePtr) {
 	for(size_t i = 0; i < scenePtr->lightSources().size(); ++i) {
 		LightSource li = lightSources[i];
 		lightMVP.push_back(li.getProjectionViewMatrix(m_shadowMapingShaderProgramPtr, glm::vec3(0.f), 3.f));
+		if (!li.shadowMap ())
+			continue;
 		m_shadowMapingShaderProgramPtr->set("depthMVP", lightMVP.back());
 		li.bindShadowMap();
 
@@ -156,7 +169,7 @@ void Rasterizer::render (std::shared_ptr<Scene> scenePtr) {
 		draw (0, scenePtr->mesh (0)->triangleIndices().size ());
 		if(saveShadowMapsPpm) {
 			std::cout << "Saving Shadow Map for Light " << i << std::endl;
-			li.m_shadowMap.savePpmFile(std::string("shadom_map_")+std::to_string(i)+std::string(".ppm"));
+			li.shadowMap ()->savePpmFile(std::string("shadom_map_")+std::to_string(i)+std::string(".ppm"));
 		}
 	}
 	saveShadowMapsPpm = false;
@@ -178,9 +191,11 @@ void Rasterizer::render (std::shared_ptr<Scene> scenePtr) {
 		m_pbrShaderProgramPtr->set (lstring + ".color", li.getColor ());
 		m_pbrShaderProgramPtr->set (lstring + ".intensity", li.getIntensity ());
 
-		glActiveTexture(GL_TEXTURE0 + li.getShadowMapTex());
-		glBindTexture(GL_TEXTURE_2D, li.m_shadowMap.getTextureId());
-		m_pbrShaderProgramPtr->set(std::string("shadowMap[") + std::to_string(i) + std::string("]"), li.getShadowMapTex());
+		if (li.shadowMap ()) {
+			glActiveTexture(GL_TEXTURE0 + li.getShadowMapTex());
+			glBindTexture(GL_TEXTURE_2D, li.shadowMap ()->getTextureId());
+			m_pbrShaderProgramPtr->set(std::string("shadowMap[") + std::to_string(i) + std::string("]"), li.getShadowMapTex());
+		}
       	m_pbrShaderProgramPtr->set(std::string("shadowMVP[") + std::to_string(i) + std::string("]"), lightMVP[i]);
 	}
 	
@@ -220,8 +235,9 @@ void Rasterizer::render (std::shared_ptr<Scene> scenePtr) {
 	
 }
 
-void Rasterizer::display (std::shared_ptr<Image> imagePtr) {
-	updateDisplayedImageTexture (imagePtr);
+void Rasterizer::display (std::shared_ptr<const Image> imagePtr, bool updateTexture) {
+	if (updateTexture)
+		updateDisplayedImageTexture (imagePtr);
 	glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Erase the color and z buffers.
 	m_displayShaderProgramPtr->use (); // Activate the program to be used for upcoming primitive
 	glActiveTexture (GL_TEXTURE0);
@@ -26,12 +26,13 @@ public:
 	/// OpenGL context, shader pipeline initialization and GPU ressources (vertex buffers, textures, etc)
 	void init (const std::string & basepath, const std::shared_ptr<Scene> scenePtr);
 	void setResolution (int width, int height);
-	void updateDisplayedImageTexture (std::shared_ptr<Image> imagePtr);
+	void updateDisplayedImageTexture (std::shared_ptr<const Image> imagePtr);
 	void initDisplayedImage ();
 	/// Loads and compile the programmable shader pipeline
 	void loadShaderProgram (const std::string & basePath);
 	void render (std::shared_ptr<Scene> scenePtr);
-	void display (std::shared_ptr<Image> imagePtr);
+	/// Draw the image over the whole viewport. The texture of the previously displayed image is reused unless updateTexture is set.
+	void display (std::shared_ptr<const Image> imagePtr, bool updateTexture = true);
 	void clear ();
 	bool oneTime = true;
 
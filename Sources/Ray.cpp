@@ -1,34 +1,63 @@
 #include "Ray.h"
 
-constexpr float epsilon = 1e-6;
-
-
-bool Ray::rayTriangleIntersection(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, Hit& hit, bool aux) {
-    glm::vec3 e0 = p1 - p0;
-    glm::vec3 e1 = p2 - p0;
-    glm::vec3 n = glm::normalize(glm::cross(e0, e1));
-    
-    glm::vec3 q = glm::cross(this->direction, e1);
-    float a = glm::dot(e0, q);
-
-    if (fabs(a) < epsilon)
-        return false; // No intersection
-
-    glm::vec3 s = (this->origin - p0);
-    glm::vec3 r = glm::cross(s, e0);
-
-    float b0 = glm::dot(s, q)/a;
-    float b1 = glm::dot(r, this->direction)/a;
-    float t = glm::dot(e1, r)/ a;
-
-    hit.setHitPoint(this->origin + t * this->direction);
-    hit.u = b0;
-    hit.v = b1;
-    hit.t = t;
-
-    if (b0 < 0.f || b0 > 1.f)
-		return false;
-	if (b1 >= 0.f && b1 + b0 <= 1.f)
-		return true;
-	return false;
-}
\ No newline at end of file
+#include <cmath>
+#include <utility>
+
+void Ray::precomputeShear() {
+    glm::vec3 a = glm::abs(direction);
+    kz = (a.x > a.y) ? (a.x > a.z ? 0 : 2) : (a.y > a.z ? 1 : 2);
+    kx = (kz + 1) % 3;
+    ky = (kx + 1) % 3;
+    if (direction[kz] < 0.f)
+        std::swap(kx, ky);
+    Sx = direction[kx] / direction[kz];
+    Sy = direction[ky] / direction[kz];
+    Sz = 1.f / direction[kz];
+}
+
+bool Ray::rayTriangleIntersection(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, Hit& hit) const {
+    // Vertices relative to the ray origin, sheared and scaled so that the ray becomes the unit +z axis
+    const glm::vec3 A = p0 - this->origin;
+    const glm::vec3 B = p1 - this->origin;
+    const glm::vec3 C = p2 - this->origin;
+    const float Ax = A[kx] - Sx * A[kz];
+    const float Ay = A[ky] - Sy * A[kz];
+    const float Bx = B[kx] - Sx * B[kz];
+    const float By = B[ky] - Sy * B[kz];
+    const float Cx = C[kx] - Sx * C[kz];
+    const float Cy = C[ky] - Sy * C[kz];
+
+    // Scaled barycentric coordinates, i.e. 2D edge functions
+    float U = Cx * By - Cy * Bx;
+    float V = Ax * Cy - Ay * Cx;
+    float W = Bx * Ay - By * Ax;
+
+    // Fall back to double precision on edges, so that rays cannot leak between adjacent triangles
+    if (U == 0.f || V == 0.f || W == 0.f) {
+        U = static_cast<float>(double(Cx) * double(By) - double(Cy) * double(Bx));
+        V = static_cast<float>(double(Ax) * double(Cy) - double(Ay) * double(Cx));
+        W = static_cast<float>(double(Bx) * double(Ay) - double(By) * double(Ax));
+    }
+
+    if ((U < 0.f || V < 0.f || W < 0.f) && (U > 0.f || V > 0.f || W > 0.f))
+        return false;
+
+    const float det = U + V + W;
+    if (det == 0.f)
+        return false;
+
+    // Scaled hit distance, compared against ]0, hit.t[ before the single division
+    const float Az = Sz * A[kz];
+    const float Bz = Sz * B[kz];
+    const float Cz = Sz * C[kz];
+    const float T = U * Az + V * Bz + W * Cz;
+    if (det < 0.f ? (T >= 0.f || T <= hit.t * det) : (T <= 0.f || T >= hit.t * det))
+        return false;
+
+    const float invDet = 1.f / det;
+    hit.u = V * invDet;
+    hit.v = W * invDet;
+    hit.t = T * invDet;
+    hit.setHitPoint(this->origin + hit.t * this->direction);
+    return true;
+}
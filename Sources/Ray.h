@@ -1,3 +1,5 @@
+#pragma once
+
 #include <iostream>
 #include <glm/glm.hpp>
 #include "Hit.h"
@@ -6,9 +8,20 @@ class Ray {
 public:
     
     Ray(const glm::vec3& origin, const glm::vec3& direction)
-        : origin(origin), direction(glm::normalize(direction)) {}
+        : origin(origin), direction(glm::normalize(direction)) { precomputeShear(); }
 
-    bool rayTriangleIntersection(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, Hit& hit, bool aux) ;
+    /// Watertight ray/triangle test (Woop et al. 2013). Accepts hits with 0 < t < hit.t only,
+    /// in which case hit receives the intersection point, t and the barycentric coordinates
+    /// (u for p1, v for p2). The hit is left untouched otherwise.
+    bool rayTriangleIntersection(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, Hit& hit) const;
     glm::vec3 origin;
     glm::vec3 direction;
-};
\ No newline at end of file
+
+    // Per-ray shear constants of the watertight test, derived from the direction at construction:
+    // kz is the dominant axis of the direction, (kx, ky) the two others, keeping the winding.
+    int kx, ky, kz;
+    float Sx, Sy, Sz;
+
+private:
+    void precomputeShear();
+};
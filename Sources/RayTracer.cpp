@@ -8,26 +8,39 @@
 // ----------------------------------------------
 #include "RayTracer.h"
 #include <algorithm>
+#include <numeric>
+#include <filesystem>
 
 #include "Console.h"
 #include "Camera.h"
 #include "Hit.h"
+#include "BRDFBatch.h"
 
 RayTracer::RayTracer() : 
-	m_imagePtr (std::make_shared<Image>()) {}
+	m_imagePtr (std::make_shared<Image>()),
+	m_bvhPtr (std::make_shared<BVH>()),
+	m_lightBVHPtr (std::make_shared<LightBVH>()),
+	m_wavefrontPtr (std::make_shared<Wavefront>()) {}
 
 RayTracer::~RayTracer() {}
 
 void RayTracer::init (const std::shared_ptr<Scene> scenePtr) {
+	// Into a new hierarchy, the current one may be shared (see setBVH)
+	auto bvhPtr = std::make_shared<BVH> ();
+	bvhPtr->setBuildMode (m_bvhPtr->buildMode ());
+	bvhPtr->setDuplicationBudget (m_bvhPtr->duplicationBudget ());
+	bvhPtr->build (scenePtr);
+	m_bvhPtr = bvhPtr;
+	m_history.clear ();
+	m_lightBVHSignature = 0;
 }
 
-
-bool rayTriangleIntersection(glm::mat4 modelMatrix, Ray ray, const std::vector<glm::vec3>& vertexPositions, const glm::uvec3& triangleIndices, Hit& hit) {
-	const glm::vec3& p0 = glm::vec3(modelMatrix * glm::vec4(vertexPositions[triangleIndices.x], 1.0));
-    const glm::vec3& p1 = glm::vec3(modelMatrix * glm::vec4(vertexPositions[triangleIndices.y], 1.0));
-    const glm::vec3& p2 = glm::vec3(modelMatrix * glm::vec4(vertexPositions[triangleIndices.z], 1.0));
-
-	return ray.rayTriangleIntersection(p0, p1, p2, hit, false);
+void RayTracer::setBVH (std::shared_ptr<BVH> bvhPtr) {
+	if (bvhPtr == m_bvhPtr)
+		return;
+	m_bvhPtr = bvhPtr;
+	m_history.clear ();
+	m_lightBVHSignature = 0;
 }
 
 
@@ -46,158 +59,761 @@ void printMat41(const glm::mat4& matrix) {
     }
 }
 
-glm::vec3 attenuation (LightSource l, glm::vec3 lightPosition, glm::vec3 p){
-	float d = distance (lightPosition, p);
-	return l.getIntensity() * l.getColor()/(d*d);
+/// Direct lighting at the surface point: the point lights selected by selectLights, plus one environment sample,
+/// MIS weighted against BRDF sampling if the path continues.
+glm::vec3 shade (const ShadingContext & context, const BVH & bvh, const LightBVH & lightBVH, unsigned int numOfLightSamples,
+				 const PixelSampler & sampler, unsigned int dimension, const Ray & ray, const Hit & hit, bool lastBounce, SurfacePoint & sp) {
+	sp = surfacePoint (context, hit);
+	glm::vec3 wo = normalize(-ray.direction);
+	glm::vec3 colorResponse (0.f, 0.f, 0.f);
+
+	float u[MAX_LIGHT_SAMPLES];
+	unsigned int lights[MAX_LIGHT_SAMPLES];
+	float weights[MAX_LIGHT_SAMPLES];
+	for (unsigned int k = 0; k < numOfLightSamples; k++)
+		u[k] = sampler.get1D (dimension + LIGHT_SELECTION_DIMENSION + k);
+	unsigned int numOfSelectedLights = selectLights (sp, context.lights.size (), lightBVH, numOfLightSamples, u, lights, weights);
+	// The BRDF of the unoccluded lights is evaluated in a single batch
+	BRDFBatch<MAX_LIGHT_SAMPLES> batch;
+	glm::vec3 irradiances[MAX_LIGHT_SAMPLES];
+	for (unsigned int k = 0; k < numOfSelectedLights; ++k) {
+		const ShadingLight & light = context.lights[lights[k]];
+		glm::vec3 wi, irradiance;
+		float distance;
+		if (!lightIncidence (sp, light, wi, distance, irradiance))
+			continue;
+		glm::vec3 shadowOrigin = offsetRayOrigin (sp, wi);
+		if (bvh.occluded (Ray (shadowOrigin, wi), glm::distance (shadowOrigin, light.position)))
+			continue;
+		irradiances[batch.add (sp, wo, wi)] = weights[k] * irradiance;
+	}
+	evaluateBRDFBatch (batch);
+	for (size_t i = 0; i < batch.size; i++)
+		colorResponse += irradiances[i] * batch.result (i);
+
+	glm::vec2 ue = sampler.get2D (dimension + ENVIRONMENT_DIMENSION);
+	glm::vec3 wi;
+	float pdf;
+	glm::vec3 Le = sampleEnvironment (context, ue.x, ue.y, wi, pdf);
+	glm::vec3 radiance;
+	if (environmentContribution (sp, Le, pdf, wo, wi, !lastBounce, radiance)
+		&& !bvh.occluded (Ray (offsetRayOrigin (sp, wi), wi), std::numeric_limits<float>::infinity ()))
+		colorResponse += radiance;
+	return colorResponse;
 }
-glm::vec3 diffuseBRDF(Material material){
-	float aux = 1.0 - material.getMetallicness();
-	aux /= PI;
-	return aux * (material.getAlbedo());
+
+/// Unidirectional path tracing with next event estimation. BRDF sampled rays escaping to the background
+/// are MIS weighted against the environment samples of the previous vertex. The primary hit is described in features.
+/// If primaryHit is given, it is the hit of the camera ray, already traced, with a negative mesh index on a miss.
+glm::vec3 PerPixel (const ShadingContext & context, const BVH & bvh, const LightBVH & lightBVH, unsigned int numOfLightSamples,
+					const PixelSampler & sampler, Ray ray, unsigned int numOfBounces, SurfaceFeatures & features, const Hit * primaryHit = nullptr) {
+	glm::vec3 color (0.f, 0.f, 0.f);
+	glm::vec3 throughput (1.f, 1.f, 1.f);
+	features = SurfaceFeatures ();
+	float brdfPdf = 0.f; // Density of the BRDF sample that generated the ray, 0 for camera rays
+	float occlusion = 1.f; // Ambient occlusion of the vertex the ray left, applied to both environment strategies
+	for (unsigned int bounce = 0; bounce <= numOfBounces; bounce++) {
+		Hit hit (ray.origin, ray.direction, std::numeric_limits<float>::infinity ());
+		bool found;
+		if (bounce == 0 && primaryHit) {
+			hit = *primaryHit;
+			found = (hit.getMesh () >= 0);
+		} else
+			found = bvh.intersect (ray, hit);
+		if (!found) {
+			float misWeight = (brdfPdf > 0.f ? powerHeuristic (brdfPdf, environmentPdf (context, ray.direction)) : 1.f);
+			color += (misWeight * occlusion) * throughput * environmentRadiance (context, ray.direction);
+			break;
+		}
+		SurfacePoint sp;
+		bool lastBounce = (bounce == numOfBounces);
+		unsigned int dimension = bounceDimension (bounce);
+		color += throughput * shade(context, bvh, lightBVH, numOfLightSamples, sampler, dimension, ray, hit, lastBounce, sp);
+		if (bounce == 0)
+			features = surfaceFeatures (sp, hit);
+		if (lastBounce)
+			break;
+		glm::vec3 wi, weight;
+		glm::vec2 ub = sampler.get2D (dimension + BRDF_DIRECTION_DIMENSION);
+		if (!sampleBRDF (sp, -ray.direction, sampler.get1D (dimension + BRDF_LOBE_DIMENSION), ub.x, ub.y, wi, weight, brdfPdf))
+			break;
+		throughput *= weight;
+		occlusion = sp.occlusion;
+		if (!russianRoulette (bounce, sampler.get1D (dimension + RUSSIAN_ROULETTE_DIMENSION), throughput))
+			break;
+		ray = Ray (offsetRayOrigin (sp, wi), wi);
+	}
+	return color;
 }
 
-float D_GGX(float NoH, float a) {
-    float a2 = a * a;
-    float f = (NoH * a2 - NoH) * NoH + 1.0;
-    return a2 / (PI * f * f);
+static const size_t TILE_SIZE = 16;
+static const unsigned int ADAPTIVE_MIN_SAMPLES = 8; // Samples per pixel before a tile may be retired
+static const unsigned int ADAPTIVE_MAX_SAMPLE_RATIO = 16; // Maximum samples per pixel, relative to the average target
+
+static const unsigned int SUBDIVISION_BLOCK_SIZE = 8; // Spacing of the coarse lattice of adaptive subdivision, in pixels
+static const float REPROJECTION_DEPTH_TOLERANCE = 0.02f; // Relative to the distance to the previous camera
+static const float REPROJECTION_NORMAL_TOLERANCE = 0.9f; // Minimum cosine between the current and previous normals
+
+static inline float luminance (const glm::vec3 & c) { return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b; }
+
+/// FNV-1a hash of size bytes, accumulated into h.
+static inline void hashBytes (uint64_t & h, const void * data, size_t size) {
+	const unsigned char * bytes = static_cast<const unsigned char *> (data);
+	for (size_t i = 0; i < size; i++)
+		h = (h ^ bytes[i]) * 1099511628211ull;
 }
 
-glm::vec3 F_Schlick(float u, glm::vec3 f0) {
-	return f0 + ((glm::vec3(1.0f) - f0) * pow(1.0f - u, 5.0f));
+static inline void hashString (uint64_t & h, const std::string & s) { hashBytes (h, s.c_str (), s.size () + 1); }
+
+template<typename T>
+static inline void hashVector (uint64_t & h, const std::vector<T> & v) { hashBytes (h, v.data (), v.size () * sizeof (T)); }
+
+const char * renderModeName (RenderMode mode) {
+	switch (mode) {
+	case RenderMode::Wavefront: return "wavefront";
+	case RenderMode::VisibilityBuffer: return "visibility buffer";
+	default: return "megakernel";
+	}
 }
 
-float V_SmithGGXCorrelated(float NoV, float NoL, float a) {
-    float a2 = a * a;
-    float GGXL = NoV * sqrt((-NoL * a2 + NoL) * NoL + a2);
-    float GGXV = NoL * sqrt((-NoV * a2 + NoV) * NoV + a2);
-    return 0.5 / (GGXV + GGXL);
+/// Camera ray of the sample, through the pixel center for the first sample.
+static inline Ray primaryRay (const CameraFrame & frame, const PixelSampler & sampler, size_t i, size_t j, size_t width, size_t height, unsigned int sampleIndex) {
+	glm::vec2 offset = (sampleIndex > 0 ? sampler.get2D (PIXEL_DIMENSION) : glm::vec2 (0.5f));
+	return frame.rayAt((float(i) + offset.x) / width, 1.f - (float(j) + offset.y) / height);
 }
 
+bool RayTracer::renderPass (const std::shared_ptr<Scene> scenePtr) {
+	size_t width = m_imagePtr->width();
+	size_t height = m_imagePtr->height();
+	if (m_renderMode == RenderMode::Wavefront)
+		return m_wavefrontPtr->render (scenePtr, m_shadingContext, *m_bvhPtr, *m_lightBVHPtr, m_numOfLightSamples, m_numOfBounces, width, height, m_activePixels, m_sampler, m_sampleCounts, m_cancelRequested, m_passBuffer, m_passFeatures);
+	if (m_renderMode == RenderMode::VisibilityBuffer)
+		return renderVisibilityPass (scenePtr);
+	const CameraFrame frame = scenePtr->camera()->computeFrame();
+	#pragma omp parallel for schedule(dynamic, TILE_SIZE)
+	for (long long k = 0; k < (long long)m_activePixels.size(); k++) {
+		if (m_cancelRequested)
+			continue;
+		size_t pixel = m_activePixels[k];
+		size_t i = pixel % width;
+		size_t j = pixel / width;
+		PixelSampler sampler (m_sampler, i, j, m_sampleCounts[pixel]);
+		Ray ray = primaryRay (frame, sampler, i, j, width, height, m_sampleCounts[pixel]);
+		m_passBuffer[pixel] = PerPixel(m_shadingContext, *m_bvhPtr, *m_lightBVHPtr, m_numOfLightSamples, sampler, ray, m_numOfBounces, m_passFeatures[pixel]);
+	}
+	return !m_cancelRequested;
+}
 
-glm::vec3 microfacetBRDF(Material m, glm::vec3 normal, glm::vec3 wo, glm::vec3 wi){
-	glm::vec3 h = normalize(wo + wi);
-    float NoV = abs(dot(normal, wo)) + 1e-5;
-    float NoL = clamp(dot(normal, wi), 0.0f, 1.0f);
-    float NoH = clamp(dot(normal, h), 0.0f, 1.0f);
-    float LoH = clamp(dot(wi, h), 0.0f, 1.0f);
+bool RayTracer::renderVisibilityPass (const std::shared_ptr<Scene> scenePtr) {
+	size_t width = m_imagePtr->width();
+	size_t height = m_imagePtr->height();
+	const CameraFrame frame = scenePtr->camera()->computeFrame();
+	size_t numOfSamples = m_activePixels.size ();
+	m_visibilityBuffer.resize (numOfSamples);
+
+	// Phase one: primary visibility only, no shading data is touched
+	#pragma omp parallel for schedule(dynamic, TILE_SIZE)
+	for (long long k = 0; k < (long long)numOfSamples; k++) {
+		if (m_cancelRequested)
+			continue;
+		size_t pixel = m_activePixels[k];
+		size_t i = pixel % width;
+		size_t j = pixel / width;
+		PixelSampler sampler (m_sampler, i, j, m_sampleCounts[pixel]);
+		Ray ray = primaryRay (frame, sampler, i, j, width, height, m_sampleCounts[pixel]);
+		Hit hit (ray.origin, ray.direction, std::numeric_limits<float>::infinity ());
+		m_visibilityBuffer.setDirection (k, ray.direction);
+		if (m_bvhPtr->intersect (ray, hit))
+			m_visibilityBuffer.set (k, hit);
+		else
+			m_visibilityBuffer.setMiss (k);
+	}
+	if (m_cancelRequested)
+		return false;
+
+	// Phase two: shade the samples mesh by mesh
+	m_visibilityBuffer.sortByMesh (m_shadingContext.meshes.size ());
+	const std::vector<unsigned int> & order = m_visibilityBuffer.order ();
+	#pragma omp parallel for schedule(dynamic, TILE_SIZE)
+	for (long long q = 0; q < (long long)numOfSamples; q++) {
+		if (m_cancelRequested)
+			continue;
+		size_t k = order[q];
+		size_t pixel = m_activePixels[k];
+		size_t i = pixel % width;
+		size_t j = pixel / width;
+		PixelSampler sampler (m_sampler, i, j, m_sampleCounts[pixel]);
+		Ray ray (frame.eye, m_visibilityBuffer.direction (k));
+		Hit hit = m_visibilityBuffer.hit (k, ray);
+		m_passBuffer[pixel] = PerPixel(m_shadingContext, *m_bvhPtr, *m_lightBVHPtr, m_numOfLightSamples, sampler, ray, m_numOfBounces, m_passFeatures[pixel], &hit);
+	}
+	return !m_cancelRequested;
+}
 
-    // perceptually linear roughness to roughness (see parameterization)
-    float roughness = m.getRoughness() * m.getRoughness();
+/// Block of adaptive subdivision, spanning the pixels [x0, x1] x [y0, y1], whose corners are traced.
+struct SubdivisionBlock {
+	unsigned int x0, y0, x1, y1;
+};
 
-    float D = D_GGX(NoH, roughness);
-    float reflectance  = 1.0;
-    glm::vec3 f0 = 0.16f * reflectance * reflectance * (1.0f - m.getMetallicness()) + m.getAlbedo() * m.getMetallicness();
-    glm::vec3  F = F_Schlick(LoH, f0);
-    float V = V_SmithGGXCorrelated(NoV, NoL, roughness);
-    return D * V * F;
+size_t RayTracer::renderSubdividedPass (const std::shared_ptr<Scene> scenePtr) {
+	size_t width = m_imagePtr->width();
+	size_t height = m_imagePtr->height();
+	std::vector<unsigned char> traced (width * height, 0);
+	std::vector<SubdivisionBlock> blocks, children;
+	for (unsigned int y0 = 0; y0 + 1 < height; y0 += SUBDIVISION_BLOCK_SIZE)
+		for (unsigned int x0 = 0; x0 + 1 < width; x0 += SUBDIVISION_BLOCK_SIZE)
+			blocks.push_back ({ x0, y0, unsigned (std::min (size_t (x0 + SUBDIVISION_BLOCK_SIZE), width - 1)), unsigned (std::min (size_t (y0 + SUBDIVISION_BLOCK_SIZE), height - 1)) });
+	size_t numOfTracedSamples = 0;
+	while (!blocks.empty ()) {
+		// Trace the corners of the blocks of this level, shared corners once
+		m_activePixels.clear ();
+		for (const SubdivisionBlock & block : blocks) {
+			unsigned int corners[4] = { block.y0 * unsigned (width) + block.x0, block.y0 * unsigned (width) + block.x1,
+										block.y1 * unsigned (width) + block.x0, block.y1 * unsigned (width) + block.x1 };
+			for (unsigned int corner : corners)
+				if (!traced[corner]) {
+					traced[corner] = 1;
+					m_activePixels.push_back (corner);
+				}
+		}
+		if (!renderPass (scenePtr))
+			return numOfTracedSamples;
+		numOfTracedSamples += m_activePixels.size ();
+
+		// Interpolate the coherent blocks, and split the others along their sides longer than a pixel
+		children.clear ();
+		for (const SubdivisionBlock & block : blocks) {
+			size_t corners[4] = { block.y0 * width + block.x0, block.y0 * width + block.x1, block.y1 * width + block.x0, block.y1 * width + block.x1 };
+			if (block.x1 - block.x0 <= 1 && block.y1 - block.y0 <= 1)
+				continue;
+			bool coherent = true;
+			glm::vec3 minColor = m_passBuffer[corners[0]], maxColor = m_passBuffer[corners[0]];
+			for (size_t c = 1; c < 4; c++) {
+				coherent &= (m_passFeatures[corners[c]].mesh == m_passFeatures[corners[0]].mesh
+							 && m_passFeatures[corners[c]].triangle == m_passFeatures[corners[0]].triangle);
+				minColor = glm::min (minColor, m_passBuffer[corners[c]]);
+				maxColor = glm::max (maxColor, m_passBuffer[corners[c]]);
+			}
+			glm::vec3 range = maxColor - minColor;
+			float contrast = std::max (range.r, std::max (range.g, range.b)) / (luminance (0.5f * (minColor + maxColor)) + 1e-2f);
+			if (coherent && contrast <= m_subdivisionThreshold) {
+				interpolateBlock (block.x0, block.y0, block.x1, block.y1, traced);
+				continue;
+			}
+			unsigned int xm = (block.x1 - block.x0 > 1 ? (block.x0 + block.x1) / 2 : block.x1);
+			unsigned int ym = (block.y1 - block.y0 > 1 ? (block.y0 + block.y1) / 2 : block.y1);
+			children.push_back ({ block.x0, block.y0, xm, ym });
+			if (xm < block.x1)
+				children.push_back ({ xm, block.y0, block.x1, ym });
+			if (ym < block.y1)
+				children.push_back ({ block.x0, ym, xm, block.y1 });
+			if (xm < block.x1 && ym < block.y1)
+				children.push_back ({ xm, ym, block.x1, block.y1 });
+		}
+		std::swap (blocks, children);
+	}
+	return numOfTracedSamples;
 }
 
-glm::vec3 shade (const std::shared_ptr<Scene> scenePtr, Ray ray, Hit hit) {
-	const auto mesh = scenePtr->mesh(hit.getMesh());
-	//const std::shared_ptr<Material> materialPtr = scenePtr->material(scenePtr->mesh2material(hit.m_meshIndex));
-	const auto& P = mesh->vertexPositions();
-	const auto& N = mesh->vertexNormals();
-	const glm::uvec3 & triangle = mesh->triangleIndices()[hit.getSimp()];
-
-	float w = 1.f - hit.u - hit.v;
+void RayTracer::interpolateBlock (unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, const std::vector<unsigned char> & traced) {
+	size_t width = m_imagePtr->width();
+	size_t corners[4] = { y0 * width + x0, y0 * width + x1, y1 * width + x0, y1 * width + x1 };
+	float sx = 1.f / float (std::max (1u, x1 - x0)), sy = 1.f / float (std::max (1u, y1 - y0));
+	for (unsigned int y = y0; y <= y1; y++)
+		for (unsigned int x = x0; x <= x1; x++) {
+			size_t pixel = y * width + x;
+			if (traced[pixel])
+				continue;
+			float u = float (x - x0) * sx, v = float (y - y0) * sy;
+			float weights[4] = { (1.f - u) * (1.f - v), u * (1.f - v), (1.f - u) * v, u * v };
+			glm::vec3 color (0.f);
+			SurfaceFeatures features = m_passFeatures[corners[0]]; // Same mesh and triangle at all corners
+			features.albedo = features.normal = glm::vec3 (0.f);
+			features.depth = 0.f;
+			features.barycentrics = glm::vec2 (0.f);
+			for (size_t c = 0; c < 4; c++) {
+				const SurfaceFeatures & cornerFeatures = m_passFeatures[corners[c]];
+				color += weights[c] * m_passBuffer[corners[c]];
+				features.albedo += weights[c] * cornerFeatures.albedo;
+				features.normal += weights[c] * cornerFeatures.normal;
+				features.depth += weights[c] * cornerFeatures.depth;
+				features.barycentrics += weights[c] * cornerFeatures.barycentrics;
+			}
+			if (features.mesh >= 0)
+				features.normal = normalize (features.normal);
+			m_passBuffer[pixel] = color;
+			m_passFeatures[pixel] = features;
+		}
+}
 
-	glm::mat4 modelMatrix = mesh->computeTransformMatrix ();
-	glm::mat4 viewMatrix = scenePtr->camera()->computeViewMatrix ();
-	glm::mat4 modelViewMatrix = viewMatrix * modelMatrix;
+float RayTracer::tileError (size_t tile) const {
+	size_t width = m_imagePtr->width();
+	size_t height = m_imagePtr->height();
+	size_t x0 = (tile % m_numOfTilesX) * TILE_SIZE;
+	size_t y0 = (tile / m_numOfTilesX) * TILE_SIZE;
+	double sumSq = 0.0;
+	size_t numOfTilePixels = 0;
+	for (size_t y = y0; y < std::min (height, y0 + TILE_SIZE); y++)
+		for (size_t x = x0; x < std::min (width, x0 + TILE_SIZE); x++) {
+			size_t pixel = y * width + x;
+			float n = float (m_sampleCounts[pixel]);
+			if (n < 2.f)
+				return std::numeric_limits<float>::max ();
+			float mean = luminance (m_accumulation[pixel]) / n;
+			float variance = std::max (0.f, (m_luminanceSq[pixel] / n - mean * mean) * n / (n - 1.f));
+			// Squared standard error of the mean, relative to the square root of the intensity (perceptual weighting)
+			sumSq += variance / (n * (mean + 1e-3f));
+			numOfTilePixels++;
+		}
+	return numOfTilePixels > 0 ? float (std::sqrt (sumSq / numOfTilePixels)) : 0.f;
+}
 
-	glm::vec3 hitPoint = glm::vec3 (modelViewMatrix * glm::vec4 (hit.getHitPoint(), 1.0));
-	glm::vec3 unormalizedHitNormal = barycentricInterpolation(N[triangle[0]], N[triangle[1]], N[triangle[2]], w, hit.u, hit.v);
-	glm::mat4 normalMatrix = glm::transpose (glm::inverse (modelViewMatrix));
-	glm::vec3 hitNormal = normalize (glm::vec3 (normalMatrix * glm::vec4 (normalize (unormalizedHitNormal), 1.0)));
+void RayTracer::updateActiveTiles () {
+	std::vector<unsigned char> converged (m_activeTiles.size (), 0);
+	#pragma omp parallel for schedule(dynamic)
+	for (long long t = 0; t < (long long)m_activeTiles.size(); t++)
+		converged[t] = (tileError (m_activeTiles[t]) < m_adaptiveThreshold);
+	size_t numOfActiveTiles = 0;
+	for (size_t t = 0; t < m_activeTiles.size (); t++)
+		if (!converged[t])
+			m_activeTiles[numOfActiveTiles++] = m_activeTiles[t];
+	if (numOfActiveTiles == m_activeTiles.size ())
+		return;
+	m_activeTiles.resize (numOfActiveTiles);
+	collectActivePixels ();
+}
 
-	glm::vec3 wo = normalize(-ray.direction);
-	glm::vec3 colorResponse (0.f, 0.f, 0.f);
+void RayTracer::collectActivePixels () {
+	size_t width = m_imagePtr->width();
+	size_t height = m_imagePtr->height();
+	m_activePixels.clear ();
+	for (unsigned int tile : m_activeTiles) {
+		size_t x0 = (tile % m_numOfTilesX) * TILE_SIZE;
+		size_t y0 = (tile / m_numOfTilesX) * TILE_SIZE;
+		for (size_t y = y0; y < std::min (height, y0 + TILE_SIZE); y++)
+			for (size_t x = x0; x < std::min (width, x0 + TILE_SIZE); x++)
+				if (m_sampleCounts[y * width + x] < m_maxSampleCount)
+					m_activePixels.push_back (static_cast<unsigned int> (y * width + x));
+	}
+}
 
-	for (size_t i = 0; i < scenePtr->lightSources().size(); ++i) {
-		LightSource light = scenePtr->lightSource(i);
-		glm::vec3 lightPosition = glm::vec3(viewMatrix * glm::vec4(light.getTranslation(), 1.0));
-		glm::vec3 wi = normalize(lightPosition - hitPoint);
-		glm::vec3 li = attenuation (light, lightPosition, hitPoint);
-		glm::vec3 fd = diffuseBRDF(mesh->material());
-		glm::vec3 fs = microfacetBRDF (mesh->material(), hitNormal, wo, wi);
-		glm::vec3 fr = fd+fs;
-
-		float wiDotN = max(0.f, dot(wi, hitNormal));
-		if (wiDotN <= 0.f)
+bool RayTracer::traceCenterFeatures (const std::shared_ptr<Scene> scenePtr) {
+	size_t width = m_imagePtr->width();
+	size_t height = m_imagePtr->height();
+	const CameraFrame frame = scenePtr->camera()->computeFrame();
+	m_centerFeatures.resize (width * height);
+	#pragma omp parallel for schedule(dynamic, TILE_SIZE)
+	for (long long pixel = 0; pixel < (long long)m_centerFeatures.size(); pixel++) {
+		if (m_cancelRequested)
 			continue;
+		size_t i = pixel % width;
+		size_t j = pixel / width;
+		Ray ray = frame.rayAt ((float(i) + 0.5f) / width, 1.f - (float(j) + 0.5f) / height);
+		Hit hit (ray.origin, ray.direction, std::numeric_limits<float>::infinity ());
+		SurfaceFeatures features;
+		if (m_bvhPtr->intersect (ray, hit))
+			features = surfaceFeatures (surfacePoint (m_shadingContext, hit), hit);
+		m_centerFeatures[pixel] = features;
+	}
+	return !m_cancelRequested;
+}
 
-		colorResponse += li * fr * wiDotN;
+size_t RayTracer::reproject (const std::shared_ptr<Scene> scenePtr) {
+	size_t width = m_imagePtr->width();
+	size_t height = m_imagePtr->height();
+	const CameraFrame frame = scenePtr->camera()->computeFrame();
+	const History & history = m_history;
+	size_t numOfReprojectedPixels = 0;
+	#pragma omp parallel for reduction(+:numOfReprojectedPixels)
+	for (long long pixel = 0; pixel < (long long)m_centerFeatures.size(); pixel++) {
+		const SurfaceFeatures & features = m_centerFeatures[pixel];
+		// The background is cheap to trace, and its radiance moves with the view direction
+		if (features.mesh < 0)
+			continue;
+		size_t i = pixel % width;
+		size_t j = pixel / width;
+		glm::vec3 p = frame.eye + features.depth * frame.directionAt ((float(i) + 0.5f) / width, 1.f - (float(j) + 0.5f) / height);
+		glm::vec2 xy;
+		if (!history.frame.project (p, xy))
+			continue;
+		// Bilinear blend of the previous pixels around the projection, among those which saw the same surface
+		float fx = xy.x * width - 0.5f;
+		float fy = (1.f - xy.y) * height - 0.5f;
+		float x0 = std::floor (fx), y0 = std::floor (fy);
+		float distance = glm::distance (history.frame.eye, p);
+		float totalWeight = 0.f, count = 0.f, luminanceSqMean = 0.f;
+		glm::vec3 mean (0.f);
+		SurfaceFeatures featureMean;
+		featureMean.albedo = glm::vec3 (0.f);
+		for (int corner = 0; corner < 4; corner++) {
+			float x = x0 + float (corner & 1), y = y0 + float (corner >> 1);
+			if (!(x >= 0.f && x < float (width) && y >= 0.f && y < float (height)))
+				continue;
+			size_t previous = size_t (y) * width + size_t (x);
+			const SurfaceFeatures & previousFeatures = history.centerFeatures[previous];
+			// Disocclusions show up as another surface behind the previous pixel, or a surface seen under another angle
+			if (previousFeatures.mesh != features.mesh || history.sampleCounts[previous] == 0
+				|| std::abs (previousFeatures.depth - distance) > REPROJECTION_DEPTH_TOLERANCE * distance
+				|| dot (previousFeatures.normal, features.normal) < REPROJECTION_NORMAL_TOLERANCE)
+				continue;
+			float weight = (1.f - std::abs (fx - x)) * (1.f - std::abs (fy - y));
+			float n = float (history.sampleCounts[previous]);
+			const SurfaceFeatures & sums = history.featureAccumulation[previous];
+			mean += (weight / n) * history.accumulation[previous];
+			luminanceSqMean += (weight / n) * history.luminanceSq[previous];
+			featureMean.albedo += (weight / n) * sums.albedo;
+			featureMean.normal += (weight / n) * sums.normal;
+			featureMean.depth += (weight / n) * sums.depth;
+			count += weight * n;
+			totalWeight += weight;
+		}
+		if (totalWeight < 1e-3f)
+			continue;
+		// Rescale the blended means to sums over the blended sample count
+		unsigned int numOfSamples = std::max (1u, static_cast<unsigned int> (count / totalWeight));
+		float scale = float (numOfSamples) / totalWeight;
+		m_accumulation[pixel] = scale * mean;
+		m_luminanceSq[pixel] = scale * luminanceSqMean;
+		m_sampleCounts[pixel] = numOfSamples;
+		m_featureAccumulation[pixel].albedo = scale * featureMean.albedo;
+		m_featureAccumulation[pixel].normal = scale * featureMean.normal;
+		m_featureAccumulation[pixel].depth = scale * featureMean.depth;
+		(*m_imagePtr)[pixel] = mean / totalWeight;
+		numOfReprojectedPixels++;
 	}
-	return colorResponse;
+	return numOfReprojectedPixels;
 }
 
+uint64_t RayTracer::shadingSignature () const {
+	uint64_t h = 14695981039346656037ull;
+	const ShadingContext & context = m_shadingContext;
+	for (size_t m = 0; m < context.meshes.size (); m++) {
+		glm::mat4 transform = context.meshes[m]->computeTransformMatrix ();
+		float textureScale = context.meshes[m]->material ().getTextureScale ();
+		hashBytes (h, &transform, sizeof (transform));
+		hashBytes (h, &context.materials[m], sizeof (MaterialTerms));
+		hashBytes (h, context.materialMaps[m].maps, sizeof (context.materialMaps[m].maps));
+		hashBytes (h, &textureScale, sizeof (textureScale));
+	}
+	for (const ShadingLight & light : context.lights)
+		hashBytes (h, &light, sizeof (ShadingLight));
+	hashBytes (h, &context.background, sizeof (context.background));
+	hashBytes (h, &context.environmentMap, sizeof (context.environmentMap));
+	uint32_t settings[] = { uint32_t (context.meshes.size ()), uint32_t (context.lights.size ()), m_numOfBounces, m_numOfLightSamples,
+							uint32_t (m_sampler.type ()), m_sampler.seed () };
+	hashBytes (h, settings, sizeof (settings));
+	return h;
+}
 
-glm::vec3 PerPixel (const std::shared_ptr<Scene> scenePtr, Ray ray) {
-	glm::mat4 viewMat = scenePtr->camera()->computeViewMatrix();
-	glm::vec3 cameraPosition = glm::vec3(viewMat[3]);
-	bool found = false;
-	bool target = false;
-	float minimun = std::numeric_limits<float>::infinity();
-	Hit lastHit = {glm::vec3(1.0), glm::vec3(1.0), minimun};
-
-	for(int m = 0; m < scenePtr->numOfMeshes(); m++){
-			const auto& positions = scenePtr->mesh(m)->vertexPositions();
-			const auto& indices = scenePtr->mesh(m)->triangleIndices();
-			glm::mat4 modelMatrix = scenePtr->mesh(m)->computeTransformMatrix ();
-			glm::mat4 normalMatrix = glm::transpose (glm::inverse (modelMatrix));
-			
-			for(int simp = 0; simp < indices.size(); simp++){
-				bool target = false;
-				Hit actualHit = {glm::vec3(1.0), glm::vec3(1.0), minimun};
-				target = rayTriangleIntersection(modelMatrix, ray, positions, indices[simp], actualHit);
-				
-				if(target && actualHit.t < minimun){
-					found = true;
-					minimun = actualHit.t;
-					actualHit.setMesh(m);
-					actualHit.setSimp(simp);
-					lastHit = actualHit;
-					//return (glm::vec3(1.0));
-				}
+uint64_t RayTracer::checkpointSignature (const Scene & scene) const {
+	uint64_t h = 14695981039346656037ull;
+	const ShadingContext & context = m_shadingContext;
+	for (size_t m = 0; m < context.meshes.size (); m++) {
+		const Mesh & mesh = *context.meshes[m];
+		glm::mat4 transform = mesh.computeTransformMatrix ();
+		float textureScale = mesh.material ().getTextureScale ();
+		hashBytes (h, &transform, sizeof (transform));
+		hashVector (h, mesh.vertexPositions ());
+		hashVector (h, mesh.vertexNormals ());
+		hashVector (h, mesh.triangleIndices ());
+		hashBytes (h, &context.materials[m], sizeof (MaterialTerms));
+		for (const Texture * texturePtr : context.materialMaps[m].maps)
+			hashString (h, texturePtr ? texturePtr->filename () : std::string ());
+		hashBytes (h, &textureScale, sizeof (textureScale));
+	}
+	for (const ShadingLight & light : context.lights)
+		hashBytes (h, &light, sizeof (ShadingLight));
+	hashBytes (h, &context.background, sizeof (context.background));
+	hashString (h, context.environmentMap ? context.environmentMap->filename () : std::string ());
+	CameraFrame frame = scene.camera ()->computeFrame ();
+	hashBytes (h, &frame, sizeof (frame));
+	uint32_t settings[] = { uint32_t (m_imagePtr->width ()), uint32_t (m_imagePtr->height ()), uint32_t (context.meshes.size ()),
+							uint32_t (context.lights.size ()), m_numOfSamples, m_numOfBounces, m_numOfLightSamples, uint32_t (m_sampler.type ()),
+							m_sampler.seed (), uint32_t (m_renderMode), m_adaptiveSampling, m_adaptiveSubdivision };
+	float thresholds[] = { m_adaptiveThreshold, m_subdivisionThreshold };
+	hashBytes (h, settings, sizeof (settings));
+	hashBytes (h, thresholds, sizeof (thresholds));
+	return h;
+}
 
-			}
+bool RayTracer::resume (uint64_t signature, size_t & sampleBudget, double & elapsedTime) {
+	RenderCheckpoint checkpoint;
+	size_t numOfPixels = m_imagePtr->width () * m_imagePtr->height ();
+	if (!std::filesystem::exists (m_checkpointFilename))
+		return false;
+	if (!checkpoint.load (m_checkpointFilename) || checkpoint.signature != signature
+		|| checkpoint.width != m_imagePtr->width () || checkpoint.height != m_imagePtr->height ()) {
+		Console::print ("Checkpoint " + m_checkpointFilename + " does not match the render, starting over");
+		return false;
 	}
+	m_numOfAccumulatedSamples = checkpoint.numOfAccumulatedSamples;
+	m_numOfTracedSamples = checkpoint.numOfTracedSamples;
+	m_numOfReprojectedPixels = checkpoint.numOfReprojectedPixels;
+	sampleBudget = checkpoint.sampleBudget;
+	elapsedTime = checkpoint.elapsedTime;
+	m_activeTiles = std::move (checkpoint.activeTiles);
+	m_accumulation = std::move (checkpoint.accumulation);
+	m_luminanceSq = std::move (checkpoint.luminanceSq);
+	m_sampleCounts = std::move (checkpoint.sampleCounts);
+	m_featureAccumulation = std::move (checkpoint.featureAccumulation);
+	m_centerFeatures = std::move (checkpoint.centerFeatures);
+	#pragma omp parallel for
+	for (long long i = 0; i < (long long)numOfPixels; i++)
+		if (m_sampleCounts[i] > 0)
+			(*m_imagePtr)[i] = m_accumulation[i] / float (m_sampleCounts[i]);
+	Console::print ("Resumed from checkpoint " + m_checkpointFilename + " after " + std::to_string (m_numOfAccumulatedSamples) + " pass(es)");
+	return true;
+}
 
-	if(found && lastHit.t > 0.0f){
-		//std::cout << lastHit.u << std::endl;
-		return shade(scenePtr, ray, lastHit);
+void RayTracer::checkpoint (uint64_t signature, size_t sampleBudget, double elapsedTime) {
+	auto checkpointPtr = std::make_shared<RenderCheckpoint> ();
+	checkpointPtr->signature = signature;
+	checkpointPtr->width = uint32_t (m_imagePtr->width ());
+	checkpointPtr->height = uint32_t (m_imagePtr->height ());
+	checkpointPtr->numOfAccumulatedSamples = m_numOfAccumulatedSamples;
+	checkpointPtr->numOfTracedSamples = m_numOfTracedSamples;
+	checkpointPtr->sampleBudget = sampleBudget;
+	checkpointPtr->numOfReprojectedPixels = m_numOfReprojectedPixels;
+	checkpointPtr->elapsedTime = elapsedTime;
+	checkpointPtr->activeTiles = m_activeTiles;
+	checkpointPtr->accumulation = m_accumulation;
+	checkpointPtr->luminanceSq = m_luminanceSq;
+	checkpointPtr->sampleCounts = m_sampleCounts;
+	checkpointPtr->featureAccumulation = m_featureAccumulation;
+	checkpointPtr->centerFeatures = m_centerFeatures;
+	if (!m_checkpointWriterPtr)
+		m_checkpointWriterPtr = std::make_shared<AsyncWriter> ();
+	std::string filename = m_checkpointFilename;
+	m_checkpointWriterPtr->submit ([checkpointPtr, filename] () {
+		if (checkpointPtr->save (filename))
+			return true;
+		Console::print ("Cannot write checkpoint " + filename);
+		return false;
+	});
+}
+
+void RayTracer::storeFeatures () {
+	Framebuffer & framebuffer = *m_framebufferPtr;
+	#pragma omp parallel for
+	for (long long i = 0; i < (long long)m_centerFeatures.size(); i++) {
+		const SurfaceFeatures & features = m_centerFeatures[i];
+		if (features.mesh < 0)
+			continue;
+		framebuffer (Framebuffer::Depth, i) = features.depth;
+		framebuffer (Framebuffer::NormalX, i) = features.normal.x;
+		framebuffer (Framebuffer::NormalY, i) = features.normal.y;
+		framebuffer (Framebuffer::NormalZ, i) = features.normal.z;
+		framebuffer (Framebuffer::AlbedoR, i) = features.albedo.r;
+		framebuffer (Framebuffer::AlbedoG, i) = features.albedo.g;
+		framebuffer (Framebuffer::AlbedoB, i) = features.albedo.b;
+		framebuffer (Framebuffer::MeshIndex, i) = float (features.mesh);
+		framebuffer (Framebuffer::TriangleIndex, i) = float (features.triangle);
+		framebuffer (Framebuffer::BarycentricU, i) = features.barycentrics.x;
+		framebuffer (Framebuffer::BarycentricV, i) = features.barycentrics.y;
 	}
+}
 
-	else{
-		return scenePtr->backgroundColor();
+void RayTracer::denoise () {
+	size_t width = m_imagePtr->width();
+	size_t height = m_imagePtr->height();
+	size_t numOfPixels = width * height;
+	std::vector<glm::vec3> color (numOfPixels), albedo (numOfPixels), normal (numOfPixels);
+	std::vector<float> variance (numOfPixels), depth (numOfPixels);
+	#pragma omp parallel for
+	for (long long i = 0; i < (long long)numOfPixels; i++) {
+		float n = float (std::max (1u, m_sampleCounts[i]));
+		const SurfaceFeatures & features = m_featureAccumulation[i];
+		color[i] = m_accumulation[i] / n;
+		albedo[i] = features.albedo / n;
+		normal[i] = features.normal / n;
+		depth[i] = features.depth / n;
+		// Variance of the mean, left to the denoiser's spatial estimate when there are too few samples
+		float mean = luminance (color[i]);
+		variance[i] = (n >= 4.f ? std::max (0.f, (m_luminanceSq[i] / n - mean * mean) / (n - 1.f)) : -1.f);
 	}
+	m_denoiser.denoise (width, height, color, variance, albedo, normal, depth, *m_imagePtr);
+}
 
+void RayTracer::publish () {
+	if (!m_displayImagePtr)
+		return;
+	{
+		std::shared_ptr<Image> backPtr = m_displayImagePtr->back (m_imagePtr->width (), m_imagePtr->height ());
+		std::copy (m_imagePtr->pixels ().begin (), m_imagePtr->pixels ().end (), &(*backPtr)[0]);
+	}
+	m_displayImagePtr->publish ();
 }
 
 void RayTracer::render (const std::shared_ptr<Scene> scenePtr) {
 	size_t width = m_imagePtr->width();
 	size_t height = m_imagePtr->height();
+	size_t numOfPixels = width * height;
 	std::chrono::high_resolution_clock clock;
-	Console::print ("Start ray tracing at " + std::to_string (width) + "x" + std::to_string (height) + " resolution...");
+	// Previews stick to one pass, and keep the AOVs of the last full render
+	unsigned int numOfSamples = m_preview ? 1 : m_numOfSamples;
+	bool adaptiveSampling = m_adaptiveSampling && !m_preview;
+	std::shared_ptr<Framebuffer> framebufferPtr = m_preview ? nullptr : m_framebufferPtr;
+	if (!m_preview)
+		Console::print ("Start " + std::string (renderModeName (m_renderMode)) + " ray tracing at " + std::to_string (width) + "x" + std::to_string (height) + " resolution, " + std::to_string (m_numOfBounces) + " bounce(s), " + std::to_string (m_numOfSamples) + (m_adaptiveSampling ? " adaptive" : "") + " sample(s) per pixel...");
 	std::chrono::time_point<std::chrono::high_resolution_clock> before = clock.now();
+	m_numOfAccumulatedSamples = 0;
+	m_numOfTracedSamples = 0;
 	m_imagePtr->clear (scenePtr->backgroundColor ());
+	if (m_bvhPtr->isEmpty ())
+		init (scenePtr);
+	// Materials, lights and transforms may have changed since the last render, and these are cheap to rebuild
+	m_shadingContext.build (*scenePtr);
+	const CameraFrame frame = scenePtr->camera ()->computeFrame ();
+	m_shadingContext.pixelSpreadAngle = frame.w * frame.windowSize.y / float (height);
+	uint64_t signature = shadingSignature ();
+	if (signature != m_lightBVHSignature) {
+		if (scenePtr->lightSources ().size () > m_numOfLightSamples)
+			m_lightBVHPtr->build (scenePtr->lightSources ());
+		else
+			m_lightBVHPtr->clear ();
+		m_lightBVHSignature = signature;
+	}
+	m_accumulation.assign (numOfPixels, glm::vec3 (0.f));
+	m_passBuffer.resize (numOfPixels);
+	m_passFeatures.resize (numOfPixels);
+	SurfaceFeatures zeroFeatures;
+	zeroFeatures.albedo = glm::vec3 (0.f);
+	m_featureAccumulation.assign (numOfPixels, zeroFeatures);
+	m_luminanceSq.assign (numOfPixels, 0.f);
+	m_sampleCounts.assign (numOfPixels, 0);
+	m_numOfTilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	m_numOfTilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+	m_activeTiles.resize (m_numOfTilesX * m_numOfTilesY);
+	for (size_t t = 0; t < m_activeTiles.size (); t++)
+		m_activeTiles[t] = static_cast<unsigned int> (t);
+	if (framebufferPtr)
+		framebufferPtr->resize (width, height);
+	unsigned int maxNumOfPasses = adaptiveSampling ? numOfSamples * ADAPTIVE_MAX_SAMPLE_RATIO : numOfSamples;
+	m_maxSampleCount = maxNumOfPasses;
+	// Start from the checkpoint of an interrupted run of the same render, or else from the previous full render if only
+	// the camera moved since
+	bool reprojection = m_temporalReprojection && !m_preview;
+	bool checkpointing = !m_checkpointFilename.empty () && !m_preview;
+	uint64_t resumeSignature = checkpointing ? checkpointSignature (*scenePtr) : 0;
+	size_t sampleBudget = numOfPixels * numOfSamples;
+	double resumedTime = 0.0;
+	m_centerFeatures.clear ();
+	m_numOfReprojectedPixels = 0;
+	bool resumed = checkpointing && resume (resumeSignature, sampleBudget, resumedTime);
+	if (resumed) {
+		before -= std::chrono::duration_cast<std::chrono::high_resolution_clock::duration> (std::chrono::duration<double> (resumedTime));
+		if (framebufferPtr && !m_centerFeatures.empty ())
+			storeFeatures ();
+		publish ();
+	} else if (reprojection && !m_history.empty () && m_history.width == width && m_history.height == height && m_history.signature == signature) {
+		if (traceCenterFeatures (scenePtr)) {
+			m_numOfReprojectedPixels = reproject (scenePtr);
+			if (framebufferPtr)
+				storeFeatures ();
+			publish ();
+		} else
+			m_centerFeatures.clear ();
+	}
+	collectActivePixels ();
+	bool subdivision = m_adaptiveSubdivision && maxNumOfPasses == 1 && m_numOfReprojectedPixels == 0 && width > 1 && height > 1;
+	// Reprojected samples count against the budget, which adaptive sampling otherwise spends on the noisiest tiles anyway
+	if (m_numOfReprojectedPixels > 0 && !resumed)
+		sampleBudget -= std::min (sampleBudget, std::accumulate (m_sampleCounts.begin (), m_sampleCounts.end (), size_t (0)));
 
-	glm::mat4 viewMat = scenePtr->camera()->computeViewMatrix();
-	// Camera Position in the world
-	glm::vec3 cameraPosition = glm::vec3(viewMat[3]);
-	bool aux = false;
 	// <---- Ray tracing code ---->
-	for(float j = 0; j < height; j++){
-		for(float i = 0; i < width; i++){
-			glm::vec3 color (0.f, 0.f, 0.f);
-			Ray ray = scenePtr->camera()->rayAt((float(i) + 0.5) / width, 1.f - (float(j) + 0.5) / height);
-			m_imagePtr->operator()(i, j) = PerPixel(scenePtr, ray);
+	double lastPassTime = 0.0;
+	std::chrono::time_point<std::chrono::high_resolution_clock> lastCheckpoint = clock.now();
+	while (m_numOfAccumulatedSamples < maxNumOfPasses && m_numOfTracedSamples < sampleBudget && !m_activePixels.empty () && !m_cancelRequested) {
+		std::chrono::time_point<std::chrono::high_resolution_clock> passStart = clock.now();
+		double elapsedTime = std::chrono::duration<double> (passStart - before).count();
+		if (m_timeBudget > 0.0 && m_numOfAccumulatedSamples > 0 && elapsedTime + lastPassTime > m_timeBudget)
+			break;
+		if (subdivision) {
+			// A single pass through the pixel centers, of all the pixels, most of them interpolated
+			m_numOfTracedSamples += renderSubdividedPass (scenePtr);
+			collectActivePixels ();
+			if (m_cancelRequested)
+				break;
+		} else {
+			if (!renderPass (scenePtr))
+				break;
+			m_numOfTracedSamples += m_activePixels.size ();
+		}
+		m_numOfAccumulatedSamples++;
+		#pragma omp parallel for
+		for (long long k = 0; k < (long long)m_activePixels.size(); k++) {
+			size_t i = m_activePixels[k];
+			const glm::vec3 & sample = m_passBuffer[i];
+			float l = luminance (sample);
+			m_accumulation[i] += sample;
+			const SurfaceFeatures & features = m_passFeatures[i];
+			m_featureAccumulation[i].albedo += features.albedo;
+			m_featureAccumulation[i].normal += features.normal;
+			m_featureAccumulation[i].depth += features.depth;
+			m_luminanceSq[i] += l * l;
+			m_sampleCounts[i]++;
+			(*m_imagePtr)[i] = m_accumulation[i] / float (m_sampleCounts[i]);
+		}
+		// The first pass goes through the pixel centers of all the pixels, unless its hits were traced for the reprojection
+		if (m_numOfAccumulatedSamples == 1 && m_centerFeatures.empty () && (framebufferPtr || reprojection)) {
+			std::swap (m_centerFeatures, m_passFeatures);
+			m_passFeatures.resize (numOfPixels);
+			if (framebufferPtr)
+				storeFeatures ();
+		}
+		if (adaptiveSampling && m_numOfAccumulatedSamples >= ADAPTIVE_MIN_SAMPLES)
+			updateActiveTiles ();
+		// Reprojected pixels reach the sample count before the others
+		if (m_numOfReprojectedPixels > 0)
+			collectActivePixels ();
+		publish ();
+		lastPassTime = std::chrono::duration<double> (clock.now() - passStart).count();
+		// Skipped while the previous checkpoint is still being written, rather than stalling the passes
+		if (checkpointing && std::chrono::duration<double> (clock.now() - lastCheckpoint).count() >= m_checkpointInterval
+			&& !(m_checkpointWriterPtr && m_checkpointWriterPtr->busy ())) {
+			checkpoint (resumeSignature, sampleBudget, std::chrono::duration<double> (clock.now() - before).count());
+			lastCheckpoint = clock.now();
 		}
-		
 	}
-
+	// Cancelled renders leave a checkpoint of their completed passes, complete ones remove it
+	if (checkpointing) {
+		if (m_cancelRequested && m_numOfAccumulatedSamples > 0)
+			checkpoint (resumeSignature, sampleBudget, std::chrono::duration<double> (clock.now() - before).count());
+		if (m_checkpointWriterPtr)
+			m_checkpointWriterPtr->flush ();
+		if (!m_cancelRequested) {
+			std::error_code error;
+			std::filesystem::remove (m_checkpointFilename, error);
+		}
+	}
+	if (m_denoising && !m_preview && (m_numOfAccumulatedSamples > 0 || m_numOfReprojectedPixels > 0)) {
+		denoise ();
+		publish ();
+	}
+	if (framebufferPtr) {
+		#pragma omp parallel for
+		for (long long i = 0; i < (long long)numOfPixels; i++)
+			framebufferPtr->setColor (i, (*m_imagePtr)[i]);
+	}
+	// Renders cancelled before their first pass completed keep the previous history, which still matches its camera
+	if (reprojection && m_centerFeatures.size () == numOfPixels) {
+		m_history.width = width;
+		m_history.height = height;
+		m_history.frame = scenePtr->camera ()->computeFrame ();
+		m_history.signature = signature;
+		m_history.accumulation = m_accumulation;
+		m_history.luminanceSq = m_luminanceSq;
+		m_history.sampleCounts = m_sampleCounts;
+		m_history.featureAccumulation = m_featureAccumulation;
+		std::swap (m_history.centerFeatures, m_centerFeatures);
+	}
 
 	std::chrono::time_point<std::chrono::high_resolution_clock> after = clock.now();
 	double elapsedTime = (double)std::chrono::duration_cast<std::chrono::milliseconds>(after - before).count();
-	Console::print ("Ray tracing executed in " + std::to_string(elapsedTime) + "ms");
+	double raysPerSecond = (elapsedTime > 0.0 ? 1e3 * m_numOfTracedSamples / elapsedTime : 0.0);
+	double samplesPerPixel = double (m_numOfTracedSamples) / std::max (size_t (1), numOfPixels);
+	std::string adaptiveInfo = adaptiveSampling ? ", " + std::to_string (m_activeTiles.size ()) + "/" + std::to_string (m_numOfTilesX * m_numOfTilesY) + " tiles still active" : "";
+	std::string reprojectionInfo = m_numOfReprojectedPixels > 0 ? ", " + std::to_string (100 * m_numOfReprojectedPixels / std::max (size_t (1), numOfPixels)) + "% of the pixels reprojected" : "";
+	if (!m_preview)
+		Console::print ("Ray tracing executed in " + std::to_string(elapsedTime) + "ms, " + std::to_string (samplesPerPixel) + " sample(s) per pixel on average" + adaptiveInfo + reprojectionInfo + (m_cancelRequested ? " (cancelled)" : "") + " (" + std::to_string (raysPerSecond * 1e-6) + " M primary rays/s)");
 }
\ No newline at end of file
@@ -14,15 +14,38 @@
 #include <limits>
 #include <memory>
 #include <chrono>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <string>
 
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
 #include "Image.h"
 #include "Scene.h"
+#include "BVH.h"
+#include "LightBVH.h"
+#include "Sampler.h"
+#include "Shading.h"
+#include "Denoiser.h"
+#include "Framebuffer.h"
+#include "Wavefront.h"
+#include "VisibilityBuffer.h"
+#include "RenderCheckpoint.h"
+#include "AsyncWriter.h"
 
 using namespace std;
-const float PI = 3.1415926535897932384626433832795;
+
+/// Execution strategy of the ray tracer.
+enum class RenderMode {
+	Megakernel, ///< Each pixel follows its path to completion, all stages inlined
+	Wavefront, ///< Stage by stage processing of large ray batches, see Wavefront
+	VisibilityBuffer ///< Primary hits of all pixels first, then shading grouped by mesh, see VisibilityBuffer
+};
+
+/// Display name of a render mode.
+const char * renderModeName (RenderMode mode);
 
 class RayTracer {
 public:
@@ -33,9 +56,245 @@ public:
 	inline void setResolution (int width, int height) { m_imagePtr = make_shared<Image> (width, height); }
 	inline std::shared_ptr<Image> image () { return m_imagePtr; }
 
+	/// Scene wide acceleration structure build mode. Use BVHBuildMode::Spatial for final-quality renders.
+	inline BVHBuildMode bvhBuildMode () const { return m_bvhPtr->buildMode (); }
+	inline void setBVHBuildMode (BVHBuildMode mode) { m_bvhPtr->setBuildMode (mode); }
+	inline std::shared_ptr<BVH> bvh () { return m_bvhPtr; }
+
+	/// Trace the next renders through a hierarchy built elsewhere for the scene, e.g., shared by the renders of a
+	/// RenderServer, instead of building one with init. Shared hierarchies are not rebuilt: init builds a new one.
+	void setBVH (std::shared_ptr<BVH> bvhPtr);
+
+	/// Number of lights sampled per shading point through the light BVH. Scenes with at most this many lights
+	/// connect every shading point to all of them instead.
+	inline unsigned int numOfLightSamples () const { return m_numOfLightSamples; }
+	inline void setNumOfLightSamples (unsigned int n) { m_numOfLightSamples = glm::clamp (n, 1u, MAX_LIGHT_SAMPLES); }
+
+	/// Sample sequence of the integrators. Renders are deterministic for a given sampler type and seed.
+	inline SamplerType samplerType () const { return m_sampler.type (); }
+	inline void setSamplerType (SamplerType type) { m_sampler.setType (type); }
+	inline Sampler & sampler () { return m_sampler; }
+	inline const Sampler & sampler () const { return m_sampler; }
+
+	inline RenderMode renderMode () const { return m_renderMode; }
+	inline void setRenderMode (RenderMode mode) { m_renderMode = mode; }
+
+	/// Maximum number of indirect bounces of the path tracer after the primary hit. 0 for direct lighting only.
+	inline unsigned int numOfBounces () const { return m_numOfBounces; }
+	inline void setNumOfBounces (unsigned int n) { m_numOfBounces = n; }
+
+	/// Target number of samples per pixel. render() stops after this many progressive passes.
+	inline unsigned int numOfSamples () const { return m_numOfSamples; }
+	inline void setNumOfSamples (unsigned int n) { m_numOfSamples = std::max (1u, n); }
+
+	/// Render time budget in seconds, 0 for none. No new pass is started if it would exceed the budget,
+	/// but the first pass always completes unless cancelled.
+	inline double timeBudget () const { return m_timeBudget; }
+	inline void setTimeBudget (double seconds) { m_timeBudget = std::max (0.0, seconds); }
+
+	/// Variance driven adaptive sampling. Once every pixel has a few samples, the image tiles whose estimated
+	/// relative error is below the threshold are retired from the following passes, and the sample budget
+	/// (numOfSamples per pixel on average) is spent on the remaining noisy tiles instead.
+	inline bool adaptiveSampling () const { return m_adaptiveSampling; }
+	inline void setAdaptiveSampling (bool adaptive) { m_adaptiveSampling = adaptive; }
+	inline float adaptiveThreshold () const { return m_adaptiveThreshold; }
+	inline void setAdaptiveThreshold (float threshold) { m_adaptiveThreshold = threshold; }
+
+	/// Adaptive subdivision of the primary rays, for renders tracing a single pass through the pixel centers, i.e.,
+	/// previews and renders at one sample per pixel. A coarse lattice of pixels is traced first, then each block of the
+	/// lattice is either interpolated from its corners, if they hit the same mesh triangle (or all miss) and their colors
+	/// differ by less than the threshold, relative to their luminance, or split in four and refined likewise. Flat regions
+	/// and the background cost a fraction of their pixels, at the price of missing details smaller than a block.
+	inline bool adaptiveSubdivision () const { return m_adaptiveSubdivision; }
+	inline void setAdaptiveSubdivision (bool subdivision) { m_adaptiveSubdivision = subdivision; }
+	inline float subdivisionThreshold () const { return m_subdivisionThreshold; }
+	inline void setSubdivisionThreshold (float threshold) { m_subdivisionThreshold = threshold; }
+
+	/// Edge-aware filtering of the final image, guided by the albedo, normal and depth of the primary hits.
+	/// The noisy mean is replaced in the image once the last pass has completed.
+	inline bool denoising () const { return m_denoising; }
+	inline void setDenoising (bool denoising) { m_denoising = denoising; }
+	inline Denoiser & denoiser () { return m_denoiser; }
+
+	/// Optional AOV framebuffer, resized and filled by render() along with the image: the final color, and the
+	/// features of the primary hits through the pixel centers (first pass), so that indices are not blended.
+	inline std::shared_ptr<Framebuffer> framebuffer () { return m_framebufferPtr; }
+	inline void setFramebuffer (std::shared_ptr<Framebuffer> framebufferPtr) { m_framebufferPtr = framebufferPtr; }
+
+	/// Preview renders trace a single pass through the pixel centers, without adaptive sampling nor denoising, and leave
+	/// the AOV framebuffer untouched, for interactive navigation.
+	inline bool preview () const { return m_preview; }
+	inline void setPreview (bool preview) { m_preview = preview; }
+
+	/// Optional image shared with another thread, e.g., the display, to which render() publishes the running mean after
+	/// every pass, and the final image.
+	inline std::shared_ptr<DoubleBufferedImage> displayImage () { return m_displayImagePtr; }
+	inline void setDisplayImage (std::shared_ptr<DoubleBufferedImage> imagePtr) { m_displayImagePtr = imagePtr; }
+
+	/// Temporal reprojection: a render starts from the samples of the previous full render, if the scene only differs by
+	/// its camera. The primary hits through the pixel centers are projected into the previous view, and inherit a bilinear
+	/// blend of the accumulated samples of the previous pixels whose hits match in mesh, depth and normal, the others
+	/// being disoccluded. The blend softens the image by a fraction of a pixel at each reprojection. Only the pixels below
+	/// the target sample count are traced further, so converged pixels survive small camera moves. View dependent shading, e.g.,
+	/// glossy highlights, lags behind until the pixels are disoccluded. Previews neither use nor replace the history.
+	inline bool temporalReprojection () const { return m_temporalReprojection; }
+	inline void setTemporalReprojection (bool reprojection) { m_temporalReprojection = reprojection; if (!reprojection) m_history.clear (); }
+
+	/// Number of pixels whose samples were reprojected from the previous render by the last render.
+	inline size_t numOfReprojectedPixels () const { return m_numOfReprojectedPixels; }
+
+	/// Checkpointing of long renders to the file, none if empty. Every checkpointInterval seconds, a copy of the progressive
+	/// state is saved by a writer thread while the passes go on, and once more when the render is cancelled. A render whose
+	/// scene, camera, resolution and settings match the file resumes from it, to the image of an uninterrupted render,
+	/// and removes it once complete. Previews neither read nor write checkpoints.
+	inline const std::string & checkpointFilename () const { return m_checkpointFilename; }
+	inline void setCheckpointFilename (const std::string & filename) { m_checkpointFilename = filename; }
+	inline double checkpointInterval () const { return m_checkpointInterval; }
+	inline void setCheckpointInterval (double seconds) { m_checkpointInterval = std::max (0.0, seconds); }
+
+	/// Interrupt the render in flight, or the next one if called before it starts checking for cancellation. Safe to
+	/// call from any thread. The image keeps the mean of the completed passes. The request holds until resetCancel.
+	inline void cancel () { m_cancelRequested = true; }
+
+	/// Withdraw a pending cancellation, e.g., one which arrived after the last render. Called by the owner of the render
+	/// before starting it, where no cancellation may come in between.
+	inline void resetCancel () { m_cancelRequested = false; }
+
+	/// Number of passes accumulated in the image by the last render, i.e., the maximum number of samples traced per pixel.
+	inline unsigned int numOfAccumulatedSamples () const { return m_numOfAccumulatedSamples; }
+
+	/// Total number of samples traced by the last render, over all pixels.
+	inline size_t numOfTracedSamples () const { return m_numOfTracedSamples; }
+
 	void init (const std::shared_ptr<Scene> scenePtr);
+
+	/// Progressive rendering. Each pass traces one sample per active pixel, jittered by the sampler except for the
+	/// first one which goes through the pixel centers. The running mean is published to the image after every pass,
+	/// until the sample count, the time budget or a cancel request stops the render.
 	void render (const std::shared_ptr<Scene> scenePtr);
 
 private:
+	/// Trace one sample per active pixel into m_passBuffer. Returns false if the pass was cancelled before completion.
+	/// The sample index of a pixel is its sample count, so that the samples inherited by reprojection are not redrawn.
+	bool renderPass (const std::shared_ptr<Scene> scenePtr);
+
+	/// Same as renderPass, in two phases through the visibility buffer: trace the primary rays of all the active
+	/// pixels, then shade them mesh by mesh.
+	bool renderVisibilityPass (const std::shared_ptr<Scene> scenePtr);
+
+	/// Same as renderPass, through the pixel centers of all the pixels, tracing only those selected by adaptive
+	/// subdivision and interpolating the others. Returns the number of traced samples; check m_cancelRequested.
+	size_t renderSubdividedPass (const std::shared_ptr<Scene> scenePtr);
+
+	/// Bilinear interpolation of the samples of the corners of the block [x0, x1] x [y0, y1] in m_passBuffer and
+	/// m_passFeatures, for its pixels which are not traced.
+	void interpolateBlock (unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, const std::vector<unsigned char> & traced);
+
+	/// Retire the tiles whose error estimate has converged and rebuild the list of active pixels.
+	void updateActiveTiles ();
+
+	/// List the pixels of the active tiles, tile by tile for coherence.
+	void collectActivePixels ();
+
+	/// Relative error estimate of the running mean of a tile, from the per pixel luminance variance.
+	float tileError (size_t tile) const;
+
+	/// Trace the primary rays through the pixel centers, without shading, into m_centerFeatures. Returns false if cancelled.
+	bool traceCenterFeatures (const std::shared_ptr<Scene> scenePtr);
+
+	/// Seed the accumulation of the pixels whose center hit projects next to matching hits of the history, seen from the
+	/// previous camera. Returns the number of reprojected pixels.
+	size_t reproject (const std::shared_ptr<Scene> scenePtr);
+
+	/// Hash of the shading context and the integrator settings: everything a render depends on, but the camera and the
+	/// geometry (whose edits call init).
+	uint64_t shadingSignature () const;
+
+	/// Hash of everything the samples of a render depend on, stable across processes unlike shadingSignature: the
+	/// geometry, the camera, the resolution and the sampling settings, and the files of the maps rather than their addresses.
+	uint64_t checkpointSignature (const Scene & scene) const;
+
+	/// Restore the progressive state from the checkpoint file, if it has the signature. Returns false otherwise.
+	bool resume (uint64_t signature, size_t & sampleBudget, double & elapsedTime);
+
+	/// Submit a copy of the progressive state to the checkpoint writer.
+	void checkpoint (uint64_t signature, size_t sampleBudget, double elapsedTime);
+
+	/// Store the primary hit features through the pixel centers in the AOVs of the framebuffer.
+	void storeFeatures ();
+
+	/// Filter the accumulated image with the denoiser, from the averaged features of the completed passes.
+	void denoise ();
+
+	/// Copy the image to the back buffer of the display image, if any, and swap.
+	void publish ();
+
 	std::shared_ptr<Image> m_imagePtr;
+	std::shared_ptr<BVH> m_bvhPtr;
+	std::shared_ptr<LightBVH> m_lightBVHPtr;
+	uint64_t m_lightBVHSignature = 0; // Shading signature the light BVH was built for, e.g., reused along camera paths
+	std::shared_ptr<Wavefront> m_wavefrontPtr;
+	std::shared_ptr<Framebuffer> m_framebufferPtr;
+	std::shared_ptr<DoubleBufferedImage> m_displayImagePtr;
+	VisibilityBuffer m_visibilityBuffer; // Primary hits of the active pixels, in the order of m_activePixels
+	RenderMode m_renderMode = RenderMode::Megakernel;
+	Sampler m_sampler;
+	ShadingContext m_shadingContext; // Per render shading invariants
+	unsigned int m_numOfBounces = 0;
+	unsigned int m_numOfLightSamples = 4;
+	bool m_preview = false;
+
+	// Progressive accumulation
+	unsigned int m_numOfSamples = 1;
+	double m_timeBudget = 0.0;
+	std::atomic<bool> m_cancelRequested {false};
+	unsigned int m_numOfAccumulatedSamples = 0;
+	std::vector<glm::vec3> m_accumulation; // Per pixel sum of the completed passes
+	std::vector<glm::vec3> m_passBuffer; // Samples of the pass in flight
+	std::vector<SurfaceFeatures> m_passFeatures;
+	std::vector<SurfaceFeatures> m_featureAccumulation; // Per pixel sum of the features of the completed passes
+	size_t m_numOfTracedSamples = 0;
+
+	// Adaptive sampling
+	bool m_adaptiveSampling = false;
+	float m_adaptiveThreshold = 0.01f;
+	size_t m_numOfTilesX = 0, m_numOfTilesY = 0;
+	std::vector<float> m_luminanceSq; // Per pixel sum of the squared sample luminances
+	std::vector<unsigned int> m_sampleCounts;
+	std::vector<unsigned int> m_activeTiles;
+	std::vector<unsigned int> m_activePixels; // Pixels of the active tiles, tile by tile
+
+	// Adaptive subdivision
+	bool m_adaptiveSubdivision = false;
+	float m_subdivisionThreshold = 0.05f;
+
+	// Denoising
+	bool m_denoising = false;
+	Denoiser m_denoiser;
+
+	// Temporal reprojection
+	/// Accumulation of the last full render, with its primary hits through the pixel centers and its camera.
+	struct History {
+		size_t width = 0, height = 0;
+		CameraFrame frame;
+		uint64_t signature = 0;
+		std::vector<glm::vec3> accumulation;
+		std::vector<float> luminanceSq;
+		std::vector<unsigned int> sampleCounts;
+		std::vector<SurfaceFeatures> featureAccumulation;
+		std::vector<SurfaceFeatures> centerFeatures;
+
+		inline bool empty () const { return centerFeatures.empty (); }
+		inline void clear () { centerFeatures.clear (); }
+	};
+	bool m_temporalReprojection = true;
+	History m_history;
+	std::vector<SurfaceFeatures> m_centerFeatures; // Primary hits through the pixel centers, once the first pass completed
+	unsigned int m_maxSampleCount = 0; // Pixels with this many samples are no longer active
+	size_t m_numOfReprojectedPixels = 0;
+
+	// Checkpointing
+	std::string m_checkpointFilename;
+	double m_checkpointInterval = 60.0;
+	std::shared_ptr<AsyncWriter> m_checkpointWriterPtr; // Created by the first checkpoint
 };
\ No newline at end of file
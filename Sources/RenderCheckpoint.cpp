@@ -0,0 +1,99 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "RenderCheckpoint.h"
+
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+
+namespace fs = std::filesystem;
+
+struct CheckpointFileHeader {
+	char magic[8];
+	uint64_t signature;
+	uint32_t width, height;
+	uint32_t numOfAccumulatedSamples;
+	uint32_t numOfActiveTiles;
+	uint64_t numOfTracedSamples;
+	uint64_t sampleBudget;
+	uint64_t numOfReprojectedPixels;
+	double elapsedTime;
+	uint32_t hasCenterFeatures;
+	uint32_t padding;
+};
+
+static const char CHECKPOINT_FILE_MAGIC[8] = {'I', 'N', 'F', '5', '8', '4', 'C', '1'};
+
+template<typename T>
+static inline void writeArray (std::ofstream & file, const std::vector<T> & values) {
+	file.write (reinterpret_cast<const char *> (values.data ()), std::streamsize (values.size () * sizeof (T)));
+}
+
+template<typename T>
+static inline bool readArray (std::ifstream & file, std::vector<T> & values, size_t size) {
+	values.resize (size);
+	return bool (file.read (reinterpret_cast<char *> (values.data ()), std::streamsize (size * sizeof (T))));
+}
+
+bool RenderCheckpoint::save (const std::string & filename) const {
+	CheckpointFileHeader header;
+	std::copy_n (CHECKPOINT_FILE_MAGIC, 8, header.magic);
+	header.signature = signature;
+	header.width = width;
+	header.height = height;
+	header.numOfAccumulatedSamples = numOfAccumulatedSamples;
+	header.numOfActiveTiles = uint32_t (activeTiles.size ());
+	header.numOfTracedSamples = numOfTracedSamples;
+	header.sampleBudget = sampleBudget;
+	header.numOfReprojectedPixels = numOfReprojectedPixels;
+	header.elapsedTime = elapsedTime;
+	header.hasCenterFeatures = centerFeatures.empty () ? 0 : 1;
+	header.padding = 0;
+	std::error_code error;
+	std::string temporaryFilename = filename + ".tmp";
+	std::ofstream file (temporaryFilename, std::ios::binary);
+	file.write (reinterpret_cast<const char *> (&header), sizeof (header));
+	writeArray (file, activeTiles);
+	writeArray (file, accumulation);
+	writeArray (file, luminanceSq);
+	writeArray (file, sampleCounts);
+	writeArray (file, featureAccumulation);
+	writeArray (file, centerFeatures);
+	file.close ();
+	if (file)
+		fs::rename (temporaryFilename, filename, error);
+	if (!file || error) {
+		fs::remove (temporaryFilename, error);
+		return false;
+	}
+	return true;
+}
+
+bool RenderCheckpoint::load (const std::string & filename) {
+	std::ifstream file (filename, std::ios::binary);
+	CheckpointFileHeader header;
+	if (!file.read (reinterpret_cast<char *> (&header), sizeof (header))
+		|| !std::equal (header.magic, header.magic + 8, CHECKPOINT_FILE_MAGIC))
+		return false;
+	signature = header.signature;
+	width = header.width;
+	height = header.height;
+	numOfAccumulatedSamples = header.numOfAccumulatedSamples;
+	numOfTracedSamples = header.numOfTracedSamples;
+	sampleBudget = header.sampleBudget;
+	numOfReprojectedPixels = header.numOfReprojectedPixels;
+	elapsedTime = header.elapsedTime;
+	size_t numOfPixels = size_t (width) * height;
+	return readArray (file, activeTiles, header.numOfActiveTiles)
+		&& readArray (file, accumulation, numOfPixels)
+		&& readArray (file, luminanceSq, numOfPixels)
+		&& readArray (file, sampleCounts, numOfPixels)
+		&& readArray (file, featureAccumulation, numOfPixels)
+		&& readArray (file, centerFeatures, header.hasCenterFeatures ? numOfPixels : 0);
+}
@@ -0,0 +1,44 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "Shading.h"
+
+/// Progressive state of a render, from which a restarted render resumes where the checkpoint left off: the per pixel
+/// sums and sample counts of the completed passes, and the tiles still active for adaptive sampling. The samplers are
+/// functions of the pixel, the sample index and the seed, so the number of completed passes is all their state. Stored
+/// as raw buffers in native byte order, behind the signature of everything the samples depend on (see RayTracer).
+struct RenderCheckpoint {
+	uint64_t signature = 0;
+	uint32_t width = 0, height = 0;
+	uint32_t numOfAccumulatedSamples = 0;
+	uint64_t numOfTracedSamples = 0;
+	uint64_t sampleBudget = 0;
+	uint64_t numOfReprojectedPixels = 0;
+	double elapsedTime = 0.0; // Seconds spent so far, so that time budgets span restarts
+	std::vector<unsigned int> activeTiles;
+	std::vector<glm::vec3> accumulation;
+	std::vector<float> luminanceSq;
+	std::vector<unsigned int> sampleCounts;
+	std::vector<SurfaceFeatures> featureAccumulation;
+	std::vector<SurfaceFeatures> centerFeatures; // Empty if the render did not keep them
+
+	/// Written next to its final name and renamed once complete, so that a killed process never leaves a partial
+	/// checkpoint. Returns false on failure.
+	bool save (const std::string & filename) const;
+
+	/// Returns false if the file is missing, or is not a complete checkpoint.
+	bool load (const std::string & filename);
+};
@@ -0,0 +1,265 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "RenderCoordinator.h"
+
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+
+#include "Console.h"
+
+RenderCoordinator::RenderCoordinator (const std::string & address) :
+	m_address (address),
+	m_listener (Socket::listen (address)) {
+	if (m_listener.valid ()) {
+		Console::print ("Render coordinator listening for workers at " + address);
+		m_acceptThread = std::thread (&RenderCoordinator::acceptWorkers, this);
+	} else
+		Console::print ("Render coordinator cannot listen at " + address);
+}
+
+RenderCoordinator::~RenderCoordinator () {
+	{
+		std::lock_guard<std::mutex> lock (m_mutex);
+		m_quit = true;
+		if (m_jobPtr)
+			m_jobPtr->cancelled = true;
+		// Workers busy with a tile cannot be interrupted: drop them. Idle ones are asked to quit by their thread.
+		for (auto & workerPtr : m_workers)
+			if (workerPtr->busy)
+				workerPtr->socket.shutdown ();
+	}
+	m_condition.notify_all ();
+	if (m_acceptThread.joinable ())
+		m_acceptThread.join ();
+	for (auto & workerPtr : m_workers)
+		workerPtr->thread.join ();
+}
+
+size_t RenderCoordinator::numOfWorkers () const {
+	std::lock_guard<std::mutex> lock (m_mutex);
+	size_t numOfWorkers = 0;
+	for (const auto & workerPtr : m_workers)
+		if (!workerPtr->statistics.lost)
+			numOfWorkers++;
+	return numOfWorkers;
+}
+
+void RenderCoordinator::acceptWorkers () {
+	for (;;) {
+		Socket socket = m_listener.accept (0.1);
+		std::lock_guard<std::mutex> lock (m_mutex);
+		if (m_quit)
+			return;
+		if (!socket.valid ())
+			continue;
+		auto workerPtr = std::make_shared<Worker> ();
+		workerPtr->id = ++m_numOfConnections;
+		workerPtr->socket = std::move (socket);
+		workerPtr->thread = std::thread (&RenderCoordinator::serve, this, workerPtr);
+		m_workers.push_back (workerPtr);
+		Console::print ("Render worker #" + std::to_string (workerPtr->id) + " connected");
+		m_condition.notify_all ();
+	}
+}
+
+void RenderCoordinator::serve (std::shared_ptr<Worker> workerPtr) {
+	Worker & worker = *workerPtr;
+	std::unique_lock<std::mutex> lock (m_mutex);
+	for (;;) {
+		m_condition.wait (lock, [this] () { return m_quit || (m_jobPtr && !m_jobPtr->cancelled && !m_jobPtr->tiles.empty ()); });
+		if (m_quit) {
+			lock.unlock ();
+			worker.socket.send ("quit");
+			return;
+		}
+		std::shared_ptr<Job> jobPtr = m_jobPtr;
+		ImageTile tile = jobPtr->tiles.front ();
+		jobPtr->tiles.pop_front ();
+		bool newJob = (worker.job != jobPtr->id);
+		worker.job = jobPtr->id;
+		worker.busy = true;
+		lock.unlock ();
+
+		// Exchange the tile, without holding the lock
+		auto start = std::chrono::steady_clock::now ();
+		std::ostringstream request;
+		request << "tile " << jobPtr->id << ' ' << tile.x << ' ' << tile.y << ' ' << tile.width << ' ' << tile.height;
+		std::string reply, error;
+		bool received = (!newJob || worker.socket.send (jobPtr->message))
+			&& worker.socket.send (request.str ())
+			&& worker.socket.wait (m_leaseTimeout)
+			&& worker.socket.receive (reply);
+		double seconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+		size_t headerSize = reply.find ('\n');
+		std::istringstream header (reply.substr (0, headerSize));
+		std::string keyword;
+		unsigned long job = 0;
+		ImageTile answered;
+		size_t numOfTracedSamples = 0;
+		double renderTime = 0.0;
+		header >> keyword;
+		if (received && keyword == "error")
+			std::getline (header, error);
+		else if (received) {
+			header >> job >> answered.x >> answered.y >> answered.width >> answered.height >> numOfTracedSamples >> renderTime;
+			size_t payloadSize = size_t (tile.width) * tile.height * sizeof (glm::vec3);
+			received = keyword == "tile" && !header.fail () && job == jobPtr->id && answered.x == tile.x && answered.y == tile.y
+				&& answered.width == tile.width && answered.height == tile.height
+				&& headerSize != std::string::npos && reply.size () - headerSize - 1 == payloadSize;
+		}
+
+		lock.lock ();
+		worker.busy = false;
+		if (received && !error.empty ()) {
+			// The worker is fine, the job is not: leasing its tiles again would only fail them on every worker
+			if (!jobPtr->cancelled && jobPtr->error.empty ())
+				jobPtr->error = "render worker #" + std::to_string (worker.id) + " failed," + error;
+			jobPtr->cancelled = true;
+			jobPtr->tiles.clear ();
+			m_condition.notify_all ();
+			continue;
+		}
+		if (!received) {
+			// Lease the tile again, first, so that the image completes in order
+			if (!jobPtr->cancelled)
+				jobPtr->tiles.push_front (tile);
+			worker.statistics.lost = true;
+			if (!m_quit)
+				Console::print ("Render worker #" + std::to_string (worker.id) + " lost, its tile is leased again");
+			lock.unlock ();
+			m_condition.notify_all ();
+			worker.socket.close ();
+			return;
+		}
+		// Under the lock, as the image may be copied for display meanwhile
+		Image & image = *jobPtr->imagePtr;
+		const glm::vec3 * pixels = reinterpret_cast<const glm::vec3 *> (reply.data () + headerSize + 1);
+		for (unsigned int y = 0; y < tile.height; y++)
+			std::memcpy (&image (tile.x, tile.y + y), pixels + size_t (y) * tile.width, tile.width * sizeof (glm::vec3));
+		jobPtr->numOfTilesLeft--;
+		worker.statistics.numOfTiles++;
+		worker.statistics.numOfPixels += size_t (tile.width) * tile.height;
+		worker.statistics.numOfTracedSamples += numOfTracedSamples;
+		worker.statistics.busyTime += seconds;
+		m_condition.notify_all ();
+	}
+}
+
+/// Copy the image to the display image and publish it.
+static void publish (const Image & image, DoubleBufferedImage & displayImage) {
+	{
+		std::shared_ptr<Image> backPtr = displayImage.back (image.width (), image.height ());
+		std::copy (image.pixels ().begin (), image.pixels ().end (), &(*backPtr)[0]);
+	}
+	displayImage.publish ();
+}
+
+std::shared_ptr<Image> RenderCoordinator::render (const SceneDescription & scene, const RenderSettings & settings, std::shared_ptr<DoubleBufferedImage> displayImagePtr) {
+	auto start = std::chrono::steady_clock::now ();
+	auto jobPtr = std::make_shared<Job> ();
+	jobPtr->imagePtr = std::make_shared<Image> (settings.width, settings.height);
+	for (size_t y = 0; y < settings.height; y += m_tileSize)
+		for (size_t x = 0; x < settings.width; x += m_tileSize) {
+			ImageTile tile;
+			tile.x = unsigned (x);
+			tile.y = unsigned (y);
+			tile.width = unsigned (std::min (size_t (m_tileSize), settings.width - x));
+			tile.height = unsigned (std::min (size_t (m_tileSize), settings.height - y));
+			jobPtr->tiles.push_back (tile);
+		}
+	size_t numOfTiles = jobPtr->tiles.size ();
+	jobPtr->numOfTilesLeft = numOfTiles;
+	Console::print ("Distributed ray tracing of " + std::to_string (jobPtr->tiles.size ()) + " tile(s) at "
+					+ std::to_string (settings.width) + "x" + std::to_string (settings.height) + " resolution");
+
+	std::unique_lock<std::mutex> lock (m_mutex);
+	jobPtr->id = ++m_numOfJobs;
+	jobPtr->message = "job " + std::to_string (jobPtr->id) + "\n" + settings.toString () + "\n" + scene.toString ();
+	// Workers lost during the previous render are reported by it only. Their threads no longer need the lock.
+	for (size_t i = 0; i < m_workers.size (); )
+		if (m_workers[i]->statistics.lost) {
+			m_workers[i]->thread.join ();
+			m_workers.erase (m_workers.begin () + i);
+		} else
+			m_workers[i++]->statistics = WorkerStatistics ();
+	m_jobPtr = jobPtr;
+	m_condition.notify_all ();
+	bool waiting = false;
+	auto published = std::chrono::steady_clock::now ();
+	size_t numOfPublishedTiles = 0;
+	while (jobPtr->numOfTilesLeft > 0 && jobPtr->error.empty () && !m_cancelRequested) {
+		m_condition.wait_for (lock, std::chrono::milliseconds (100));
+		bool connected = std::any_of (m_workers.begin (), m_workers.end (), [] (const std::shared_ptr<Worker> & workerPtr) { return !workerPtr->statistics.lost; });
+		if (!connected && !waiting)
+			Console::print ("Waiting for render workers to connect at " + m_address);
+		waiting = !connected;
+		size_t numOfReceivedTiles = numOfTiles - jobPtr->numOfTilesLeft;
+		if (displayImagePtr && numOfReceivedTiles != numOfPublishedTiles
+			&& std::chrono::duration<double> (std::chrono::steady_clock::now () - published).count () > 0.5) {
+			publish (*jobPtr->imagePtr, *displayImagePtr);
+			published = std::chrono::steady_clock::now ();
+			numOfPublishedTiles = numOfReceivedTiles;
+		}
+	}
+	bool cancelled = (jobPtr->numOfTilesLeft > 0);
+	jobPtr->cancelled = cancelled;
+	jobPtr->tiles.clear ();
+	if (displayImagePtr)
+		publish (*jobPtr->imagePtr, *displayImagePtr);
+	double seconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+	lock.unlock ();
+	if (!jobPtr->error.empty ())
+		Console::print ("Distributed ray tracing failed: " + jobPtr->error);
+	else
+		Console::print ("Distributed ray tracing executed in " + std::to_string (seconds * 1e3) + "ms" + (cancelled ? " (cancelled)" : ""));
+	printStatistics (seconds);
+	return jobPtr->imagePtr;
+}
+
+void RenderCoordinator::cancel () {
+	m_cancelRequested = true;
+	m_condition.notify_all ();
+}
+
+std::vector<WorkerStatistics> RenderCoordinator::statistics () const {
+	std::lock_guard<std::mutex> lock (m_mutex);
+	std::vector<WorkerStatistics> statistics;
+	for (const auto & workerPtr : m_workers)
+		if (workerPtr->statistics.numOfTiles > 0 || workerPtr->statistics.lost)
+			statistics.push_back (workerPtr->statistics);
+	return statistics;
+}
+
+void RenderCoordinator::printStatistics (double seconds) const {
+	std::lock_guard<std::mutex> lock (m_mutex);
+	size_t numOfPixels = 0;
+	double totalBusyTime = 0.0, maxBusyTime = 0.0;
+	size_t numOfActiveWorkers = 0;
+	for (const auto & workerPtr : m_workers) {
+		numOfPixels += workerPtr->statistics.numOfPixels;
+		totalBusyTime += workerPtr->statistics.busyTime;
+		maxBusyTime = std::max (maxBusyTime, workerPtr->statistics.busyTime);
+		if (workerPtr->statistics.numOfTiles > 0)
+			numOfActiveWorkers++;
+	}
+	for (const auto & workerPtr : m_workers) {
+		const WorkerStatistics & statistics = workerPtr->statistics;
+		if (statistics.numOfTiles == 0 && !statistics.lost)
+			continue;
+		double share = numOfPixels > 0 ? 100.0 * statistics.numOfPixels / numOfPixels : 0.0;
+		double utilization = seconds > 0.0 ? 100.0 * statistics.busyTime / seconds : 0.0;
+		Console::print ("  Worker #" + std::to_string (workerPtr->id) + ": " + std::to_string (statistics.numOfTiles) + " tile(s), "
+						+ std::to_string (share) + "% of the pixels, busy " + std::to_string (utilization) + "% of the time, "
+						+ std::to_string (statistics.numOfTracedSamples) + " sample(s)" + (statistics.lost ? " (lost)" : ""));
+	}
+	if (numOfActiveWorkers > 0 && totalBusyTime > 0.0)
+		Console::print ("  Load imbalance (max/mean busy time): " + std::to_string (maxBusyTime * numOfActiveWorkers / totalBusyTime));
+}
@@ -0,0 +1,113 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "Image.h"
+#include "Socket.h"
+#include "SceneDescription.h"
+#include "RenderSettings.h"
+#include "RenderWorker.h"
+
+/// Tiles and time spent by a worker on the last render of a RenderCoordinator.
+struct WorkerStatistics {
+	size_t numOfTiles = 0;
+	size_t numOfPixels = 0;
+	size_t numOfTracedSamples = 0;
+	double busyTime = 0.0; // Seconds between leasing tiles and receiving them
+	bool lost = false;
+};
+
+/// Distributes renders across worker processes (see RenderWorker), on this machine or others. Workers connect at any
+/// time and pull tiles one at a time, so that faster workers render more of them. The tile of a worker which is lost
+/// or does not answer within the lease timeout is leased again to another worker. A worker which cannot render the job,
+/// e.g., for lack of a mesh file, fails it, as the others would likely fail the same way.
+class RenderCoordinator {
+public:
+	/// Listen for workers at the address, see Socket.
+	RenderCoordinator (const std::string & address);
+	/// Asks the workers to quit.
+	virtual ~RenderCoordinator ();
+
+	inline bool listening () const { return m_listener.valid (); }
+	inline const std::string & address () const { return m_address; }
+
+	/// Number of connected workers.
+	size_t numOfWorkers () const;
+
+	inline unsigned int tileSize () const { return m_tileSize; }
+	inline void setTileSize (unsigned int tileSize) { m_tileSize = std::max (tileSize, 1u); }
+
+	/// Seconds a worker may spend on a tile before it is considered lost.
+	inline double leaseTimeout () const { return m_leaseTimeout; }
+	inline void setLeaseTimeout (double leaseTimeout) { m_leaseTimeout = leaseTimeout; }
+
+	/// Render the described scene with the settings, waiting for workers if there are none. The tiles received so far
+	/// are published to the display image, if any, every half second. Returns the image, which misses the tiles not
+	/// received yet if the render was cancelled or failed.
+	std::shared_ptr<Image> render (const SceneDescription & scene, const RenderSettings & settings, std::shared_ptr<DoubleBufferedImage> displayImagePtr = nullptr);
+
+	/// Stop the current render, or the next one if called before it starts. Thread safe. The request holds until
+	/// resetCancel.
+	void cancel ();
+
+	/// Withdraw a pending cancellation, before starting a render which it was not meant for.
+	inline void resetCancel () { m_cancelRequested = false; }
+
+	/// Statistics of the workers which took part in the last render.
+	std::vector<WorkerStatistics> statistics () const;
+
+private:
+	struct Job {
+		unsigned long id = 0;
+		std::string message;
+		std::shared_ptr<Image> imagePtr;
+		std::deque<ImageTile> tiles; // Not leased yet
+		size_t numOfTilesLeft = 0; // Not received yet
+		bool cancelled = false;
+		std::string error; // Reported by the worker which failed the job, if any
+	};
+
+	struct Worker {
+		size_t id = 0; // Order of connection, from 1
+		Socket socket;
+		std::thread thread;
+		unsigned long job = 0; // Last job sent
+		bool busy = false; // Waiting for a tile
+		WorkerStatistics statistics;
+	};
+
+	void acceptWorkers ();
+	void serve (std::shared_ptr<Worker> workerPtr);
+	/// Print the load balance of the last render.
+	void printStatistics (double seconds) const;
+
+	std::string m_address;
+	Socket m_listener;
+	unsigned int m_tileSize = 64;
+	double m_leaseTimeout = 600.0;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::vector<std::shared_ptr<Worker>> m_workers;
+	std::shared_ptr<Job> m_jobPtr;
+	unsigned long m_numOfJobs = 0;
+	size_t m_numOfConnections = 0;
+	bool m_quit = false;
+	std::atomic<bool> m_cancelRequested {false};
+	std::thread m_acceptThread;
+};
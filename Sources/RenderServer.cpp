@@ -0,0 +1,177 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "RenderServer.h"
+
+#include <sstream>
+#include <deque>
+#include <iterator>
+#include <algorithm>
+#include <exception>
+
+#include "Console.h"
+#include "SceneDescription.h"
+#include "RenderSettings.h"
+
+RenderServer::RenderServer (size_t cacheBudget) : m_sceneCache (cacheBudget) {}
+
+bool RenderServer::run (const std::string & address) {
+	Socket listener = Socket::listen (address);
+	if (!listener.valid ()) {
+		Console::print ("Render server cannot listen at " + address);
+		return false;
+	}
+	Console::print ("Render server listening at " + address);
+	std::vector<std::shared_ptr<Client>> clients;
+	size_t numOfConnections = 0;
+	while (!m_quit) {
+		Socket socket = listener.accept (0.1);
+		for (size_t i = 0; i < clients.size (); )
+			if (clients[i]->finished) {
+				clients[i]->thread.join ();
+				clients.erase (clients.begin () + i);
+			} else
+				i++;
+		if (!socket.valid ())
+			continue;
+		auto clientPtr = std::make_shared<Client> ();
+		clientPtr->id = ++numOfConnections;
+		clientPtr->socket = std::move (socket);
+		clientPtr->thread = std::thread (&RenderServer::serve, this, clientPtr);
+		clients.push_back (clientPtr);
+		Console::print ("Render client #" + std::to_string (clientPtr->id) + " connected");
+	}
+	for (auto & clientPtr : clients)
+		clientPtr->thread.join ();
+	Console::print ("Render server stopped");
+	return true;
+}
+
+/// Header line followed by the RGB floats of the image.
+static std::string imageMessage (const std::string & header, const Image & image) {
+	std::string message = header + "\n";
+	message.append (reinterpret_cast<const char *> (image.pixels ().data ()), image.pixels ().size () * sizeof (glm::vec3));
+	return message;
+}
+
+void RenderServer::serve (std::shared_ptr<Client> clientPtr) {
+	Client & client = *clientPtr;
+	std::string name = "Render client #" + std::to_string (client.id);
+	std::deque<std::shared_ptr<Job>> jobs; // The first one running once its thread is started
+	unsigned long publishedVersion = 0;
+	auto progressTime = std::chrono::steady_clock::now ();
+	bool connected = true;
+	while (connected && !m_quit) {
+		if (!jobs.empty () && !jobs.front ()->thread.joinable ()) {
+			Job & job = *jobs.front ();
+			job.displayImagePtr->front (publishedVersion);
+			progressTime = std::chrono::steady_clock::now ();
+			job.thread = std::thread (&RenderServer::render, this, std::ref (job));
+		}
+		// Messages are waited for a little, so that progress is sent and the end of the job noticed meanwhile
+		if (client.socket.wait (0.1)) {
+			std::string message;
+			if (!client.socket.receive (message)) {
+				connected = false;
+				break;
+			}
+			std::istringstream in (message);
+			std::string keyword;
+			unsigned long id = 0;
+			in >> keyword >> id;
+			if (keyword == "render") {
+				auto jobPtr = std::make_shared<Job> ();
+				jobPtr->id = id;
+				jobPtr->message = std::move (message);
+				jobPtr->rayTracerPtr = std::make_shared<RayTracer> ();
+				// Jobs are unrelated renders as far as the history is concerned, e.g., views of a scene by different clients
+				jobPtr->rayTracerPtr->setTemporalReprojection (false);
+				jobPtr->displayImagePtr = std::make_shared<DoubleBufferedImage> ();
+				jobPtr->rayTracerPtr->setDisplayImage (jobPtr->displayImagePtr);
+				jobs.push_back (jobPtr);
+			} else if (keyword == "cancel") {
+				auto it = std::find_if (jobs.begin (), jobs.end (), [id] (const std::shared_ptr<Job> & jobPtr) { return jobPtr->id == id; });
+				if (it != jobs.end () && (*it)->thread.joinable ())
+					(*it)->rayTracerPtr->cancel ();
+				else if (it != jobs.end ()) {
+					jobs.erase (it);
+					connected = client.socket.send ("error " + std::to_string (id) + " cancelled");
+				}
+			} else
+				connected = client.socket.send ("error " + std::to_string (id) + " unknown message " + keyword);
+		}
+		if (jobs.empty () || !jobs.front ()->thread.joinable ())
+			continue;
+		Job & job = *jobs.front ();
+		if (job.finished) {
+			job.thread.join ();
+			std::string header = (job.error.empty () ? "done " : "error ") + std::to_string (job.id) + " ";
+			if (job.error.empty ()) {
+				const RayTracer & rayTracer = *job.rayTracerPtr;
+				connected = client.socket.send (imageMessage (header + std::to_string (rayTracer.numOfAccumulatedSamples ()) + " "
+															  + std::to_string (rayTracer.numOfTracedSamples ()) + " " + std::to_string (job.seconds),
+															  *job.rayTracerPtr->image ()));
+				Console::print (name + ", job " + std::to_string (job.id) + ": scene ready in " + std::to_string (int (1e3 * job.setupTime))
+								+ "ms, done in " + std::to_string (int (1e3 * job.seconds)) + "ms. Scene cache: "
+								+ std::to_string (m_sceneCache.numOfEntries ()) + " entries, " + std::to_string (m_sceneCache.memoryUsage () >> 20) + "MB, "
+								+ std::to_string (m_sceneCache.numOfHits ()) + " hit(s), " + std::to_string (m_sceneCache.numOfMisses ()) + " miss(es)");
+			} else {
+				connected = client.socket.send (header + job.error);
+				Console::print (name + ", job " + std::to_string (job.id) + " failed: " + job.error);
+			}
+			jobs.pop_front ();
+		} else if (std::chrono::duration<double> (std::chrono::steady_clock::now () - progressTime).count () >= m_progressInterval) {
+			unsigned long version;
+			std::shared_ptr<const Image> imagePtr = job.displayImagePtr->front (version);
+			if (version != publishedVersion) {
+				connected = client.socket.send (imageMessage ("progress " + std::to_string (job.id), *imagePtr));
+				publishedVersion = version;
+				progressTime = std::chrono::steady_clock::now ();
+			}
+		}
+	}
+	// Queued jobs are dropped, the running one is cancelled
+	if (!jobs.empty () && jobs.front ()->thread.joinable ()) {
+		jobs.front ()->rayTracerPtr->cancel ();
+		jobs.front ()->thread.join ();
+	}
+	client.socket.close ();
+	Console::print (name + (connected ? " dropped" : " disconnected"));
+	client.finished = true;
+}
+
+void RenderServer::render (Job & job) {
+	auto start = std::chrono::steady_clock::now ();
+	std::istringstream in (job.message);
+	std::string header, settingsLine;
+	std::getline (in, header);
+	std::getline (in, settingsLine);
+	std::string sceneText ((std::istreambuf_iterator<char> (in)), std::istreambuf_iterator<char> ());
+	RenderSettings settings;
+	SceneDescription description;
+	if (!settings.fromString (settingsLine))
+		job.error = "malformed render settings";
+	else if (!description.fromString (sceneText))
+		job.error = "malformed scene description";
+	else {
+		try {
+			std::shared_ptr<Scene> scenePtr = description.build (m_textureCache, &m_sceneCache);
+			RayTracer & rayTracer = *job.rayTracerPtr;
+			settings.apply (rayTracer);
+			// Scenes without meshes get an empty hierarchy of their own
+			if (scenePtr->numOfMeshes () > 0)
+				rayTracer.setBVH (m_sceneCache.bvh (scenePtr, m_bvhBuildMode));
+			job.setupTime = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+			rayTracer.render (scenePtr);
+		} catch (std::exception & e) {
+			job.error = std::string ("cannot build the scene, ") + e.what ();
+		}
+	}
+	job.seconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+	job.finished = true;
+}
@@ -0,0 +1,83 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "Socket.h"
+#include "Texture.h"
+#include "SceneCache.h"
+#include "RayTracer.h"
+
+/// Long running renderer, serving clients which connect to its address (see Socket), e.g., local processes through
+/// "unix:<path>". Meshes and BVHs are kept in a SceneCache across jobs, and textures in a TextureCache, so that the
+/// jobs on a scene seen before start tracing at once. Each client has a thread of its own, and is served concurrently
+/// with the others, its jobs one after another in the order received, each by a ray tracer of its own. Messages are a header line,
+/// possibly followed by more lines or binary data, in the style of RenderWorker:
+///  - "render <id>", the render settings and the scene description: queue a job. Answered by "progress <id>" with the
+///    running mean, at most every progressInterval seconds, then by "done <id> <passes> <traced samples> <seconds>"
+///    with the final image, or by "error <id> <message>". Images are the RGB floats of the pixels (see Image).
+///  - "cancel <id>": stop the job, which answers done with the passes completed so far, or error if still queued.
+class RenderServer {
+public:
+	RenderServer (size_t cacheBudget = SceneCache::DEFAULT_MEMORY_BUDGET);
+	virtual ~RenderServer () {}
+
+	inline SceneCache & sceneCache () { return m_sceneCache; }
+
+	/// Build mode of the BVHs of the scenes.
+	inline BVHBuildMode bvhBuildMode () const { return m_bvhBuildMode; }
+	inline void setBVHBuildMode (BVHBuildMode mode) { m_bvhBuildMode = mode; }
+
+	/// Seconds between the progress messages of a job.
+	inline double progressInterval () const { return m_progressInterval; }
+	inline void setProgressInterval (double seconds) { m_progressInterval = seconds; }
+
+	/// Serve the clients connecting at the address until stop is called. Returns false if it cannot listen.
+	bool run (const std::string & address);
+
+	/// Make run return, once the jobs in flight are cancelled. Safe to call from any thread, or a signal handler.
+	inline void stop () { m_quit = true; }
+
+private:
+	struct Client {
+		size_t id = 0; // Order of connection, from 1
+		Socket socket;
+		std::thread thread;
+		std::atomic<bool> finished {false};
+	};
+
+	struct Job {
+		unsigned long id = 0;
+		std::string message;
+		std::shared_ptr<RayTracer> rayTracerPtr;
+		std::shared_ptr<DoubleBufferedImage> displayImagePtr; // Running mean, for the progress messages
+		std::thread thread; // Started once the previous jobs of the client are done
+		std::atomic<bool> finished {false};
+		std::string error; // Why the job failed, empty if it did not
+		double setupTime = 0.0; // Seconds before the first ray: scene and BVH
+		double seconds = 0.0;
+	};
+
+	void serve (std::shared_ptr<Client> clientPtr);
+
+	/// Build the scene of the job, through the caches, and render it. Run by the thread of the job.
+	void render (Job & job);
+
+	SceneCache m_sceneCache;
+	TextureCache m_textureCache;
+	BVHBuildMode m_bvhBuildMode = BVHBuildMode::Binned;
+	double m_progressInterval = 0.5;
+	std::atomic<bool> m_quit {false};
+};
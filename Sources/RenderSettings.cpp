@@ -0,0 +1,62 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "RenderSettings.h"
+
+#include <sstream>
+#include <limits>
+
+RenderSettings RenderSettings::capture (const RayTracer & rayTracer, size_t width, size_t height) {
+	RenderSettings settings;
+	settings.width = width;
+	settings.height = height;
+	settings.renderMode = rayTracer.renderMode ();
+	settings.numOfSamples = rayTracer.numOfSamples ();
+	settings.numOfBounces = rayTracer.numOfBounces ();
+	settings.numOfLightSamples = rayTracer.numOfLightSamples ();
+	settings.samplerType = rayTracer.samplerType ();
+	settings.seed = rayTracer.sampler ().seed ();
+	settings.adaptiveSampling = rayTracer.adaptiveSampling ();
+	settings.adaptiveThreshold = rayTracer.adaptiveThreshold ();
+	settings.denoising = rayTracer.denoising ();
+	return settings;
+}
+
+void RenderSettings::apply (RayTracer & rayTracer) const {
+	rayTracer.setResolution (int (width), int (height));
+	rayTracer.setRenderMode (renderMode);
+	rayTracer.setNumOfSamples (numOfSamples);
+	rayTracer.setNumOfBounces (numOfBounces);
+	rayTracer.setNumOfLightSamples (numOfLightSamples);
+	rayTracer.setSamplerType (samplerType);
+	rayTracer.sampler ().setSeed (seed);
+	rayTracer.setAdaptiveSampling (adaptiveSampling);
+	rayTracer.setAdaptiveThreshold (adaptiveThreshold);
+	rayTracer.setDenoising (denoising);
+}
+
+std::string RenderSettings::toString () const {
+	std::ostringstream out;
+	out.precision (std::numeric_limits<float>::max_digits10);
+	out << "settings " << width << ' ' << height << ' ' << int (renderMode) << ' ' << numOfSamples << ' ' << numOfBounces << ' '
+		<< numOfLightSamples << ' ' << int (samplerType) << ' ' << seed << ' ' << adaptiveSampling << ' ' << adaptiveThreshold << ' ' << denoising;
+	return out.str ();
+}
+
+bool RenderSettings::fromString (const std::string & text) {
+	std::istringstream in (text);
+	std::string keyword;
+	int mode, type;
+	in >> keyword >> width >> height >> mode >> numOfSamples >> numOfBounces >> numOfLightSamples >> type >> seed >> adaptiveSampling
+	   >> adaptiveThreshold >> denoising;
+	if (in.fail () || keyword != "settings")
+		return false;
+	renderMode = RenderMode (mode);
+	samplerType = SamplerType (type);
+	return true;
+}
@@ -0,0 +1,40 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include "RayTracer.h"
+
+/// Resolution and ray tracer settings of a render, so that another process can reproduce it. Written as text on
+/// one line.
+struct RenderSettings {
+	size_t width = 0, height = 0;
+	RenderMode renderMode = RenderMode::Megakernel;
+	unsigned int numOfSamples = 1;
+	unsigned int numOfBounces = 0;
+	unsigned int numOfLightSamples = 4;
+	SamplerType samplerType = SamplerType::Sobol;
+	uint32_t seed = 0;
+	bool adaptiveSampling = false;
+	float adaptiveThreshold = 0.01f;
+	bool denoising = false;
+
+	/// Settings of the ray tracer, at the given resolution.
+	static RenderSettings capture (const RayTracer & rayTracer, size_t width, size_t height);
+
+	/// Set the ray tracer to these settings, resolution included.
+	void apply (RayTracer & rayTracer) const;
+
+	std::string toString () const;
+
+	/// Returns false on a malformed line.
+	bool fromString (const std::string & text);
+};
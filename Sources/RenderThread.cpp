@@ -0,0 +1,111 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "RenderThread.h"
+
+#include "Console.h"
+#include "SceneDescription.h"
+#include "RenderSettings.h"
+
+RenderThread::RenderThread (std::shared_ptr<RayTracer> rayTracerPtr) :
+	m_rayTracerPtr (rayTracerPtr),
+	m_imagePtr (std::make_shared<DoubleBufferedImage> ()),
+	m_thread (&RenderThread::run, this) {
+	m_rayTracerPtr->setDisplayImage (m_imagePtr);
+}
+
+RenderThread::~RenderThread () {
+	{
+		std::lock_guard<std::mutex> lock (m_mutex);
+		m_quit = true;
+		m_pendingScenePtr.reset ();
+		cancelRender ();
+	}
+	m_condition.notify_all ();
+	m_thread.join ();
+}
+
+void RenderThread::request (const Scene & scene, size_t width, size_t height, bool preview) {
+	std::shared_ptr<Scene> snapshotPtr = scene.snapshot ();
+	{
+		std::lock_guard<std::mutex> lock (m_mutex);
+		m_pendingScenePtr = snapshotPtr;
+		m_pendingWidth = width;
+		m_pendingHeight = height;
+		m_pendingPreview = preview;
+		cancelRender ();
+	}
+	m_condition.notify_all ();
+}
+
+void RenderThread::cancel () {
+	std::unique_lock<std::mutex> lock (m_mutex);
+	m_pendingScenePtr.reset ();
+	cancelRender ();
+	m_condition.wait (lock, [this] () { return !m_rendering; });
+}
+
+bool RenderThread::busy () const {
+	std::lock_guard<std::mutex> lock (m_mutex);
+	return m_rendering || m_pendingScenePtr;
+}
+
+void RenderThread::setCoordinator (std::shared_ptr<RenderCoordinator> coordinatorPtr) {
+	cancel ();
+	std::lock_guard<std::mutex> lock (m_mutex);
+	m_coordinatorPtr = coordinatorPtr;
+}
+
+void RenderThread::cancelRender () {
+	if (!m_rendering)
+		return;
+	if (m_distributed)
+		m_coordinatorPtr->cancel ();
+	else
+		m_rayTracerPtr->cancel ();
+}
+
+void RenderThread::run () {
+	std::unique_lock<std::mutex> lock (m_mutex);
+	for (;;) {
+		m_condition.wait (lock, [this] () { return m_quit || m_pendingScenePtr; });
+		if (m_quit)
+			return;
+		std::shared_ptr<Scene> scenePtr = m_pendingScenePtr;
+		size_t width = m_pendingWidth, height = m_pendingHeight;
+		bool preview = m_pendingPreview;
+		m_pendingScenePtr.reset ();
+		std::shared_ptr<RenderCoordinator> coordinatorPtr = (preview ? nullptr : m_coordinatorPtr);
+		SceneDescription description;
+		if (coordinatorPtr && !description.describe (*scenePtr)) {
+			Console::print ("Scene not loaded from files, ray traced locally");
+			coordinatorPtr.reset ();
+		}
+		// Cancellations are forwarded to the renderer only from now on, so that any one left pending belongs to a
+		// render that is over. The renderer then honors them even before its first check.
+		if (coordinatorPtr)
+			coordinatorPtr->resetCancel ();
+		else
+			m_rayTracerPtr->resetCancel ();
+		m_rendering = true;
+		m_distributed = bool (coordinatorPtr);
+		lock.unlock ();
+		if (coordinatorPtr)
+			coordinatorPtr->render (description, RenderSettings::capture (*m_rayTracerPtr, width, height), m_imagePtr);
+		else {
+			m_rayTracerPtr->setResolution (int (width), int (height));
+			m_rayTracerPtr->setPreview (preview);
+			m_rayTracerPtr->render (scenePtr);
+		}
+		scenePtr.reset ();
+		lock.lock ();
+		m_rendering = false;
+		m_distributed = false;
+		m_condition.notify_all ();
+	}
+}
@@ -0,0 +1,68 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "Image.h"
+#include "Scene.h"
+#include "RayTracer.h"
+#include "RenderCoordinator.h"
+
+/// Runs the ray tracer on a thread of its own, which leads its own OpenMP thread pool, so that the thread of the
+/// window system never waits for a render. Each request renders a snapshot of the scene, taken when it is made, so
+/// that the scene may be edited meanwhile. The running mean is published after every pass to a double buffered image,
+/// for display. A new request cancels the render in flight; only the latest request is kept. With a coordinator,
+/// full renders are distributed to its workers, while previews are still traced locally.
+class RenderThread {
+public:
+	RenderThread (std::shared_ptr<RayTracer> rayTracerPtr);
+
+	/// Cancel the render in flight and join the thread.
+	virtual ~RenderThread ();
+
+	inline std::shared_ptr<DoubleBufferedImage> image () { return m_imagePtr; }
+
+	/// Render a snapshot of the scene at the given resolution, in the background, as a preview (see
+	/// RayTracer::setPreview) or with the settings of the ray tracer. Returns immediately.
+	void request (const Scene & scene, size_t width, size_t height, bool preview = false);
+
+	/// Cancel the render in flight and the pending request, if any, and wait for the thread to be idle, e.g., before
+	/// changing the settings of the ray tracer. Takes at most the time to notice the cancellation, a fraction of a pass.
+	void cancel ();
+
+	/// Whether a render is in flight or pending.
+	bool busy () const;
+
+	/// Distribute the full renders to the workers of the coordinator, or trace them locally if null. Cancels the render
+	/// in flight. Distributed renders are not denoised and leave the framebuffer of the ray tracer untouched.
+	void setCoordinator (std::shared_ptr<RenderCoordinator> coordinatorPtr);
+
+private:
+	void run ();
+
+	/// Cancel the render in flight, if any. Called with the lock held.
+	void cancelRender ();
+
+	std::shared_ptr<RayTracer> m_rayTracerPtr;
+	std::shared_ptr<RenderCoordinator> m_coordinatorPtr;
+	std::shared_ptr<DoubleBufferedImage> m_imagePtr;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_condition; // Signals a request to the thread, or the end of a render to the cancellers
+	std::shared_ptr<Scene> m_pendingScenePtr; // Latest request, not started yet
+	size_t m_pendingWidth = 0, m_pendingHeight = 0;
+	bool m_pendingPreview = false;
+	bool m_rendering = false;
+	bool m_distributed = false; // Whether the render in flight runs on the coordinator
+	bool m_quit = false;
+	std::thread m_thread; // Last, started once the state above is initialized
+};
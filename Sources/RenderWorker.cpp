@@ -0,0 +1,120 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "RenderWorker.h"
+
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <exception>
+
+#include "Console.h"
+#include "Socket.h"
+#include "SceneDescription.h"
+
+void renderTile (RayTracer & rayTracer, const std::shared_ptr<Scene> scenePtr, const RenderSettings & settings, const ImageTile & tile) {
+	float width = float (settings.width), height = float (settings.height);
+	// Normalized image coordinates have y pointing up
+	scenePtr->camera ()->setWindow (glm::vec2 (tile.x / width, 1.f - (tile.y + tile.height) / height),
+									glm::vec2 (tile.width / width, tile.height / height));
+	rayTracer.sampler ().setPixelOffset (glm::uvec2 (tile.x, tile.y));
+	rayTracer.setResolution (int (tile.width), int (tile.height));
+	rayTracer.render (scenePtr);
+}
+
+RenderWorker::RenderWorker () : m_rayTracerPtr (std::make_shared<RayTracer> ()) {
+	// Tiles are unrelated renders as far as the history is concerned
+	m_rayTracerPtr->setTemporalReprojection (false);
+}
+
+bool RenderWorker::startJob (const std::string & message) {
+	std::istringstream in (message);
+	std::string header, settingsLine;
+	std::getline (in, header);
+	std::getline (in, settingsLine);
+	std::istringstream headerIn (header);
+	std::string keyword;
+	headerIn >> keyword >> m_job;
+	m_error.clear ();
+	if (!m_settings.fromString (settingsLine)) {
+		m_error = "malformed render settings";
+		return false;
+	}
+	// Denoising tiles separately would show their seams
+	m_settings.denoising = false;
+	std::string sceneText (std::istreambuf_iterator<char> (in), {});
+	if (sceneText == m_sceneText && m_scenePtr)
+		return true;
+	m_scenePtr.reset ();
+	m_sceneText.clear ();
+	SceneDescription description;
+	if (!description.fromString (sceneText)) {
+		m_error = "malformed scene description";
+		return false;
+	}
+	try {
+		m_scenePtr = description.build (m_textureCache);
+	} catch (std::exception & e) {
+		m_error = std::string ("cannot build the scene, ") + e.what ();
+		return false;
+	}
+	m_rayTracerPtr->init (m_scenePtr);
+	m_sceneText = sceneText;
+	return true;
+}
+
+bool RenderWorker::run (const std::string & address, double connectTimeout) {
+	Socket socket = Socket::connect (address);
+	auto start = std::chrono::steady_clock::now ();
+	while (!socket.valid () && std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count () < connectTimeout) {
+		std::this_thread::sleep_for (std::chrono::milliseconds (200));
+		socket = Socket::connect (address);
+	}
+	if (!socket.valid ()) {
+		Console::print ("Cannot connect to the render coordinator at " + address);
+		return false;
+	}
+	Console::print ("Connected to the render coordinator at " + address);
+	std::string message;
+	while (socket.receive (message)) {
+		std::istringstream in (message);
+		std::string keyword;
+		in >> keyword;
+		if (keyword == "quit") {
+			Console::print ("Render coordinator quit");
+			return true;
+		} else if (keyword == "job") {
+			if (!startJob (message))
+				Console::print ("Cannot start job " + std::to_string (m_job) + ": " + m_error);
+		} else if (keyword == "tile") {
+			unsigned long job;
+			ImageTile tile;
+			in >> job >> tile.x >> tile.y >> tile.width >> tile.height;
+			if (!m_error.empty () || !m_scenePtr || job != m_job) {
+				if (!socket.send ("error " + (m_error.empty () ? std::string ("tile of an unknown job") : m_error)))
+					break;
+				continue;
+			}
+			auto tileStart = std::chrono::steady_clock::now ();
+			m_settings.apply (*m_rayTracerPtr);
+			renderTile (*m_rayTracerPtr, m_scenePtr, m_settings, tile);
+			double seconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - tileStart).count ();
+			std::ostringstream reply;
+			reply << "tile " << job << ' ' << tile.x << ' ' << tile.y << ' ' << tile.width << ' ' << tile.height << ' '
+				  << m_rayTracerPtr->numOfTracedSamples () << ' ' << seconds << '\n';
+			std::string answer = reply.str ();
+			const std::vector<glm::vec3> & pixels = m_rayTracerPtr->image ()->pixels ();
+			answer.append (reinterpret_cast<const char *> (pixels.data ()), pixels.size () * sizeof (glm::vec3));
+			if (!socket.send (answer))
+				break;
+		} else
+			Console::print ("Unknown message from the render coordinator: " + keyword);
+	}
+	Console::print ("Connection to the render coordinator lost");
+	return false;
+}
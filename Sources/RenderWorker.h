@@ -0,0 +1,57 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <string>
+#include <memory>
+
+#include "Scene.h"
+#include "Texture.h"
+#include "RayTracer.h"
+#include "RenderSettings.h"
+
+/// Rectangle of pixels of an image, rows counted from the top.
+struct ImageTile {
+	unsigned int x = 0, y = 0;
+	unsigned int width = 0, height = 0;
+};
+
+/// Render the tile of the image described by the settings, at the tile resolution, with the same rays and samples as
+/// the whole image. Sets the window of the scene camera.
+void renderTile (RayTracer & rayTracer, const std::shared_ptr<Scene> scenePtr, const RenderSettings & settings, const ImageTile & tile);
+
+/// Worker of a distributed render, see RenderCoordinator. Connects to the coordinator, then renders the tiles it
+/// leases until it quits. Messages are a header line, possibly followed by more lines or binary data:
+///  - "job <id>", the render settings and the scene description: scene and settings of the following tiles. The
+///    scene and its BVH are built again only if the description differs from the previous one.
+///  - "tile <job> <x> <y> <width> <height>", answered by the same header followed by the number of traced samples and
+///    the render time in seconds, then by the RGB floats of the tile, row by row. Answered by "error <message>" if the
+///    job could not be started.
+///  - "quit".
+class RenderWorker {
+public:
+	RenderWorker ();
+	virtual ~RenderWorker () {}
+
+	/// Serve the coordinator listening at the address (see Socket), retrying to connect for connectTimeout seconds.
+	/// Returns true when the coordinator quits, false if it cannot be reached or the connection is lost.
+	bool run (const std::string & address, double connectTimeout = 10.0);
+
+private:
+	/// Build the scene of a job message, unless it is the one of the previous job. Returns false on failure.
+	bool startJob (const std::string & message);
+
+	std::shared_ptr<RayTracer> m_rayTracerPtr;
+	TextureCache m_textureCache;
+	std::shared_ptr<Scene> m_scenePtr;
+	std::string m_sceneText; // Description of m_scenePtr
+	RenderSettings m_settings;
+	unsigned long m_job = 0;
+	std::string m_error; // Why the current job could not be started, empty if it was
+};
@@ -12,5 +12,6 @@
 
 static const std::string BASE_WINDOW_TITLE ("INF584 Image Synthesis - Practical Assignment");
 static const std::string SHADER_PATH ("Resources/Shaders/");
+static const std::string MATERIAL_PATH ("Resources/Materials/");
 static const std::string DEFAULT_MESH_FILENAME ("Resources/Models/face.off");
 static const std::string DEFAULT_MATERIAL_DIRNAME ("Resources/Materials/Chesterfield/");
\ No newline at end of file
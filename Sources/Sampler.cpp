@@ -0,0 +1,202 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "Sampler.h"
+
+#include <cmath>
+#include <limits>
+
+static inline uint32_t reverseBits (uint32_t x) {
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+	x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+static inline uint32_t hashCombine (uint32_t seed, uint32_t v) {
+	return seed ^ (v + (seed << 6) + (seed >> 2));
+}
+
+/// Hash-based nested uniform scramble (Laine and Karras 2011, Burley 2020): an Owen scramble of the bits of x.
+static inline uint32_t nestedUniformScramble (uint32_t x, uint32_t seed) {
+	x = reverseBits (x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return reverseBits (x);
+}
+
+/// Second dimension of the Sobol sequence, its generator matrix applied to each byte of the index at once. Scrambled
+/// indices have about 32 significant bits, whose branchy bit by bit product cost as much as the rest of a camera ray.
+static const struct SobolTables {
+	uint32_t bytes[4][256]; // XOR of the generator columns selected by the bits of each byte of the index
+	SobolTables () {
+		uint32_t columns[32];
+		columns[0] = 1u << 31;
+		for (int i = 1; i < 32; i++)
+			columns[i] = columns[i-1] ^ (columns[i-1] >> 1);
+		for (int b = 0; b < 4; b++)
+			for (int x = 0; x < 256; x++) {
+				bytes[b][x] = 0;
+				for (int i = 0; i < 8; i++)
+					if (x & (1 << i))
+						bytes[b][x] ^= columns[8 * b + i];
+			}
+	}
+} sobolTables;
+
+/// First two dimensions of the Sobol sequence: the van der Corput sequence and its companion (0,2)-sequence.
+static inline void sobol2D (uint32_t index, uint32_t & s0, uint32_t & s1) {
+	s0 = reverseBits (index);
+	s1 = sobolTables.bytes[0][index & 0xFF] ^ sobolTables.bytes[1][(index >> 8) & 0xFF]
+		^ sobolTables.bytes[2][(index >> 16) & 0xFF] ^ sobolTables.bytes[3][index >> 24];
+}
+
+static const int BLUE_NOISE_SIZE = 64;
+
+/// Blue noise threshold mask of BLUE_NOISE_SIZE^2 pixels, generated with the void-and-cluster method (Ulichney 1993).
+/// Values are the normalized ranks, uniformly distributed over [0, 1).
+static std::vector<float> generateBlueNoiseMask () {
+	const int n = BLUE_NOISE_SIZE;
+	const int numOfPixels = n * n;
+	const float sigma = 1.5f;
+	// Toroidal gaussian energy kernel
+	std::vector<float> kernel (numOfPixels);
+	for (int y = 0; y < n; y++)
+		for (int x = 0; x < n; x++) {
+			float dx = float (std::min (x, n - x));
+			float dy = float (std::min (y, n - y));
+			kernel[y * n + x] = std::exp (-(dx * dx + dy * dy) / (2.f * sigma * sigma));
+		}
+	std::vector<unsigned char> pattern (numOfPixels, 0);
+	std::vector<float> energy (numOfPixels, 0.f);
+	auto toggle = [&] (int p, bool on) {
+		pattern[p] = on;
+		int px = p % n, py = p / n;
+		float sign = on ? 1.f : -1.f;
+		for (int y = 0; y < n; y++)
+			for (int x = 0; x < n; x++)
+				energy[y * n + x] += sign * kernel[((y - py + n) % n) * n + (x - px + n) % n];
+	};
+	auto tightestCluster = [&] () {
+		int best = -1;
+		for (int p = 0; p < numOfPixels; p++)
+			if (pattern[p] && (best < 0 || energy[p] > energy[best]))
+				best = p;
+		return best;
+	};
+	auto largestVoid = [&] () {
+		int best = -1;
+		for (int p = 0; p < numOfPixels; p++)
+			if (!pattern[p] && (best < 0 || energy[p] < energy[best]))
+				best = p;
+		return best;
+	};
+
+	// Initial pattern: a tenth of the pixels, relaxed by moving the tightest cluster to the largest void
+	int numOfInitialPoints = numOfPixels / 10;
+	uint32_t counter = 0;
+	for (int i = 0; i < numOfInitialPoints; ) {
+		int p = int (pcgHash (counter++) % uint32_t (numOfPixels));
+		if (!pattern[p]) {
+			toggle (p, true);
+			i++;
+		}
+	}
+	for (int iteration = 0; iteration < numOfPixels; iteration++) {
+		int cluster = tightestCluster ();
+		toggle (cluster, false);
+		int hole = largestVoid ();
+		if (hole == cluster) {
+			toggle (cluster, true);
+			break;
+		}
+		toggle (hole, true);
+	}
+
+	std::vector<int> ranks (numOfPixels, 0);
+	std::vector<unsigned char> initialPattern = pattern;
+	std::vector<float> initialEnergy = energy;
+	// Phase 1: rank the initial points, removing the tightest clusters first
+	for (int rank = numOfInitialPoints - 1; rank >= 0; rank--) {
+		int cluster = tightestCluster ();
+		toggle (cluster, false);
+		ranks[cluster] = rank;
+	}
+	// Phases 2 and 3: fill the largest voids of the remaining pixels, in order
+	pattern = initialPattern;
+	energy = initialEnergy;
+	for (int rank = numOfInitialPoints; rank < numOfPixels; rank++) {
+		int hole = largestVoid ();
+		toggle (hole, true);
+		ranks[hole] = rank;
+	}
+	std::vector<float> mask (numOfPixels);
+	for (int p = 0; p < numOfPixels; p++)
+		mask[p] = (float (ranks[p]) + 0.5f) / float (numOfPixels);
+	return mask;
+}
+
+uint32_t Sampler::hash (uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const {
+	return pcgHash (x + pcgHash (y + pcgHash (sampleIndex + pcgHash (dimension + pcgHash (m_seed)))));
+}
+
+/// Owen scrambled Sobol sample, with the sample order shuffled by the seed too (Burley 2020).
+static inline float owenSobol1D (uint32_t sampleIndex, uint32_t seed) {
+	uint32_t index = nestedUniformScramble (sampleIndex, seed);
+	return uintToFloat (nestedUniformScramble (reverseBits (index), hashCombine (seed, 1)));
+}
+
+static inline glm::vec2 owenSobol2D (uint32_t sampleIndex, uint32_t seed) {
+	uint32_t index = nestedUniformScramble (sampleIndex, seed);
+	uint32_t s0, s1;
+	sobol2D (index, s0, s1);
+	return glm::vec2 (uintToFloat (nestedUniformScramble (s0, hashCombine (seed, 1))),
+					  uintToFloat (nestedUniformScramble (s1, hashCombine (seed, 2))));
+}
+
+static inline float wrap (float v) {
+	return std::min (v - std::floor (v), 1.f - std::numeric_limits<float>::epsilon ());
+}
+
+float Sampler::blueNoise (uint32_t x, uint32_t y, uint32_t dimension) const {
+	static const std::vector<float> mask = generateBlueNoiseMask ();
+	// Each dimension reads the mask at its own toroidal offset
+	uint32_t offset = pcgHash (dimension + pcgHash (m_seed));
+	uint32_t mx = (x + offset) % BLUE_NOISE_SIZE;
+	uint32_t my = (y + (offset >> 16)) % BLUE_NOISE_SIZE;
+	return mask[my * BLUE_NOISE_SIZE + mx];
+}
+
+float Sampler::get1D (uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const {
+	switch (m_type) {
+	case SamplerType::Sobol:
+		return owenSobol1D (sampleIndex, hash (x, y, 0, dimension));
+	case SamplerType::BlueNoise:
+		// The same sequence for all pixels, with a per pixel toroidal shift from the blue noise mask (Georgiev and Fajardo 2016)
+		return wrap (owenSobol1D (sampleIndex, hash (0, 0, 0, dimension)) + blueNoise (x, y, dimension));
+	default:
+		return uintToFloat (hash (x, y, sampleIndex, dimension));
+	}
+}
+
+glm::vec2 Sampler::get2D (uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const {
+	switch (m_type) {
+	case SamplerType::Sobol:
+		return owenSobol2D (sampleIndex, hash (x, y, 0, dimension));
+	case SamplerType::BlueNoise: {
+		glm::vec2 u = owenSobol2D (sampleIndex, hash (0, 0, 0, dimension));
+		return glm::vec2 (wrap (u.x + blueNoise (x, y, dimension)), wrap (u.y + blueNoise (x, y, dimension + 1)));
+	}
+	default:
+		return glm::vec2 (uintToFloat (hash (x, y, sampleIndex, dimension)), uintToFloat (hash (x, y, sampleIndex, dimension + 1)));
+	}
+}
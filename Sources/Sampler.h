@@ -0,0 +1,79 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/// Sample sequences used by the ray tracing integrators.
+enum class SamplerType {
+	Random, ///< Counter-based PCG hash of (pixel, sample, dimension, seed)
+	Sobol, ///< Owen scrambled Sobol (0,2)-sequence, shuffled and scrambled per pixel and dimension pair (Burley 2020)
+	BlueNoise ///< Owen scrambled Sobol sequence shared by all pixels, shifted per pixel by a blue noise mask
+};
+
+/// PCG hash (Jarzynski and Olano 2020).
+inline uint32_t pcgHash (uint32_t v) {
+	uint32_t state = v * 747796405u + 2891336453u;
+	uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+/// Uniform float in [0, 1) from the 24 most significant bits.
+inline float uintToFloat (uint32_t x) { return float (x >> 8) * (1.f / 16777216.f); }
+
+/// Stateless sample generator. Every number is a pure function of the pixel, the sample index and the dimension,
+/// so that renders are reproducible and independent of the number of threads and of the scheduling.
+class Sampler {
+public:
+	inline Sampler (SamplerType type = SamplerType::Sobol, uint32_t seed = 0) : m_type (type), m_seed (seed) {}
+	virtual ~Sampler () {}
+
+	inline SamplerType type () const { return m_type; }
+	inline void setType (SamplerType type) { m_type = type; }
+
+	/// Decorrelates whole renders, e.g., successive frames.
+	inline uint32_t seed () const { return m_seed; }
+	inline void setSeed (uint32_t seed) { m_seed = seed; }
+
+	/// Offset added to the pixel coordinates, so that a tile of a larger image rendered on its own draws the same
+	/// numbers as the larger image.
+	inline const glm::uvec2 & pixelOffset () const { return m_pixelOffset; }
+	inline void setPixelOffset (const glm::uvec2 & offset) { m_pixelOffset = offset; }
+
+	float get1D (uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const;
+
+	/// Stratified pair, using the dimensions dimension and dimension+1.
+	glm::vec2 get2D (uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const;
+
+private:
+	uint32_t hash (uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t dimension) const;
+	float blueNoise (uint32_t x, uint32_t y, uint32_t dimension) const;
+
+	SamplerType m_type;
+	uint32_t m_seed;
+	glm::uvec2 m_pixelOffset = glm::uvec2 (0);
+};
+
+/// Sample numbers of one pixel sample, addressed by dimension.
+class PixelSampler {
+public:
+	inline PixelSampler (const Sampler & sampler, uint32_t x, uint32_t y, uint32_t sampleIndex) :
+		m_sampler (&sampler), m_x (x + sampler.pixelOffset ().x), m_y (y + sampler.pixelOffset ().y), m_sampleIndex (sampleIndex) {}
+
+	inline float get1D (uint32_t dimension) const { return m_sampler->get1D (m_x, m_y, m_sampleIndex, dimension); }
+	inline glm::vec2 get2D (uint32_t dimension) const { return m_sampler->get2D (m_x, m_y, m_sampleIndex, dimension); }
+
+private:
+	const Sampler * m_sampler;
+	uint32_t m_x, m_y;
+	uint32_t m_sampleIndex;
+};
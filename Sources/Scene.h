@@ -15,6 +15,7 @@
 #include "Camera.h"
 #include "Mesh.h"
 #include "LightSource.h"
+#include "EnvironmentMap.h"
 
 class Scene {
 public:
@@ -24,6 +25,11 @@ public:
 	inline const glm::vec3 & backgroundColor () const { return m_backgroundColor; }
 
 	inline void setBackgroundColor (const glm::vec3 & color) { m_backgroundColor = color; }
+
+	/// Environment map lighting the ray traced scene, replacing the background color. Null if none.
+	inline std::shared_ptr<const EnvironmentMap> environmentMap () const { return m_environmentMap; }
+
+	inline void setEnvironmentMap (std::shared_ptr<const EnvironmentMap> environmentMap) { m_environmentMap = environmentMap; }
  
 	inline void set (std::shared_ptr<Camera> camera) { m_camera = camera; }
 
@@ -45,14 +51,27 @@ public:
 
 	inline const LightSource & lightSource (int index) const { return m_lightSources[index]; }
 
+	/// Copy that later edits of the scene do not affect, e.g., to render it in the background: the camera, the meshes and
+	/// their materials are copied. Textures and the environment map, which are not edited, are shared.
+	inline std::shared_ptr<Scene> snapshot () const {
+		auto snapshotPtr = std::make_shared<Scene> (*this);
+		if (m_camera)
+			snapshotPtr->m_camera = std::make_shared<Camera> (*m_camera);
+		for (auto & meshPtr : snapshotPtr->m_meshes)
+			meshPtr = std::make_shared<Mesh> (*meshPtr);
+		return snapshotPtr;
+	}
+
 	inline void clear () {
 		m_camera.reset ();
 		m_meshes.clear ();
 		m_lightSources.clear ();
+		m_environmentMap.reset ();
 	}
 
 private:
 	glm::vec3 m_backgroundColor;
+	std::shared_ptr<const EnvironmentMap> m_environmentMap;
 	std::shared_ptr<Camera> m_camera;
 	std::vector<std::shared_ptr<Mesh> > m_meshes;
 	std::vector<LightSource> m_lightSources;
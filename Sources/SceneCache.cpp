@@ -0,0 +1,168 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "SceneCache.h"
+
+#include <fstream>
+#include <iterator>
+#include <exception>
+
+#include "MeshLoader.h"
+
+/// FNV-1a hash of size bytes, accumulated into h.
+static inline void hashBytes (uint64_t & h, const void * data, size_t size) {
+	const unsigned char * bytes = static_cast<const unsigned char *> (data);
+	for (size_t i = 0; i < size; i++)
+		h = (h ^ bytes[i]) * 1099511628211ull;
+}
+
+template<typename T>
+static inline void hashVector (uint64_t & h, const std::vector<T> & v) { hashBytes (h, v.data (), v.size () * sizeof (T)); }
+
+static size_t meshSize (const Mesh & mesh) {
+	return mesh.vertexPositions ().capacity () * sizeof (glm::vec3) + mesh.vertexNormals ().capacity () * sizeof (glm::vec3)
+		+ mesh.triangleIndices ().capacity () * sizeof (glm::uvec3);
+}
+
+static size_t bvhSize (const BVH & bvh) { return bvh.memoryUsage (); }
+
+SceneCache::SceneCache (size_t memoryBudget) : m_memoryBudget (memoryBudget) {}
+
+template<typename T, typename Create, typename Size>
+std::shared_ptr<T> SceneCache::get (std::unordered_map<uint64_t, Entry<T>> & entries, uint64_t key, Create create, Size size) {
+	std::unique_lock<std::mutex> lock (m_mutex);
+	auto it = entries.find (key);
+	if (it != entries.end ()) {
+		m_numOfHits++;
+		it->second.lastUse = ++m_numOfUses;
+		std::shared_future<std::shared_ptr<T>> value = it->second.value;
+		lock.unlock ();
+		// Waits for the value if another thread is creating it, and throws its exception if it failed
+		return value.get ();
+	}
+	m_numOfMisses++;
+	std::promise<std::shared_ptr<T>> promise;
+	entries[key].value = promise.get_future ().share ();
+	entries[key].lastUse = ++m_numOfUses;
+	lock.unlock ();
+	std::shared_ptr<T> valuePtr;
+	try {
+		valuePtr = create ();
+	} catch (...) {
+		promise.set_exception (std::current_exception ());
+		lock.lock ();
+		entries.erase (key);
+		throw;
+	}
+	promise.set_value (valuePtr);
+	lock.lock ();
+	// Still there: entries are only evicted once ready
+	Entry<T> & entry = entries[key];
+	entry.ready = true;
+	entry.size = size (*valuePtr);
+	m_memoryUsage += entry.size;
+	evict ();
+	return valuePtr;
+}
+
+void SceneCache::evict () {
+	while (m_memoryUsage > m_memoryBudget) {
+		// Least recently used ready entry, of either kind
+		uint64_t oldestUse = m_numOfUses;
+		auto oldestMesh = m_meshes.end ();
+		auto oldestBVH = m_bvhs.end ();
+		for (auto it = m_meshes.begin (); it != m_meshes.end (); ++it)
+			if (it->second.ready && it->second.lastUse < oldestUse) {
+				oldestUse = it->second.lastUse;
+				oldestMesh = it;
+			}
+		for (auto it = m_bvhs.begin (); it != m_bvhs.end (); ++it)
+			if (it->second.ready && it->second.lastUse < oldestUse) {
+				oldestUse = it->second.lastUse;
+				oldestBVH = it;
+			}
+		if (oldestBVH != m_bvhs.end ()) {
+			m_memoryUsage -= oldestBVH->second.size;
+			m_bvhs.erase (oldestBVH);
+		} else if (oldestMesh != m_meshes.end ()) {
+			m_memoryUsage -= oldestMesh->second.size;
+			m_meshes.erase (oldestMesh);
+		} else
+			return;
+	}
+}
+
+std::shared_ptr<Mesh> SceneCache::mesh (const std::string & source) {
+	uint64_t key = 14695981039346656037ull;
+	hashBytes (key, source.c_str (), source.size () + 1);
+	if (source != MeshLoader::SQUARE_SOURCE) {
+		// Keyed by content rather than by name, so that edited files are loaded again, and copies are loaded once
+		std::ifstream file (source, std::ios::binary);
+		std::string content ((std::istreambuf_iterator<char> (file)), std::istreambuf_iterator<char> ());
+		key = 14695981039346656037ull;
+		hashBytes (key, content.data (), content.size ());
+	}
+	std::shared_ptr<const Mesh> meshPtr = get (m_meshes, key, [&source] () {
+		auto loadedPtr = std::make_shared<Mesh> ();
+		MeshLoader::load (source, loadedPtr);
+		return std::shared_ptr<const Mesh> (loadedPtr);
+	}, meshSize);
+	auto copyPtr = std::make_shared<Mesh> (*meshPtr);
+	copyPtr->setSource (source);
+	return copyPtr;
+}
+
+std::shared_ptr<BVH> SceneCache::bvh (const std::shared_ptr<Scene> scenePtr, BVHBuildMode mode) {
+	uint64_t key = 14695981039346656037ull;
+	hashBytes (key, &mode, sizeof (mode));
+	for (size_t m = 0; m < scenePtr->numOfMeshes (); m++) {
+		const Mesh & mesh = *scenePtr->mesh (m);
+		glm::mat4 transform = mesh.computeTransformMatrix ();
+		bool spatialSplits = mesh.spatialSplits ();
+		hashBytes (key, &transform, sizeof (transform));
+		hashBytes (key, &spatialSplits, sizeof (spatialSplits));
+		hashVector (key, mesh.vertexPositions ());
+		hashVector (key, mesh.triangleIndices ());
+	}
+	return get (m_bvhs, key, [&scenePtr, mode] () {
+		auto bvhPtr = std::make_shared<BVH> ();
+		bvhPtr->setBuildMode (mode);
+		bvhPtr->build (scenePtr);
+		return bvhPtr;
+	}, bvhSize);
+}
+
+size_t SceneCache::memoryUsage () const {
+	std::lock_guard<std::mutex> lock (m_mutex);
+	return m_memoryUsage;
+}
+
+size_t SceneCache::numOfEntries () const {
+	std::lock_guard<std::mutex> lock (m_mutex);
+	return m_meshes.size () + m_bvhs.size ();
+}
+
+size_t SceneCache::numOfHits () const {
+	std::lock_guard<std::mutex> lock (m_mutex);
+	return m_numOfHits;
+}
+
+size_t SceneCache::numOfMisses () const {
+	std::lock_guard<std::mutex> lock (m_mutex);
+	return m_numOfMisses;
+}
+
+void SceneCache::clear () {
+	std::lock_guard<std::mutex> lock (m_mutex);
+	// Entries being created are kept, their creators fill them in
+	for (auto it = m_meshes.begin (); it != m_meshes.end (); )
+		it = (it->second.ready ? m_meshes.erase (it) : std::next (it));
+	for (auto it = m_bvhs.begin (); it != m_bvhs.end (); )
+		it = (it->second.ready ? m_bvhs.erase (it) : std::next (it));
+	m_memoryUsage = 0;
+}
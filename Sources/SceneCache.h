@@ -0,0 +1,76 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <unordered_map>
+#include <cstdint>
+
+#include "Mesh.h"
+#include "Scene.h"
+#include "BVH.h"
+
+/// Meshes and BVHs kept across the renders of a long running process, e.g., a RenderServer, so that a scene seen
+/// before skips parsing, normal computation and hierarchy builds. Meshes are keyed by a hash of the content of their
+/// source file, BVHs by a hash of the geometry and transforms of their scene and of the build mode. Beyond the memory
+/// budget, the least recently used entries are dropped, although renders still using them keep them alive until they
+/// complete. Thread safe: concurrent requests for a missing entry wait for a single load or build.
+class SceneCache {
+public:
+	static const size_t DEFAULT_MEMORY_BUDGET = size_t (1) << 30;
+
+	SceneCache (size_t memoryBudget = DEFAULT_MEMORY_BUDGET);
+	virtual ~SceneCache () {}
+
+	inline size_t memoryBudget () const { return m_memoryBudget; }
+
+	/// Copy of the mesh of the source (see MeshLoader::load), free to be transformed and given a material. Throws
+	/// std::ios_base::failure like MeshLoader::load.
+	std::shared_ptr<Mesh> mesh (const std::string & source);
+
+	/// BVH of the scene in the build mode. Shared with the other renders of the scene: not to be rebuilt.
+	std::shared_ptr<BVH> bvh (const std::shared_ptr<Scene> scenePtr, BVHBuildMode mode);
+
+	/// Bytes of the cached meshes and BVHs.
+	size_t memoryUsage () const;
+	size_t numOfEntries () const;
+	size_t numOfHits () const;
+	size_t numOfMisses () const;
+
+	/// Drop all the entries.
+	void clear ();
+
+private:
+	template<typename T>
+	struct Entry {
+		std::shared_future<std::shared_ptr<T>> value;
+		bool ready = false;
+		size_t size = 0; // Bytes, once ready
+		uint64_t lastUse = 0;
+	};
+
+	/// Entry of the key in entries, created by create on a miss, outside of the lock.
+	template<typename T, typename Create, typename Size>
+	std::shared_ptr<T> get (std::unordered_map<uint64_t, Entry<T>> & entries, uint64_t key, Create create, Size size);
+
+	/// Drop the least recently used ready entries, but the last used one, until the budget is met. Under the lock.
+	void evict ();
+
+	size_t m_memoryBudget;
+	mutable std::mutex m_mutex;
+	std::unordered_map<uint64_t, Entry<const Mesh>> m_meshes;
+	std::unordered_map<uint64_t, Entry<BVH>> m_bvhs;
+	size_t m_memoryUsage = 0;
+	uint64_t m_numOfUses = 0; // Clock of the uses of the entries
+	size_t m_numOfHits = 0;
+	size_t m_numOfMisses = 0;
+};
@@ -0,0 +1,179 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "SceneDescription.h"
+
+#include <sstream>
+#include <iomanip>
+#include <limits>
+#include <filesystem>
+
+#include "Console.h"
+#include "MeshLoader.h"
+#include "EnvironmentMap.h"
+
+/// Absolute path, so that processes running in other directories find the file. Empty paths stay empty.
+static std::string absolutePath (const std::string & path) {
+	if (path.empty ())
+		return path;
+	std::error_code error;
+	std::filesystem::path absolute = std::filesystem::absolute (path, error);
+	return error ? path : absolute.lexically_normal ().string ();
+}
+
+static std::ostream & operator<< (std::ostream & out, const glm::vec3 & v) { return out << v.x << ' ' << v.y << ' ' << v.z; }
+
+static std::istream & operator>> (std::istream & in, glm::vec3 & v) { return in >> v.x >> v.y >> v.z; }
+
+bool SceneDescription::describe (const Scene & scene) {
+	meshes.clear ();
+	lights.clear ();
+	for (size_t m = 0; m < scene.numOfMeshes (); m++) {
+		const Mesh & mesh = *scene.mesh (m);
+		if (mesh.source ().empty ())
+			return false;
+		MeshDescription description;
+		description.source = (mesh.source () == MeshLoader::SQUARE_SOURCE ? mesh.source () : absolutePath (mesh.source ()));
+		description.translation = mesh.getTranslation ();
+		description.rotation = mesh.getRotation ();
+		description.scale = mesh.getScale ();
+		description.spatialSplits = mesh.spatialSplits ();
+		const Material & material = mesh.material ();
+		description.albedo = material.getAlbedo ();
+		description.roughness = material.getRoughness ();
+		description.metallicness = material.getMetallicness ();
+		description.textureScale = material.getTextureScale ();
+		description.mapsDirname = absolutePath (material.mapsDirname ());
+		meshes.push_back (description);
+	}
+	for (const LightSource & lightSource : scene.lightSources ()) {
+		LightDescription description;
+		description.translation = lightSource.getTranslation ();
+		description.color = lightSource.getColor ();
+		description.intensity = lightSource.getIntensity ();
+		lights.push_back (description);
+	}
+	if (scene.camera ()) {
+		const Camera & c = *scene.camera ();
+		camera.translation = c.getTranslation ();
+		camera.rotation = c.getRotation ();
+		camera.scale = c.getScale ();
+		camera.fov = c.getFoV ();
+		camera.aspectRatio = c.getAspectRatio ();
+		camera.nearPlane = c.getNear ();
+		camera.farPlane = c.getFar ();
+	}
+	backgroundColor = scene.backgroundColor ();
+	environmentMapFilename = (scene.environmentMap () ? absolutePath (scene.environmentMap ()->filename ()) : "");
+	return true;
+}
+
+std::shared_ptr<Scene> SceneDescription::build (TextureCache & cache, SceneCache * sceneCachePtr) const {
+	auto scenePtr = std::make_shared<Scene> ();
+	scenePtr->setBackgroundColor (backgroundColor);
+	if (!environmentMapFilename.empty ()) {
+		auto environmentMapPtr = std::make_shared<EnvironmentMap> ();
+		if (environmentMapPtr->load (environmentMapFilename))
+			scenePtr->setEnvironmentMap (environmentMapPtr);
+		else
+			Console::print ("Cannot load environment map " + environmentMapFilename + ", left out");
+	}
+	for (const MeshDescription & description : meshes) {
+		std::shared_ptr<Mesh> meshPtr = sceneCachePtr ? sceneCachePtr->mesh (description.source) : std::make_shared<Mesh> ();
+		if (!sceneCachePtr)
+			MeshLoader::load (description.source, meshPtr);
+		meshPtr->setTranslation (description.translation);
+		meshPtr->setRotation (description.rotation);
+		meshPtr->setScale (description.scale);
+		meshPtr->setSpatialSplits (description.spatialSplits);
+		Material & material = meshPtr->material ();
+		material.setAlbedo (description.albedo);
+		material.setRoughness (description.roughness);
+		material.setMetallicness (description.metallicness);
+		material.setTextureScale (description.textureScale);
+		if (!description.mapsDirname.empty ())
+			material.loadMaps (description.mapsDirname, cache);
+		scenePtr->add (meshPtr);
+	}
+	auto & lightSources = scenePtr->lightSources ();
+	lightSources.reserve (lights.size ());
+	for (const LightDescription & description : lights) {
+		lightSources.emplace_back ();
+		lightSources.back ().setTranslation (description.translation);
+		lightSources.back ().setColor (description.color);
+		lightSources.back ().setIntensity (description.intensity);
+	}
+	auto cameraPtr = std::make_shared<Camera> ();
+	cameraPtr->setTranslation (camera.translation);
+	cameraPtr->setRotation (camera.rotation);
+	cameraPtr->setScale (camera.scale);
+	cameraPtr->setFoV (camera.fov);
+	cameraPtr->setAspectRatio (camera.aspectRatio);
+	cameraPtr->setNear (camera.nearPlane);
+	cameraPtr->setFar (camera.farPlane);
+	scenePtr->set (cameraPtr);
+	return scenePtr;
+}
+
+void SceneDescription::write (std::ostream & out) const {
+	std::streamsize precision = out.precision (std::numeric_limits<float>::max_digits10);
+	out << "background " << backgroundColor << '\n';
+	if (!environmentMapFilename.empty ())
+		out << "environment " << std::quoted (environmentMapFilename) << '\n';
+	out << "camera " << camera.translation << ' ' << camera.rotation << ' ' << camera.scale << ' ' << camera.fov << ' '
+		<< camera.aspectRatio << ' ' << camera.nearPlane << ' ' << camera.farPlane << '\n';
+	for (const LightDescription & light : lights)
+		out << "light " << light.translation << ' ' << light.color << ' ' << light.intensity << '\n';
+	for (const MeshDescription & mesh : meshes)
+		out << "mesh " << std::quoted (mesh.source) << ' ' << mesh.translation << ' ' << mesh.rotation << ' ' << mesh.scale << ' '
+			<< mesh.spatialSplits << ' ' << mesh.albedo << ' ' << mesh.roughness << ' ' << mesh.metallicness << ' '
+			<< mesh.textureScale << ' ' << std::quoted (mesh.mapsDirname) << '\n';
+	out.precision (precision);
+}
+
+bool SceneDescription::read (std::istream & in) {
+	*this = SceneDescription ();
+	std::string line;
+	while (std::getline (in, line)) {
+		std::istringstream entity (line);
+		std::string keyword;
+		if (!(entity >> keyword))
+			continue;
+		if (keyword == "background")
+			entity >> backgroundColor;
+		else if (keyword == "environment")
+			entity >> std::quoted (environmentMapFilename);
+		else if (keyword == "camera")
+			entity >> camera.translation >> camera.rotation >> camera.scale >> camera.fov >> camera.aspectRatio >> camera.nearPlane >> camera.farPlane;
+		else if (keyword == "light") {
+			LightDescription light;
+			entity >> light.translation >> light.color >> light.intensity;
+			lights.push_back (light);
+		} else if (keyword == "mesh") {
+			MeshDescription mesh;
+			entity >> std::quoted (mesh.source) >> mesh.translation >> mesh.rotation >> mesh.scale >> mesh.spatialSplits
+				   >> mesh.albedo >> mesh.roughness >> mesh.metallicness >> mesh.textureScale >> std::quoted (mesh.mapsDirname);
+			meshes.push_back (mesh);
+		} else
+			return false;
+		if (entity.fail ())
+			return false;
+	}
+	return true;
+}
+
+std::string SceneDescription::toString () const {
+	std::ostringstream out;
+	write (out);
+	return out.str ();
+}
+
+bool SceneDescription::fromString (const std::string & text) {
+	std::istringstream in (text);
+	return read (in);
+}
@@ -0,0 +1,78 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <iostream>
+
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+#include "Texture.h"
+#include "SceneCache.h"
+
+/// Scene reduced to what it is built from, so that another process can build it again, e.g., the workers of a
+/// distributed render: the meshes by source (see Mesh::source) with their transform and material constants, the
+/// material maps by directory, the camera, the point lights and the environment. Paths are made absolute. Written as
+/// text, one entity per line.
+class SceneDescription {
+public:
+	struct MeshDescription {
+		std::string source;
+		glm::vec3 translation = glm::vec3 (0.f);
+		glm::vec3 rotation = glm::vec3 (0.f);
+		float scale = 1.f;
+		bool spatialSplits = false;
+		glm::vec3 albedo = glm::vec3 (0.5f);
+		float roughness = 0.01f;
+		float metallicness = 0.f;
+		float textureScale = 1.f;
+		std::string mapsDirname; // Empty for none
+	};
+
+	struct LightDescription {
+		glm::vec3 translation = glm::vec3 (0.f);
+		glm::vec3 color = glm::vec3 (1.f);
+		float intensity = 1.f;
+	};
+
+	struct CameraDescription {
+		glm::vec3 translation = glm::vec3 (0.f);
+		glm::vec3 rotation = glm::vec3 (0.f);
+		float scale = 1.f;
+		float fov = 45.f;
+		float aspectRatio = 1.f;
+		float nearPlane = 0.1f;
+		float farPlane = 10.f;
+	};
+
+	std::vector<MeshDescription> meshes;
+	std::vector<LightDescription> lights;
+	CameraDescription camera;
+	glm::vec3 backgroundColor = glm::vec3 (0.f);
+	std::string environmentMapFilename; // Empty for none
+
+	/// Describe the scene. Returns false if a mesh has no source, i.e., was not loaded by MeshLoader.
+	bool describe (const Scene & scene);
+
+	/// Build the described scene, loading the maps through the cache, and the meshes through the scene cache if any.
+	/// Throws std::ios_base::failure if a mesh cannot be loaded. Environment maps which cannot be loaded are reported
+	/// and left out.
+	std::shared_ptr<Scene> build (TextureCache & cache, SceneCache * sceneCachePtr = nullptr) const;
+
+	void write (std::ostream & out) const;
+
+	/// Returns false on a malformed description.
+	bool read (std::istream & in);
+
+	std::string toString () const;
+	bool fromString (const std::string & text);
+};
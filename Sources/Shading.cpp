@@ -0,0 +1,332 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "Shading.h"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+static const float RAY_OFFSET = 1e-4f;
+
+float D_GGX(float NoH, float a) {
+    float a2 = a * a;
+    float f = (NoH * a2 - NoH) * NoH + 1.0;
+    return a2 / (PI * f * f);
+}
+
+float V_SmithGGXCorrelated(float NoV, float NoL, float a) {
+    float a2 = a * a;
+    float GGXL = NoV * sqrt((-NoL * a2 + NoL) * NoL + a2);
+    float GGXV = NoL * sqrt((-NoV * a2 + NoV) * NoV + a2);
+    return 0.5 / (GGXV + GGXL);
+}
+
+glm::mat3 computeNormalMatrix (const Mesh & mesh) {
+	return glm::transpose (glm::inverse (glm::mat3 (mesh.computeTransformMatrix ())));
+}
+
+static inline float luminance (const glm::vec3 & c) { return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b; }
+
+MaterialTerms materialTerms (const glm::vec3 & albedo, float roughness, float metallicness) {
+	MaterialTerms terms;
+	terms.albedo = albedo;
+	terms.diffuse = (1.f - metallicness) * albedo / PI;
+	terms.f0 = 0.16f * (1.f - metallicness) + terms.albedo * metallicness;
+	terms.alpha = roughness * roughness;
+	terms.diffuseLuminance = luminance (terms.albedo) * (1.f - metallicness);
+	return terms;
+}
+
+void ShadingContext::build (const Scene & scene) {
+	size_t numOfMeshes = scene.numOfMeshes ();
+	meshes.resize (numOfMeshes);
+	normalMatrices.resize (numOfMeshes);
+	materials.resize (numOfMeshes);
+	materialMaps.resize (numOfMeshes);
+	for (size_t m = 0; m < numOfMeshes; m++) {
+		meshes[m] = scene.mesh (m).get ();
+		normalMatrices[m] = computeNormalMatrix (*meshes[m]);
+		const Material & material = meshes[m]->material ();
+		materials[m] = materialTerms (material);
+		materialMaps[m] = MaterialMaps ();
+		for (int i = 0; i < Material::NumOfMaps; i++) {
+			materialMaps[m].maps[i] = material.map (Material::Map (i)).get ();
+			materialMaps[m].textured |= (materialMaps[m].maps[i] != nullptr);
+		}
+	}
+	const auto & lightSources = scene.lightSources ();
+	lights.resize (lightSources.size ());
+	for (size_t l = 0; l < lightSources.size (); l++) {
+		lights[l].position = lightSources[l].getTranslation ();
+		lights[l].intensity = lightSources[l].getIntensity () * lightSources[l].getColor ();
+	}
+	background = scene.backgroundColor ();
+	environmentMap = scene.environmentMap ().get ();
+}
+
+/// Texture coordinates and blending weights of the three planar projections of triplanar mapping.
+struct TriplanarCoordinates {
+	glm::vec2 uv[3]; // Projections along x, y and z
+	glm::vec3 weights;
+	float footprint; // Width of the pixel footprint, in texture coordinates
+};
+
+static TriplanarCoordinates triplanarCoordinates (const glm::vec3 & p, const glm::vec3 & n, float scale, float footprint) {
+	TriplanarCoordinates c;
+	glm::vec3 q = p / scale;
+	c.uv[0] = glm::vec2 (q.z, q.y);
+	c.uv[1] = glm::vec2 (q.x, q.z);
+	c.uv[2] = glm::vec2 (q.x, q.y);
+	// Sharpened transitions, and no lookups for negligible projections
+	glm::vec3 w = n * n;
+	w *= w;
+	w /= (w.x + w.y + w.z);
+	w = glm::vec3 (w.x < 0.02f ? 0.f : w.x, w.y < 0.02f ? 0.f : w.y, w.z < 0.02f ? 0.f : w.z);
+	c.weights = w / (w.x + w.y + w.z);
+	c.footprint = footprint / scale;
+	return c;
+}
+
+static glm::vec4 sampleTriplanar (const Texture & texture, const TriplanarCoordinates & c) {
+	float lod = texture.lod (c.footprint);
+	glm::vec4 value (0.f);
+	for (int a = 0; a < 3; a++)
+		if (c.weights[a] > 0.f)
+			value += c.weights[a] * texture.sample (c.uv[a], lod);
+	return value;
+}
+
+/// Triplanar normal mapping with the UDN blend (Golus 2017): the tangent space normal of each projection offsets
+/// the components of the geometric normal n lying in its plane.
+static glm::vec3 triplanarNormal (const Texture & texture, const TriplanarCoordinates & c, const glm::vec3 & n) {
+	float lod = texture.lod (c.footprint);
+	glm::vec3 result (0.f);
+	for (int a = 0; a < 3; a++) {
+		if (c.weights[a] == 0.f)
+			continue;
+		glm::vec3 t = 2.f * glm::vec3 (texture.sample (c.uv[a], lod)) - 1.f;
+		if (a == 0)
+			result += c.weights[a] * glm::vec3 (n.x, t.y + n.y, t.x + n.z);
+		else if (a == 1)
+			result += c.weights[a] * glm::vec3 (t.x + n.x, n.y, t.y + n.z);
+		else
+			result += c.weights[a] * glm::vec3 (t.x + n.x, t.y + n.y, n.z);
+	}
+	return normalize (result);
+}
+
+SurfacePoint surfacePoint (const ShadingContext & context, const Hit & hit) {
+	const Mesh & mesh = *context.meshes[hit.getMesh ()];
+	const auto & N = mesh.vertexNormals ();
+	const glm::uvec3 & triangle = mesh.triangleIndices ()[hit.getSimp ()];
+	float w = 1.f - hit.u - hit.v;
+	glm::vec3 normal = normalize (w * N[triangle[0]] + hit.u * N[triangle[1]] + hit.v * N[triangle[2]]);
+	SurfacePoint sp;
+	sp.position = hit.getHitPoint (); // Already in world space
+	const MaterialMaps & maps = context.materialMaps[hit.getMesh ()];
+	if (!maps.textured) {
+		sp.normal = normalize (context.normalMatrices[hit.getMesh ()] * normal);
+		sp.material = context.materials[hit.getMesh ()];
+		return sp;
+	}
+
+	// Textured material, projected in object space so that the maps follow the mesh
+	const Material & material = mesh.material ();
+	const auto & P = mesh.vertexPositions ();
+	glm::vec3 position = w * P[triangle[0]] + hit.u * P[triangle[1]] + hit.v * P[triangle[2]];
+	float footprint = context.pixelSpreadAngle * hit.t / mesh.getScale ();
+	TriplanarCoordinates c = triplanarCoordinates (position, normal, material.getTextureScale (), footprint);
+	glm::vec3 albedo = material.getAlbedo ();
+	float roughness = material.getRoughness ();
+	float metallicness = material.getMetallicness ();
+	if (maps.load (Material::BaseColorMap))
+		albedo = glm::vec3 (sampleTriplanar (*maps.maps[Material::BaseColorMap], c));
+	if (maps.load (Material::RoughnessMap))
+		roughness = sampleTriplanar (*maps.maps[Material::RoughnessMap], c).r;
+	if (maps.load (Material::MetallicMap))
+		metallicness = sampleTriplanar (*maps.maps[Material::MetallicMap], c).r;
+	if (maps.load (Material::AmbientOcclusionMap))
+		sp.occlusion = sampleTriplanar (*maps.maps[Material::AmbientOcclusionMap], c).r;
+	if (maps.load (Material::NormalMap))
+		normal = triplanarNormal (*maps.maps[Material::NormalMap], c, normal);
+	sp.normal = normalize (context.normalMatrices[hit.getMesh ()] * normal);
+	sp.material = materialTerms (albedo, roughness, metallicness);
+	return sp;
+}
+
+/// Fresnel-Schlick, with the fifth power expanded.
+static inline glm::vec3 fresnelSchlick (float u, const glm::vec3 & f0) {
+	float m = 1.f - u;
+	float m2 = m * m;
+	return f0 + (glm::vec3 (1.f) - f0) * (m2 * m2 * m);
+}
+
+glm::vec3 evaluateBRDF (const SurfacePoint & sp, const glm::vec3 & wo, const glm::vec3 & wi) {
+	const MaterialTerms & m = sp.material;
+	glm::vec3 h = normalize (wo + wi);
+	float NoV = abs (dot (sp.normal, wo)) + 1e-5f;
+	float NoL = clamp (dot (sp.normal, wi), 0.0f, 1.0f);
+	float NoH = clamp (dot (sp.normal, h), 0.0f, 1.0f);
+	float LoH = clamp (dot (wi, h), 0.0f, 1.0f);
+	return m.diffuse + D_GGX (NoH, m.alpha) * V_SmithGGXCorrelated (NoV, NoL, m.alpha) * fresnelSchlick (LoH, m.f0);
+}
+
+bool lightIncidence (const SurfacePoint & sp, const ShadingLight & light, glm::vec3 & wi, float & distance, glm::vec3 & irradiance) {
+	glm::vec3 toLight = light.position - sp.position;
+	float distance2 = dot (toLight, toLight);
+	distance = sqrt (distance2);
+	wi = toLight / distance;
+	float wiDotN = dot (wi, sp.normal);
+	if (wiDotN <= 0.f)
+		return false;
+	irradiance = light.intensity * (wiDotN / distance2);
+	return true;
+}
+
+unsigned int selectLights (const SurfacePoint & sp, size_t numOfLights, const LightBVH & lightBVH, unsigned int numOfLightSamples,
+						   const float * u, unsigned int * indices, float * weights) {
+	if (numOfLights <= numOfLightSamples) {
+		for (size_t l = 0; l < numOfLights; l++) {
+			indices[l] = static_cast<unsigned int> (l);
+			weights[l] = 1.f;
+		}
+		return static_cast<unsigned int> (numOfLights);
+	}
+	unsigned int numOfSelectedLights = 0;
+	for (unsigned int k = 0; k < numOfLightSamples; k++) {
+		float pmf;
+		int l = lightBVH.sample (sp.position, sp.normal, u[k], pmf);
+		if (l < 0)
+			break; // No light can contribute
+		indices[numOfSelectedLights] = static_cast<unsigned int> (l);
+		weights[numOfSelectedLights] = 1.f / (pmf * numOfLightSamples);
+		numOfSelectedLights++;
+	}
+	return numOfSelectedLights;
+}
+
+static const unsigned int RUSSIAN_ROULETTE_START = 3;
+
+/// Orthonormal tangent frame (t, b, n) around the normal n.
+static inline void tangentFrame (const glm::vec3 & n, glm::vec3 & t, glm::vec3 & b) {
+	t = normalize (abs (n.x) > 0.9f ? cross (n, glm::vec3 (0.f, 1.f, 0.f)) : cross (n, glm::vec3 (1.f, 0.f, 0.f)));
+	b = cross (n, t);
+}
+
+/// Probability of sampling the specular lobe rather than the diffuse one, from their estimated albedos.
+static float specularProbability (const MaterialTerms & m, float NoV) {
+	float specular = luminance (fresnelSchlick (NoV, m.f0));
+	if (m.diffuseLuminance <= 0.f)
+		return 1.f;
+	return clamp (specular / (specular + m.diffuseLuminance), 0.1f, 0.9f);
+}
+
+/// Smith masking of the GGX distribution with roughness a, for a direction with cosine NoV to the normal.
+static inline float G1_GGX (float NoV, float a) {
+	float a2 = a * a;
+	return 2.f * NoV / (NoV + sqrt (a2 + (1.f - a2) * NoV * NoV));
+}
+
+float pdfBRDF (const SurfacePoint & sp, const glm::vec3 & wo, const glm::vec3 & wi) {
+	float NoV = dot (sp.normal, wo);
+	float NoL = dot (sp.normal, wi);
+	if (NoV <= 0.f || NoL <= 0.f)
+		return 0.f;
+	float a = sp.material.alpha;
+	glm::vec3 h = normalize (wo + wi);
+	float NoH = clamp (dot (sp.normal, h), 0.f, 1.f);
+	// Visible normal density, D_V(h) = G1(wo) max(0, wo.h) D(h) / NoV, mapped to wi by the reflection jacobian 1/(4 wo.h)
+	float specularPdf = G1_GGX (NoV, a) * D_GGX (NoH, a) / (4.f * NoV);
+	float diffusePdf = NoL / PI;
+	float ps = specularProbability (sp.material, NoV);
+	return ps * specularPdf + (1.f - ps) * diffusePdf;
+}
+
+bool sampleBRDF (const SurfacePoint & sp, const glm::vec3 & wo, float u0, float u1, float u2, glm::vec3 & wi, glm::vec3 & weight, float & pdf) {
+	glm::vec3 n = sp.normal;
+	float NoV = dot (wo, n);
+	if (NoV <= 0.f)
+		return false;
+	glm::vec3 t, b;
+	tangentFrame (n, t, b);
+	float ps = specularProbability (sp.material, NoV);
+	if (u0 < ps) {
+		// Sample the GGX distribution of visible normals in the local frame, stretched to unit roughness
+		float a = sp.material.alpha;
+		glm::vec3 v (dot (wo, t), dot (wo, b), NoV);
+		glm::vec3 vh = normalize (glm::vec3 (a * v.x, a * v.y, v.z));
+		float lensq = vh.x * vh.x + vh.y * vh.y;
+		glm::vec3 t1 = lensq > 0.f ? glm::vec3 (-vh.y, vh.x, 0.f) / sqrt (lensq) : glm::vec3 (1.f, 0.f, 0.f);
+		glm::vec3 t2 = cross (vh, t1);
+		float r = sqrt (u1);
+		float phi = 2.f * PI * u2;
+		float p1 = r * cos (phi);
+		float p2 = r * sin (phi);
+		float s = 0.5f * (1.f + vh.z);
+		p2 = (1.f - s) * sqrt (max (0.f, 1.f - p1 * p1)) + s * p2;
+		glm::vec3 nh = p1 * t1 + p2 * t2 + sqrt (max (0.f, 1.f - p1 * p1 - p2 * p2)) * vh;
+		glm::vec3 ne = normalize (glm::vec3 (a * nh.x, a * nh.y, max (1e-6f, nh.z)));
+		glm::vec3 m = ne.x * t + ne.y * b + ne.z * n;
+		wi = reflect (-wo, m);
+	} else {
+		float r = sqrt (u1);
+		float phi = 2.f * PI * u2;
+		wi = normalize (r * cos (phi) * t + r * sin (phi) * b + sqrt (max (0.f, 1.f - u1)) * n);
+	}
+	float NoL = dot (wi, n);
+	if (NoL <= 0.f)
+		return false;
+	pdf = pdfBRDF (sp, wo, wi);
+	if (pdf <= 0.f)
+		return false;
+	weight = evaluateBRDF (sp, wo, wi) * NoL / pdf;
+	return (weight.x > 0.f || weight.y > 0.f || weight.z > 0.f);
+}
+
+/// Density of uniform sampling over the sphere of directions.
+static const float UNIFORM_ENVIRONMENT_PDF = 0.25f / PI;
+
+float environmentPdf (const ShadingContext & context, const glm::vec3 & wi) {
+	return context.environmentMap ? context.environmentMap->pdf (wi) : UNIFORM_ENVIRONMENT_PDF;
+}
+
+glm::vec3 sampleEnvironment (const ShadingContext & context, float u1, float u2, glm::vec3 & wi, float & pdf) {
+	if (context.environmentMap)
+		return context.environmentMap->sample (u1, u2, wi, pdf);
+	float z = 1.f - 2.f * u1;
+	float r = sqrt (max (0.f, 1.f - z * z));
+	float phi = 2.f * PI * u2;
+	wi = glm::vec3 (r * cos (phi), r * sin (phi), z);
+	pdf = UNIFORM_ENVIRONMENT_PDF;
+	return context.background;
+}
+
+bool environmentContribution (const SurfacePoint & sp, const glm::vec3 & Le, float pdf, const glm::vec3 & wo, const glm::vec3 & wi, bool misWeighted, glm::vec3 & radiance) {
+	float NoL = dot (wi, sp.normal);
+	if (pdf <= 0.f || NoL <= 0.f || dot (wo, sp.normal) <= 0.f)
+		return false;
+	float misWeight = misWeighted ? powerHeuristic (pdf, pdfBRDF (sp, wo, wi)) : 1.f;
+	radiance = Le * evaluateBRDF (sp, wo, wi) * (sp.occlusion * NoL * misWeight / pdf);
+	return (radiance.x > 0.f || radiance.y > 0.f || radiance.z > 0.f);
+}
+
+bool russianRoulette (unsigned int bounce, float u, glm::vec3 & throughput) {
+	if (bounce < RUSSIAN_ROULETTE_START)
+		return true;
+	float survival = min (0.95f, max (throughput.x, max (throughput.y, throughput.z)));
+	if (u >= survival)
+		return false;
+	throughput /= survival;
+	return true;
+}
+
+glm::vec3 offsetRayOrigin (const SurfacePoint & sp, const glm::vec3 & dir) {
+	return sp.position + (dot (dir, sp.normal) >= 0.f ? RAY_OFFSET : -RAY_OFFSET) * sp.normal;
+}
@@ -0,0 +1,183 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+
+#include "Scene.h"
+#include "Material.h"
+#include "LightSource.h"
+#include "Ray.h"
+#include "Hit.h"
+#include "LightBVH.h"
+#include "Sampler.h"
+
+const float PI = 3.1415926535897932384626433832795;
+
+// BRDF model, shared by every ray tracing integrator.
+
+float D_GGX (float NoH, float a);
+
+float V_SmithGGXCorrelated (float NoV, float NoL, float a);
+
+/// BRDF terms of a material, precomputed once per frame, or per hit for textured materials.
+struct MaterialTerms {
+	glm::vec3 albedo;
+	glm::vec3 diffuse; // Lambertian BRDF, (1 - metallicness) * albedo / PI
+	glm::vec3 f0; // Fresnel reflectance at normal incidence
+	float alpha; // GGX roughness, the square of the perceptual roughness
+	float diffuseLuminance; // Luminance of the diffuse albedo, for lobe selection
+};
+
+MaterialTerms materialTerms (const glm::vec3 & albedo, float roughness, float metallicness);
+
+inline MaterialTerms materialTerms (const Material & material) {
+	return materialTerms (material.getAlbedo (), material.getRoughness (), material.getMetallicness ());
+}
+
+/// Point light reduced to what shading needs, in world space, which is the shading space.
+struct ShadingLight {
+	glm::vec3 position;
+	glm::vec3 intensity; // Color times intensity
+};
+
+/// Maps of a material, without reference counting. Textures are decoded by the first hit sampling them.
+struct MaterialMaps {
+	Texture * maps[Material::NumOfMaps] = {};
+	bool textured = false; // Whether any map is set
+
+	inline bool load (Material::Map m) const { return maps[m] && maps[m]->load (); }
+};
+
+/// Per frame shading invariants, built once per render so that shading a hit involves neither matrix inversions,
+/// nor copies of materials and lights, nor shared pointer reference counting.
+struct ShadingContext {
+	std::vector<const Mesh *> meshes;
+	std::vector<glm::mat3> normalMatrices; // Per mesh
+	std::vector<MaterialTerms> materials; // Per mesh, from the material constants
+	std::vector<MaterialMaps> materialMaps; // Per mesh
+	std::vector<ShadingLight> lights;
+	glm::vec3 background;
+	const EnvironmentMap * environmentMap = nullptr; // Replaces the background if set
+	float pixelSpreadAngle = 0.f; // Angle subtended by a pixel, selecting the mip levels of the textures
+
+	void build (const Scene & scene);
+};
+
+/// Shading point reconstructed from a ray hit, in world space.
+struct SurfacePoint {
+	glm::vec3 position;
+	glm::vec3 normal; // Interpolated shading normal, perturbed by the normal map if any
+	MaterialTerms material;
+	float occlusion = 1.f; // Ambient occlusion, attenuating the environment light
+};
+
+/// Shading point of the hit. The maps of textured materials are sampled with a triplanar projection in object space,
+/// filtered over the footprint of a pixel cone from the ray origin: exact for camera rays, and a lower bound on the
+/// footprint of the other rays, whose cones widen at each bounce.
+SurfacePoint surfacePoint (const ShadingContext & context, const Hit & hit);
+
+/// Auxiliary features of the primary hit of a pixel sample, guiding the denoiser and filling the AOVs of the framebuffer.
+/// Background samples keep the defaults: a unit albedo, so that their radiance is not demodulated, a null normal, and
+/// negative indices.
+struct SurfaceFeatures {
+	glm::vec3 albedo = glm::vec3 (1.f);
+	glm::vec3 normal = glm::vec3 (0.f);
+	float depth = 0.f; // Distance along the camera ray
+	int mesh = -1;
+	int triangle = -1;
+	glm::vec2 barycentrics = glm::vec2 (0.f);
+};
+
+inline SurfaceFeatures surfaceFeatures (const SurfacePoint & sp, const Hit & hit) {
+	SurfaceFeatures features;
+	features.albedo = sp.material.albedo;
+	features.normal = sp.normal;
+	features.depth = hit.t;
+	features.mesh = hit.getMesh ();
+	features.triangle = hit.getSimp ();
+	features.barycentrics = glm::vec2 (hit.u, hit.v);
+	return features;
+}
+
+/// Inverse transpose of the mesh's model matrix, transforming its normals to world space.
+glm::mat3 computeNormalMatrix (const Mesh & mesh);
+
+/// Diffuse plus GGX specular BRDF at the surface point, for the directions wo (outgoing) and wi (incident).
+glm::vec3 evaluateBRDF (const SurfacePoint & sp, const glm::vec3 & wo, const glm::vec3 & wi);
+
+/// Unoccluded irradiance from the light source at the surface point, i.e., its intensity times the cosine term over the
+/// squared distance. Returns false if the light lies below the surface. On success, wi and distance describe the shadow ray
+/// to trace towards the light. The reflected radiance is the irradiance times the BRDF, which may be evaluated in batches.
+bool lightIncidence (const SurfacePoint & sp, const ShadingLight & light, glm::vec3 & wi, float & distance, glm::vec3 & irradiance);
+
+/// Upper bound on the number of light samples per shading point.
+const unsigned int MAX_LIGHT_SAMPLES = 16;
+
+/// Lights to connect to in next event estimation: all of them if there are at most numOfLightSamples, otherwise
+/// numOfLightSamples picks from the light BVH, built over the scene lights, using the uniform numbers u. Fills indices with the selected lights
+/// and weights with the inverse of their expected number of picks. Returns the number of selected lights.
+unsigned int selectLights (const SurfacePoint & sp, size_t numOfLights, const LightBVH & lightBVH, unsigned int numOfLightSamples,
+						   const float * u, unsigned int * indices, float * weights);
+
+/// Sampler dimensions of a path, shared by the integrators so that the same decision always draws from the same
+/// dimension: the pixel footprint first, then a block of BOUNCE_DIMENSIONS per bounce, starting at bounceDimension.
+const unsigned int PIXEL_DIMENSION = 0; // 2D
+const unsigned int LIGHT_SELECTION_DIMENSION = 0; // MAX_LIGHT_SAMPLES x 1D
+const unsigned int ENVIRONMENT_DIMENSION = MAX_LIGHT_SAMPLES; // 2D
+const unsigned int BRDF_LOBE_DIMENSION = MAX_LIGHT_SAMPLES + 2; // 1D
+const unsigned int BRDF_DIRECTION_DIMENSION = MAX_LIGHT_SAMPLES + 3; // 2D
+const unsigned int RUSSIAN_ROULETTE_DIMENSION = MAX_LIGHT_SAMPLES + 5; // 1D
+const unsigned int BOUNCE_DIMENSIONS = MAX_LIGHT_SAMPLES + 6;
+
+inline unsigned int bounceDimension (unsigned int bounce) { return 2 + bounce * BOUNCE_DIMENSIONS; }
+
+/// Importance sampling of a continuation ray from the uniform numbers (u0, u1, u2). u0 selects the lobe:
+/// the specular one is sampled from the GGX distribution of visible normals (Heitz 2018), the diffuse one
+/// with a cosine distribution. weight receives BRDF * cosine / pdf, with pdf the solid angle density of
+/// the lobe mixture. Returns false if the path must be terminated.
+bool sampleBRDF (const SurfacePoint & sp, const glm::vec3 & wo, float u0, float u1, float u2, glm::vec3 & wi, glm::vec3 & weight, float & pdf);
+
+/// Solid angle density with which sampleBRDF generates wi.
+float pdfBRDF (const SurfacePoint & sp, const glm::vec3 & wo, const glm::vec3 & wi);
+
+/// Radiance incident along -wi from the environment: the environment map of the scene if any, otherwise the uniform
+/// background color.
+inline glm::vec3 environmentRadiance (const ShadingContext & context, const glm::vec3 & wi) {
+	return context.environmentMap ? context.environmentMap->radiance (wi) : context.background;
+}
+
+/// Solid angle density with which sampleEnvironment generates wi.
+float environmentPdf (const ShadingContext & context, const glm::vec3 & wi);
+
+/// Direction wi towards the environment drawn from the uniform numbers (u1, u2), with its solid angle density pdf:
+/// importance sampled from the environment map if any, otherwise uniform over the sphere. Returns its radiance.
+glm::vec3 sampleEnvironment (const ShadingContext & context, float u1, float u2, glm::vec3 & wi, float & pdf);
+
+/// Unoccluded environment radiance reflected towards wo, for the incident radiance Le sampled along wi with density
+/// pdf, weighted by multiple importance sampling against sampleBRDF unless the path ends here. Returns false if wi
+/// lies below the surface.
+bool environmentContribution (const SurfacePoint & sp, const glm::vec3 & Le, float pdf, const glm::vec3 & wo, const glm::vec3 & wi, bool misWeighted, glm::vec3 & radiance);
+
+/// Power heuristic weight of a sample drawn with density pdf, against another strategy with density otherPdf.
+inline float powerHeuristic (float pdf, float otherPdf) {
+	float a = pdf * pdf;
+	float b = otherPdf * otherPdf;
+	return a > 0.f ? a / (a + b) : 0.f;
+}
+
+/// Russian roulette path termination after a few bounces, with a survival probability following the throughput.
+/// Returns false if the path is terminated, otherwise compensates the throughput of the surviving path.
+bool russianRoulette (unsigned int bounce, float u, glm::vec3 & throughput);
+
+/// Origin of a secondary ray leaving the surface in direction dir, offset to avoid self intersection.
+glm::vec3 offsetRayOrigin (const SurfacePoint & sp, const glm::vec3 & dir);
@@ -0,0 +1,262 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "Socket.h"
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <new>
+
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "Console.h"
+
+static const std::string UNIX_PREFIX = "unix:";
+// Largest message accepted, a full frame of RGB floats of about 9k x 9k pixels, which guards against corrupted length prefixes
+static const uint64_t MAX_MESSAGE_SIZE = uint64_t (1) << 30;
+
+#ifdef MSG_NOSIGNAL
+static const int SEND_FLAGS = MSG_NOSIGNAL; // A lost peer must not kill the process with SIGPIPE
+#else
+static const int SEND_FLAGS = 0;
+#endif
+
+/// Socket address of a Unix domain socket path. Returns false if the path is too long.
+static bool unixAddress (const std::string & path, sockaddr_un & address) {
+	std::memset (&address, 0, sizeof (address));
+	address.sun_family = AF_UNIX;
+	if (path.size () >= sizeof (address.sun_path))
+		return false;
+	std::memcpy (address.sun_path, path.c_str (), path.size ());
+	return true;
+}
+
+/// Addresses of "host:port", for a passive (listening) socket or not.
+static addrinfo * tcpAddresses (const std::string & address, bool passive) {
+	size_t colon = address.rfind (':');
+	if (colon == std::string::npos)
+		return nullptr;
+	std::string host = address.substr (0, colon);
+	std::string port = address.substr (colon + 1);
+	addrinfo hints;
+	std::memset (&hints, 0, sizeof (hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = (passive ? AI_PASSIVE : 0);
+	addrinfo * addresses = nullptr;
+	if (getaddrinfo (host.empty () ? nullptr : host.c_str (), port.c_str (), &hints, &addresses) != 0)
+		return nullptr;
+	return addresses;
+}
+
+static void configure (int fd) {
+#ifdef SO_NOSIGPIPE
+	int one = 1;
+	setsockopt (fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof (one));
+#else
+	(void) fd; // MSG_NOSIGNAL is passed to each send instead
+#endif
+}
+
+Socket::Socket (Socket && other) : m_fd (other.m_fd), m_unixPath (std::move (other.m_unixPath)) {
+	other.m_fd = -1;
+	other.m_unixPath.clear ();
+}
+
+Socket & Socket::operator= (Socket && other) {
+	if (this != &other) {
+		close ();
+		m_fd = other.m_fd;
+		m_unixPath = std::move (other.m_unixPath);
+		other.m_fd = -1;
+		other.m_unixPath.clear ();
+	}
+	return *this;
+}
+
+Socket::~Socket () {
+	close ();
+}
+
+Socket Socket::connect (const std::string & address) {
+	if (address.compare (0, UNIX_PREFIX.size (), UNIX_PREFIX) == 0) {
+		sockaddr_un unixAddr;
+		if (!unixAddress (address.substr (UNIX_PREFIX.size ()), unixAddr))
+			return Socket ();
+		int fd = ::socket (AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0)
+			return Socket ();
+		Socket socket (fd);
+		if (::connect (fd, reinterpret_cast<sockaddr *> (&unixAddr), sizeof (unixAddr)) != 0)
+			return Socket ();
+		configure (fd);
+		return socket;
+	}
+	addrinfo * addresses = tcpAddresses (address, false);
+	Socket socket;
+	for (addrinfo * a = addresses; a && !socket.valid (); a = a->ai_next) {
+		int fd = ::socket (a->ai_family, a->ai_socktype, a->ai_protocol);
+		if (fd < 0)
+			continue;
+		Socket candidate (fd);
+		if (::connect (fd, a->ai_addr, a->ai_addrlen) != 0)
+			continue;
+		int one = 1;
+		setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+		configure (fd);
+		socket = std::move (candidate);
+	}
+	if (addresses)
+		freeaddrinfo (addresses);
+	return socket;
+}
+
+Socket Socket::listen (const std::string & address) {
+	if (address.compare (0, UNIX_PREFIX.size (), UNIX_PREFIX) == 0) {
+		std::string path = address.substr (UNIX_PREFIX.size ());
+		sockaddr_un unixAddr;
+		if (!unixAddress (path, unixAddr))
+			return Socket ();
+		int fd = ::socket (AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0)
+			return Socket ();
+		Socket socket (fd);
+		::unlink (path.c_str ());
+		if (::bind (fd, reinterpret_cast<sockaddr *> (&unixAddr), sizeof (unixAddr)) != 0 || ::listen (fd, SOMAXCONN) != 0)
+			return Socket ();
+		socket.m_unixPath = path;
+		return socket;
+	}
+	addrinfo * addresses = tcpAddresses (address, true);
+	Socket socket;
+	for (addrinfo * a = addresses; a && !socket.valid (); a = a->ai_next) {
+		int fd = ::socket (a->ai_family, a->ai_socktype, a->ai_protocol);
+		if (fd < 0)
+			continue;
+		Socket candidate (fd);
+		int one = 1;
+		setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+		if (::bind (fd, a->ai_addr, a->ai_addrlen) != 0 || ::listen (fd, SOMAXCONN) != 0)
+			continue;
+		socket = std::move (candidate);
+	}
+	if (addresses)
+		freeaddrinfo (addresses);
+	return socket;
+}
+
+Socket Socket::accept (double timeout) const {
+	if (!wait (timeout))
+		return Socket ();
+	int fd = ::accept (m_fd, nullptr, nullptr);
+	if (fd < 0)
+		return Socket ();
+	int one = 1;
+	setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one)); // Fails harmlessly on Unix domain sockets
+	configure (fd);
+	return Socket (fd);
+}
+
+bool Socket::wait (double timeout) const {
+	if (m_fd < 0)
+		return false;
+	pollfd p;
+	p.fd = m_fd;
+	p.events = POLLIN;
+	p.revents = 0;
+	int result;
+	do
+		result = ::poll (&p, 1, int (timeout * 1e3));
+	while (result < 0 && errno == EINTR);
+	return result > 0;
+}
+
+bool Socket::sendBytes (const void * data, size_t size) {
+	const char * bytes = static_cast<const char *> (data);
+	while (size > 0) {
+		ssize_t sent = ::send (m_fd, bytes, size, SEND_FLAGS);
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent <= 0)
+			return false;
+		bytes += sent;
+		size -= size_t (sent);
+	}
+	return true;
+}
+
+bool Socket::receiveBytes (void * data, size_t size) {
+	char * bytes = static_cast<char *> (data);
+	while (size > 0) {
+		ssize_t received = ::recv (m_fd, bytes, size, 0);
+		if (received < 0 && errno == EINTR)
+			continue;
+		if (received <= 0)
+			return false;
+		bytes += received;
+		size -= size_t (received);
+	}
+	return true;
+}
+
+bool Socket::send (const std::string & message) {
+	if (m_fd < 0)
+		return false;
+	// Little endian length prefix, whatever the host
+	unsigned char prefix[8];
+	uint64_t size = message.size ();
+	for (int i = 0; i < 8; i++)
+		prefix[i] = static_cast<unsigned char> (size >> (8 * i));
+	return sendBytes (prefix, sizeof (prefix)) && sendBytes (message.data (), message.size ());
+}
+
+bool Socket::receive (std::string & message) {
+	if (m_fd < 0)
+		return false;
+	unsigned char prefix[8];
+	if (!receiveBytes (prefix, sizeof (prefix)))
+		return false;
+	uint64_t size = 0;
+	for (int i = 0; i < 8; i++)
+		size |= uint64_t (prefix[i]) << (8 * i);
+	if (size > MAX_MESSAGE_SIZE) {
+		Console::print ("Invalid message of " + std::to_string (size) + " bytes, closing the connection");
+		return false;
+	}
+	try {
+		message.resize (size_t (size));
+	} catch (const std::bad_alloc &) {
+		Console::print ("Cannot allocate a message of " + std::to_string (size) + " bytes, closing the connection");
+		return false;
+	}
+	return size == 0 || receiveBytes (&message[0], message.size ());
+}
+
+void Socket::shutdown () {
+	if (m_fd >= 0)
+		::shutdown (m_fd, SHUT_RDWR);
+}
+
+void Socket::close () {
+	if (m_fd < 0)
+		return;
+	::close (m_fd);
+	m_fd = -1;
+	if (!m_unixPath.empty ()) {
+		::unlink (m_unixPath.c_str ());
+		m_unixPath.clear ();
+	}
+}
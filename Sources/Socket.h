@@ -0,0 +1,61 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <string>
+
+/// Blocking stream socket exchanging length prefixed messages, over TCP for addresses "host:port" (an empty host
+/// listens on all interfaces), or over a Unix domain socket for addresses "unix:<path>". POSIX only.
+/// Failures are reported by the return values; sockets are closed on destruction.
+class Socket {
+public:
+	inline Socket () {}
+	Socket (Socket && other);
+	Socket & operator= (Socket && other);
+	Socket (const Socket &) = delete;
+	Socket & operator= (const Socket &) = delete;
+	virtual ~Socket ();
+
+	inline bool valid () const { return m_fd >= 0; }
+
+	/// Connected socket, invalid if nothing listens at the address.
+	static Socket connect (const std::string & address);
+
+	/// Listening socket, invalid on failure, e.g., an address in use. The file of a Unix domain socket is replaced,
+	/// and removed on close.
+	static Socket listen (const std::string & address);
+
+	/// Connection accepted within timeout seconds, invalid on timeout or failure.
+	Socket accept (double timeout) const;
+
+	/// Whether a message, or the end of the stream, arrives within timeout seconds.
+	bool wait (double timeout) const;
+
+	/// Send the message, at once with respect to the other senders if calls are serialized. Returns false if the
+	/// connection is lost.
+	bool send (const std::string & message);
+
+	/// Receive the next message, waiting for it. Returns false if the connection is lost or closed, or if the message is
+	/// too large to be genuine, after which the connection is unusable.
+	bool receive (std::string & message);
+
+	/// Unblock the threads waiting on the socket, which then see a lost connection.
+	void shutdown ();
+
+	void close ();
+
+private:
+	inline explicit Socket (int fd) : m_fd (fd) {}
+
+	bool sendBytes (const void * data, size_t size);
+	bool receiveBytes (void * data, size_t size);
+
+	int m_fd = -1;
+	std::string m_unixPath; // File of a listening Unix domain socket
+};
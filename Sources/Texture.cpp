@@ -0,0 +1,367 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "Texture.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "Console.h"
+
+#include <filesystem>
+#include <sstream>
+#include <cstring>
+#include <atomic>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+static inline float sRGBToLinear (float c) {
+	return c <= 0.04045f ? c / 12.92f : std::pow ((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static inline float linearToSRGB (float c) {
+	return c <= 0.0031308f ? 12.92f * c : 1.055f * std::pow (c, 1.f / 2.4f) - 0.055f;
+}
+
+/// 8 bit value to linear float, per color space
+static const struct DecodingTables {
+	float linear[256];
+	float sRGB[256];
+	DecodingTables () {
+		for (int i = 0; i < 256; i++) {
+			linear[i] = i / 255.f;
+			sRGB[i] = sRGBToLinear (i / 255.f);
+		}
+	}
+} decodingTables;
+
+static inline unsigned char encode (float c, bool sRGB) {
+	c = glm::clamp (sRGB ? linearToSRGB (c) : c, 0.f, 1.f);
+	return static_cast<unsigned char> (c * 255.f + 0.5f);
+}
+
+/// Header of a tile file, followed by the pages of all levels, finest first.
+struct TileFileHeader {
+	char magic[8];
+	uint32_t width, height, numOfChannels, sRGB;
+	uint64_t sourceSize;
+	int64_t sourceTime; // Modification time of the image, the tile file is rebuilt when it changes
+};
+
+static const char TILE_FILE_MAGIC[8] = {'I', 'N', 'F', '5', '8', '4', 'T', '1'};
+
+/// Temporary name of a tile file being built, unique across the processes sharing the cache directory
+static std::string temporaryTileFilename (const std::string & filename) {
+	static std::atomic<unsigned int> counter (0);
+	return filename + "." + std::to_string (getpid ()) + "_" + std::to_string (counter++) + ".tmp";
+}
+
+static bool sourceStamp (const std::string & filename, uint64_t & size, int64_t & time) {
+	std::error_code error;
+	size = static_cast<uint64_t> (fs::file_size (filename, error));
+	if (error)
+		return false;
+	time = static_cast<int64_t> (fs::last_write_time (filename, error).time_since_epoch ().count ());
+	return !error;
+}
+
+/// 2x2 box filter of a scanline image, in linear space. Alpha is never sRGB encoded.
+static std::vector<unsigned char> downsample (const unsigned char * src, unsigned int width, unsigned int height, unsigned int numOfChannels, bool sRGB) {
+	unsigned int dstWidth = std::max (1u, width / 2), dstHeight = std::max (1u, height / 2);
+	std::vector<unsigned char> dst (size_t (dstWidth) * dstHeight * numOfChannels);
+	unsigned int numOfColorChannels = (numOfChannels == 2 || numOfChannels == 4 ? numOfChannels - 1 : numOfChannels);
+	const float * table = sRGB ? decodingTables.sRGB : decodingTables.linear;
+	#pragma omp parallel for
+	for (int y = 0; y < int (dstHeight); y++)
+		for (unsigned int x = 0; x < dstWidth; x++)
+			for (unsigned int c = 0; c < numOfChannels; c++) {
+				bool colorChannel = (c < numOfColorChannels);
+				float sum = 0.f;
+				for (unsigned int dy = 0; dy < 2; dy++)
+					for (unsigned int dx = 0; dx < 2; dx++) {
+						unsigned int sx = std::min (2 * x + dx, width - 1);
+						unsigned int sy = std::min (2 * y + dy, height - 1);
+						unsigned char value = src[(size_t (sy) * width + sx) * numOfChannels + c];
+						sum += colorChannel ? table[value] : decodingTables.linear[value];
+					}
+				dst[(size_t (y) * dstWidth + x) * numOfChannels + c] = encode (0.25f * sum, sRGB && colorChannel);
+			}
+	return dst;
+}
+
+Texture::Texture (TextureCache & cache, const std::string & filename, bool sRGB) :
+	m_cache (cache),
+	m_id (cache.m_nextTextureId++),
+	m_filename (filename),
+	m_sRGB (sRGB) {}
+
+bool Texture::load () {
+	std::call_once (m_loadFlag, [this] () {
+		m_loaded = openTileFile () || (buildTileFile () && openTileFile ());
+	});
+	return m_loaded;
+}
+
+void Texture::setLayout (unsigned int width, unsigned int height, unsigned int numOfChannels) {
+	m_width = width;
+	m_height = height;
+	m_numOfChannels = numOfChannels;
+	// Largest power of two page fitting in a slot: 128x128 grey texels, 64x64 otherwise
+	m_pageSize = (numOfChannels == 1 ? 128 : 64);
+	m_pageBytes = size_t (m_pageSize) * m_pageSize * numOfChannels;
+	unsigned int numOfLevels = 1 + static_cast<unsigned int> (std::floor (std::log2 (float (std::max (width, height)))));
+	m_levels.resize (numOfLevels);
+	m_numOfPages = 0;
+	for (unsigned int l = 0; l < numOfLevels; l++) {
+		Level & level = m_levels[l];
+		level.width = std::max (1u, width >> l);
+		level.height = std::max (1u, height >> l);
+		level.numOfPagesX = (level.width + m_pageSize - 1) / m_pageSize;
+		level.firstPage = m_numOfPages;
+		m_numOfPages += size_t (level.numOfPagesX) * ((level.height + m_pageSize - 1) / m_pageSize);
+	}
+	m_residency.reset (new std::atomic<int>[m_numOfPages]);
+	for (size_t p = 0; p < m_numOfPages; p++)
+		m_residency[p].store (-1, std::memory_order_relaxed);
+}
+
+std::string Texture::tileFilename () const {
+	std::error_code error;
+	fs::path path = fs::absolute (m_filename, error);
+	std::ostringstream name;
+	name << std::hex << std::hash<std::string> () (path.string ()) << (m_sRGB ? "_sRGB" : "") << ".tiles";
+	return (fs::path (m_cache.directory ()) / name.str ()).string ();
+}
+
+bool Texture::openTileFile () {
+	TileFileHeader header;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	if (!sourceStamp (m_filename, sourceSize, sourceTime))
+		return false;
+	std::string filename = tileFilename ();
+	m_file.open (filename, std::ios::binary);
+	if (m_file.read (reinterpret_cast<char *> (&header), sizeof (header))
+		&& std::equal (header.magic, header.magic + 8, TILE_FILE_MAGIC)
+		&& header.sRGB == uint32_t (m_sRGB)
+		&& header.sourceSize == sourceSize
+		&& header.sourceTime == sourceTime
+		&& header.numOfChannels >= 1 && header.numOfChannels <= 4) {
+		setLayout (header.width, header.height, header.numOfChannels);
+		// A truncated file would silently read as black pages
+		std::error_code error;
+		if (fs::file_size (filename, error) == sizeof (header) + m_numOfPages * m_pageBytes && !error)
+			return true;
+	}
+	m_file.close ();
+	m_file.clear ();
+	return false;
+}
+
+bool Texture::buildTileFile () {
+	TileFileHeader header;
+	std::copy_n (TILE_FILE_MAGIC, 8, header.magic);
+	if (!sourceStamp (m_filename, header.sourceSize, header.sourceTime)) {
+		Console::print ("Cannot find texture " + m_filename);
+		return false;
+	}
+	int width, height, numOfComponents;
+	unsigned char * data = stbi_load (m_filename.c_str (), &width, &height, &numOfComponents, 0);
+	if (!data) {
+		Console::print ("Cannot decode texture " + m_filename + ": " + stbi_failure_reason ());
+		return false;
+	}
+	header.width = static_cast<uint32_t> (width);
+	header.height = static_cast<uint32_t> (height);
+	header.numOfChannels = static_cast<uint32_t> (numOfComponents);
+	header.sRGB = uint32_t (m_sRGB);
+	setLayout (header.width, header.height, header.numOfChannels);
+
+	// Written next to its final name and renamed once complete, so that no reader ever opens a partial file
+	std::error_code error;
+	fs::create_directories (m_cache.directory (), error);
+	std::string filename = tileFilename ();
+	std::string temporaryFilename = temporaryTileFilename (filename);
+	std::ofstream file (temporaryFilename, std::ios::binary);
+	file.write (reinterpret_cast<const char *> (&header), sizeof (header));
+
+	// Only two levels are in memory at a time: the one being written and its parent
+	std::vector<unsigned char> level (data, data + size_t (width) * height * m_numOfChannels);
+	stbi_image_free (data);
+	std::vector<unsigned char> page (m_pageBytes);
+	for (unsigned int l = 0; l < m_levels.size (); l++) {
+		const Level & desc = m_levels[l];
+		unsigned int numOfPagesY = (desc.height + m_pageSize - 1) / m_pageSize;
+		for (unsigned int py = 0; py < numOfPagesY; py++)
+			for (unsigned int px = 0; px < desc.numOfPagesX; px++) {
+				std::fill (page.begin (), page.end (), 0);
+				for (unsigned int y = py * m_pageSize; y < std::min (desc.height, (py + 1) * m_pageSize); y++)
+					for (unsigned int x = px * m_pageSize; x < std::min (desc.width, (px + 1) * m_pageSize); x++)
+						std::copy_n (&level[(size_t (y) * desc.width + x) * m_numOfChannels], m_numOfChannels, &page[offsetInPage (x, y)]);
+				file.write (reinterpret_cast<const char *> (page.data ()), std::streamsize (m_pageBytes));
+			}
+		if (l + 1 < m_levels.size ())
+			level = downsample (level.data (), desc.width, desc.height, m_numOfChannels, m_sRGB);
+	}
+	file.close ();
+	if (!file) {
+		Console::print ("Cannot write tile file " + temporaryFilename);
+		fs::remove (temporaryFilename, error);
+		return false;
+	}
+	fs::rename (temporaryFilename, filename, error);
+	if (error) {
+		std::string message = error.message ();
+		fs::remove (temporaryFilename, error);
+		// Another process may have published the same tile file meanwhile, which the caller then opens
+		if (fs::exists (filename, error))
+			return true;
+		Console::print ("Cannot write tile file " + filename + ": " + message);
+		return false;
+	}
+	return true;
+}
+
+void Texture::fetch (const Level & level, unsigned int x, unsigned int y, unsigned char * t) const {
+	size_t page = pageOf (level, x, y);
+	size_t offset = offsetInPage (x, y);
+	uint64_t key = pageKey (page);
+	for (;;) {
+		int s = m_residency[page].load (std::memory_order_acquire);
+		if (s >= 0) {
+			TextureCache::Slot & slot = m_cache.m_slots[s];
+			uint32_t version = slot.version.load (std::memory_order_acquire);
+			if ((version & 1) == 0 && slot.key.load (std::memory_order_relaxed) == key) {
+				std::memcpy (t, slot.data.get () + offset, m_numOfChannels);
+				// The slot may have been refilled while copying: the copy only counts if the version is unchanged
+				std::atomic_thread_fence (std::memory_order_acquire);
+				if (slot.version.load (std::memory_order_relaxed) == version) {
+					if (!slot.referenced.load (std::memory_order_relaxed))
+						slot.referenced.store (true, std::memory_order_relaxed);
+					return;
+				}
+			}
+		}
+		m_cache.pageIn (*this, page);
+	}
+}
+
+glm::vec4 Texture::texel (const Level & level, unsigned int x, unsigned int y) const {
+	unsigned char t[4];
+	fetch (level, x, y, t);
+	const float * table = m_sRGB ? decodingTables.sRGB : decodingTables.linear;
+	switch (m_numOfChannels) {
+	case 1: return glm::vec4 (glm::vec3 (table[t[0]]), 1.f);
+	case 2: return glm::vec4 (glm::vec3 (table[t[0]]), decodingTables.linear[t[1]]);
+	case 3: return glm::vec4 (table[t[0]], table[t[1]], table[t[2]], 1.f);
+	default: return glm::vec4 (table[t[0]], table[t[1]], table[t[2]], decodingTables.linear[t[3]]);
+	}
+}
+
+glm::vec4 Texture::bilinear (const glm::vec2 & uv, unsigned int l) const {
+	const Level & level = m_levels[l];
+	// Texel centers are at half integers
+	float x = uv.x * level.width - 0.5f;
+	float y = uv.y * level.height - 0.5f;
+	float fx = std::floor (x);
+	float fy = std::floor (y);
+	float tx = x - fx;
+	float ty = y - fy;
+	// Wrap around, robust to negative coordinates
+	int w = int (level.width), h = int (level.height);
+	int x0 = int (fx) % w, y0 = int (fy) % h;
+	if (x0 < 0) x0 += w;
+	if (y0 < 0) y0 += h;
+	int x1 = (x0 + 1 == w ? 0 : x0 + 1);
+	int y1 = (y0 + 1 == h ? 0 : y0 + 1);
+	glm::vec4 top = glm::mix (texel (level, x0, y0), texel (level, x1, y0), tx);
+	glm::vec4 bottom = glm::mix (texel (level, x0, y1), texel (level, x1, y1), tx);
+	return glm::mix (top, bottom, ty);
+}
+
+glm::vec4 Texture::sample (const glm::vec2 & uv, float lod) const {
+	float maxLod = float (m_levels.size () - 1);
+	lod = glm::clamp (lod, 0.f, maxLod);
+	unsigned int l = static_cast<unsigned int> (lod);
+	float t = lod - float (l);
+	if (t == 0.f)
+		return bilinear (uv, l);
+	return glm::mix (bilinear (uv, l), bilinear (uv, l + 1), t);
+}
+
+TextureCache::TextureCache (size_t memoryBudget, const std::string & directory) :
+	m_directory (directory),
+	m_numOfSlots (std::max (size_t (MIN_NUM_OF_SLOTS), memoryBudget / PAGE_BYTES)),
+	m_slots (new Slot[m_numOfSlots]) {
+	if (m_directory.empty ()) {
+		std::error_code error;
+		m_directory = (fs::temp_directory_path (error) / "INF584TextureTiles").string ();
+	}
+}
+
+std::shared_ptr<Texture> TextureCache::get (const std::string & filename, bool sRGB) {
+	std::lock_guard<std::mutex> lock (m_mutex);
+	std::shared_ptr<Texture> & texturePtr = m_textures[std::make_pair (filename, sRGB)];
+	if (!texturePtr)
+		texturePtr = std::make_shared<Texture> (*this, filename, sRGB);
+	return texturePtr;
+}
+
+size_t TextureCache::numOfTextures () const {
+	std::lock_guard<std::mutex> lock (m_mutex);
+	return m_textures.size ();
+}
+
+size_t TextureCache::memoryUsage () const {
+	std::lock_guard<std::mutex> lock (m_mutex);
+	return m_numOfUsedSlots * PAGE_BYTES;
+}
+
+void TextureCache::clear () {
+	std::lock_guard<std::mutex> lock (m_mutex);
+	m_textures.clear ();
+}
+
+size_t TextureCache::evict () {
+	if (m_numOfUsedSlots < m_numOfSlots)
+		return m_numOfUsedSlots++;
+	// Clock: slots referenced since the last sweep get a second chance
+	for (;;) {
+		size_t s = m_clockHand;
+		m_clockHand = (m_clockHand + 1) % m_numOfSlots;
+		if (!m_slots[s].referenced.exchange (false, std::memory_order_relaxed))
+			return s;
+	}
+}
+
+void TextureCache::pageIn (const Texture & texture, size_t page) {
+	std::lock_guard<std::mutex> lock (m_mutex);
+	uint64_t key = texture.pageKey (page);
+	int resident = texture.m_residency[page].load (std::memory_order_relaxed);
+	if (resident >= 0 && m_slots[resident].key.load (std::memory_order_relaxed) == key)
+		return; // Paged in by another thread meanwhile
+	size_t s = evict ();
+	Slot & slot = m_slots[s];
+	if (!slot.data)
+		slot.data.reset (new unsigned char[PAGE_BYTES]);
+	uint32_t version = slot.version.load (std::memory_order_relaxed);
+	slot.version.store (version + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence (std::memory_order_release);
+	slot.key.store (key, std::memory_order_relaxed);
+	texture.m_file.seekg (std::streamoff (sizeof (TileFileHeader) + page * texture.m_pageBytes));
+	if (!texture.m_file.read (reinterpret_cast<char *> (slot.data.get ()), std::streamsize (texture.m_pageBytes))) {
+		Console::print ("Cannot read tile file of texture " + texture.filename ());
+		texture.m_file.clear ();
+		std::fill_n (slot.data.get (), texture.m_pageBytes, 0);
+	}
+	slot.referenced.store (true, std::memory_order_relaxed);
+	slot.version.store (version + 2, std::memory_order_release);
+	texture.m_residency[page].store (int (s), std::memory_order_release);
+	m_numOfPageIns.fetch_add (1, std::memory_order_relaxed);
+}
@@ -0,0 +1,170 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+class TextureCache;
+
+/// CPU texture for the ray tracer, paged in from disk by a TextureCache. On first use, the image is decoded once and
+/// its mip pyramid is written to a tile file of the cache directory, which later runs reuse as long as the image is
+/// unchanged. Each level is cut in pages of fixed byte size, the unit of paging, themselves laid out in tiles of 8x8
+/// texels so that the texels of a bilinear lookup, and those of the lookups of neighboring rays, mostly share cache
+/// lines. Texels are stored on 8 bits per channel; sRGB textures are averaged in linear space when building the
+/// pyramid and linearized at fetch time. Texture coordinates wrap around.
+class Texture {
+public:
+	Texture (TextureCache & cache, const std::string & filename, bool sRGB = false);
+	virtual ~Texture () {}
+
+	inline const std::string & filename () const { return m_filename; }
+	inline bool sRGB () const { return m_sRGB; }
+
+	/// Open the tile file of the image on the first call, building it if needed, and blocking concurrent callers until
+	/// it is done. Returns false if the image could not be decoded, in which case the texture must not be sampled.
+	bool load ();
+
+	inline unsigned int width () const { return m_width; }
+	inline unsigned int height () const { return m_height; }
+	inline unsigned int numOfChannels () const { return m_numOfChannels; }
+	inline unsigned int numOfLevels () const { return static_cast<unsigned int> (m_levels.size ()); }
+	inline size_t numOfPages () const { return m_numOfPages; }
+
+	/// Mip level matching a footprint of the given width in texture coordinates, e.g., the width of a pixel cone.
+	inline float lod (float footprint) const { return std::log2 (std::max (1.f, footprint * width ())); }
+
+	/// Bilinear lookup in one mip level. Missing channels are expanded as in OpenGL: grey to RGB, alpha to 1.
+	glm::vec4 bilinear (const glm::vec2 & uv, unsigned int level) const;
+
+	/// Trilinear lookup at a fractional mip level, clamped to the pyramid.
+	glm::vec4 sample (const glm::vec2 & uv, float lod) const;
+
+private:
+	friend class TextureCache;
+
+	static const unsigned int TILE_SIZE = 8;
+
+	struct Level {
+		unsigned int width = 0, height = 0;
+		unsigned int numOfPagesX = 0;
+		size_t firstPage = 0; // Index of the first page of the level in the tile file
+	};
+
+	inline size_t pageOf (const Level & level, unsigned int x, unsigned int y) const {
+		return level.firstPage + (y / m_pageSize) * level.numOfPagesX + x / m_pageSize;
+	}
+
+	/// Byte offset of a texel in its page: tiles of TILE_SIZE x TILE_SIZE texels, row by row.
+	inline size_t offsetInPage (unsigned int x, unsigned int y) const {
+		x %= m_pageSize;
+		y %= m_pageSize;
+		size_t tile = (y / TILE_SIZE) * (m_pageSize / TILE_SIZE) + x / TILE_SIZE;
+		return ((tile * TILE_SIZE + y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE) * m_numOfChannels;
+	}
+
+	inline uint64_t pageKey (size_t page) const { return (uint64_t (m_id) << 32) | uint64_t (page); }
+
+	/// Copy the channels of a texel to t, paging it in first if it is not resident.
+	void fetch (const Level & level, unsigned int x, unsigned int y, unsigned char * t) const;
+
+	/// Texel as linear values in [0,1], expanded to 4 channels.
+	glm::vec4 texel (const Level & level, unsigned int x, unsigned int y) const;
+
+	/// Page size and level layout of an image of the given resolution.
+	void setLayout (unsigned int width, unsigned int height, unsigned int numOfChannels);
+
+	std::string tileFilename () const;
+	bool openTileFile ();
+	bool buildTileFile ();
+
+	TextureCache & m_cache;
+	uint32_t m_id;
+	std::string m_filename;
+	bool m_sRGB;
+	std::once_flag m_loadFlag;
+	bool m_loaded = false;
+	unsigned int m_width = 0, m_height = 0;
+	unsigned int m_numOfChannels = 0;
+	unsigned int m_pageSize = 0; // In texels, along both axes
+	size_t m_pageBytes = 0;
+	std::vector<Level> m_levels;
+	size_t m_numOfPages = 0;
+	std::unique_ptr<std::atomic<int>[]> m_residency; // Cache slot last holding each page, -1 if never paged in
+	mutable std::ifstream m_file; // Tile file, only read by the cache under its mutex
+};
+
+/// Textures shared by file name, so that materials referring to the same image decode it once, and the fixed
+/// memory budget their pages share. Pages are brought to memory on demand and, once the budget is reached, replace
+/// the least recently used ones (clock approximation of LRU). Memory use is thus bounded by the budget whatever the
+/// number of textures. Lookups of resident pages take no lock: slots are versioned as seqlocks, so a reader racing
+/// with the replacement of its page detects it and retries. Page-ins are serialized by the cache mutex.
+class TextureCache {
+public:
+	/// Size of a page slot. Pages of textures with fewer channels cover more texels.
+	static const size_t PAGE_BYTES = 16384;
+	static const size_t DEFAULT_MEMORY_BUDGET = size_t (256) << 20;
+	static const size_t MIN_NUM_OF_SLOTS = 64;
+
+	/// Tile files are written to directory, by default a subdirectory of the system temporary directory.
+	TextureCache (size_t memoryBudget = DEFAULT_MEMORY_BUDGET, const std::string & directory = "");
+	virtual ~TextureCache () {}
+
+	/// Texture of the image file, registered on the first request. Decoding is deferred to its first load.
+	std::shared_ptr<Texture> get (const std::string & filename, bool sRGB = false);
+
+	size_t numOfTextures () const;
+
+	inline const std::string & directory () const { return m_directory; }
+	inline size_t memoryBudget () const { return m_numOfSlots * PAGE_BYTES; }
+
+	/// Bytes of resident pages, never above the budget.
+	size_t memoryUsage () const;
+
+	/// Number of pages read from tile files so far.
+	inline size_t numOfPageIns () const { return m_numOfPageIns.load (std::memory_order_relaxed); }
+
+	/// Forget the registered textures. Textures still referenced by materials remain valid.
+	void clear ();
+
+private:
+	friend class Texture;
+
+	struct Slot {
+		std::atomic<uint32_t> version {0}; // Odd while the slot is being refilled
+		std::atomic<uint64_t> key {~uint64_t (0)}; // Texture and page held by the slot
+		std::atomic<bool> referenced {false}; // Second chance of the clock
+		std::unique_ptr<unsigned char[]> data; // Allocated on first use, never freed, so that readers stay safe
+	};
+
+	/// Read a page of a texture into a free slot, or into the least recently used one once the budget is reached.
+	void pageIn (const Texture & texture, size_t page);
+
+	size_t evict ();
+
+	mutable std::mutex m_mutex;
+	std::map<std::pair<std::string, bool>, std::shared_ptr<Texture>> m_textures; // By file name and color space
+	std::string m_directory;
+	uint32_t m_nextTextureId = 0;
+	size_t m_numOfSlots;
+	std::unique_ptr<Slot[]> m_slots;
+	size_t m_numOfUsedSlots = 0;
+	size_t m_clockHand = 0;
+	std::atomic<size_t> m_numOfPageIns {0};
+};
@@ -0,0 +1,34 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "VisibilityBuffer.h"
+
+#include <algorithm>
+
+void VisibilityBuffer::resize (size_t numOfSamples) {
+	m_dx.resize (numOfSamples);
+	m_dy.resize (numOfSamples);
+	m_dz.resize (numOfSamples);
+	m_t.resize (numOfSamples);
+	m_u.resize (numOfSamples);
+	m_v.resize (numOfSamples);
+	m_mesh.resize (numOfSamples);
+	m_triangle.resize (numOfSamples);
+	m_order.resize (numOfSamples);
+}
+
+void VisibilityBuffer::sortByMesh (size_t numOfMeshes) {
+	// Bucket 0 is the background, bucket m+1 the mesh m
+	m_offsets.assign (numOfMeshes + 2, 0);
+	for (int mesh : m_mesh)
+		m_offsets[mesh + 2]++;
+	for (size_t b = 1; b < m_offsets.size (); b++)
+		m_offsets[b] += m_offsets[b-1];
+	for (size_t k = 0; k < m_mesh.size (); k++)
+		m_order[m_offsets[m_mesh[k] + 1]++] = static_cast<unsigned int> (k);
+}
@@ -0,0 +1,73 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <vector>
+#include <limits>
+
+#include "Hit.h"
+#include "Ray.h"
+
+/// Visibility buffer (Burns and Hunt 2013): the primary hits of a pass, stored as (mesh, triangle, u, v, t) per sample
+/// before any shading takes place. Shading then walks the samples grouped by mesh, and thus by material, so that the
+/// vertex normals and material terms of one mesh stay in cache while its samples are shaded.
+class VisibilityBuffer {
+public:
+	inline VisibilityBuffer () {}
+	virtual ~VisibilityBuffer () {}
+
+	void resize (size_t numOfSamples);
+	inline size_t size () const { return m_mesh.size (); }
+
+	/// Store the camera ray direction of sample k, so that shading needs not generate it again.
+	inline void setDirection (size_t k, const glm::vec3 & direction) {
+		m_dx[k] = direction.x;
+		m_dy[k] = direction.y;
+		m_dz[k] = direction.z;
+	}
+
+	inline glm::vec3 direction (size_t k) const { return glm::vec3 (m_dx[k], m_dy[k], m_dz[k]); }
+
+	inline void set (size_t k, const Hit & hit) {
+		m_t[k] = hit.t;
+		m_u[k] = hit.u;
+		m_v[k] = hit.v;
+		m_mesh[k] = hit.getMesh ();
+		m_triangle[k] = hit.getSimp ();
+	}
+
+	inline void setMiss (size_t k) { m_mesh[k] = -1; }
+
+	/// Mesh hit by sample k, negative if its primary ray escaped to the background.
+	inline int mesh (size_t k) const { return m_mesh[k]; }
+
+	/// Hit of sample k, for the primary ray it was traced with.
+	inline Hit hit (size_t k, const Ray & ray) const {
+		Hit hit (ray.origin, ray.direction, m_mesh[k] >= 0 ? m_t[k] : std::numeric_limits<float>::infinity ());
+		hit.u = m_u[k];
+		hit.v = m_v[k];
+		hit.setMesh (m_mesh[k]);
+		hit.setSimp (m_triangle[k]);
+		return hit;
+	}
+
+	/// Counting sort of the samples by mesh index, background samples first. The order of the samples of a
+	/// same mesh is preserved, so that they remain spatially coherent.
+	void sortByMesh (size_t numOfMeshes);
+
+	/// Sample indices in shading order, after sortByMesh.
+	inline const std::vector<unsigned int> & order () const { return m_order; }
+
+private:
+	std::vector<float> m_dx, m_dy, m_dz; // Camera ray directions
+	std::vector<float> m_t, m_u, m_v;
+	std::vector<int> m_mesh, m_triangle;
+	std::vector<unsigned int> m_order;
+	std::vector<size_t> m_offsets; // Scan scratch buffer, one entry per mesh plus the background
+};
@@ -0,0 +1,307 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#include "Wavefront.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <omp.h>
+
+#include "Camera.h"
+#include "Shading.h"
+#include "BRDFBatch.h"
+
+void Wavefront::RayQueue::resize (size_t n) {
+	ox.resize (n); oy.resize (n); oz.resize (n);
+	dx.resize (n); dy.resize (n); dz.resize (n);
+}
+
+size_t Wavefront::exclusiveScan (const std::vector<unsigned char> & flags, size_t n) {
+	int numOfBlocks = omp_get_num_threads ();
+	int b = omp_get_thread_num ();
+	size_t blockSize = (n + numOfBlocks - 1) / numOfBlocks;
+	size_t first = std::min (n, b * blockSize), last = std::min (n, first + blockSize);
+	unsigned int sum = 0;
+	for (size_t i = first; i < last; i++)
+		sum += flags[i];
+	m_blockSums[b+1] = sum;
+	#pragma omp barrier
+	#pragma omp single
+	for (int k = 0; k < numOfBlocks; k++)
+		m_blockSums[k+1] += m_blockSums[k];
+	sum = m_blockSums[b];
+	for (size_t i = first; i < last; i++) {
+		m_offsets[i] = sum;
+		sum += flags[i];
+	}
+	size_t total = m_blockSums[numOfBlocks];
+	// No thread may start the next scan before all have read the total
+	#pragma omp barrier
+	return total;
+}
+
+void Wavefront::resize (size_t numOfPaths, size_t numOfShadowSlots) {
+	m_rays.resize (numOfPaths);
+	m_throughputR.resize (numOfPaths);
+	m_throughputG.resize (numOfPaths);
+	m_throughputB.resize (numOfPaths);
+	m_brdfPdf.resize (numOfPaths);
+	m_occlusion.resize (numOfPaths);
+	m_pixels.resize (numOfPaths);
+	m_queue.resize (numOfPaths);
+	m_nextQueue.resize (numOfPaths);
+	m_alive.resize (numOfPaths);
+	m_hitT.resize (numOfPaths);
+	m_hitU.resize (numOfPaths);
+	m_hitV.resize (numOfPaths);
+	m_hitMesh.resize (numOfPaths);
+	m_hitSimp.resize (numOfPaths);
+	m_normalX.resize (numOfPaths);
+	m_normalY.resize (numOfPaths);
+	m_normalZ.resize (numOfPaths);
+	m_woX.resize (numOfPaths);
+	m_woY.resize (numOfPaths);
+	m_woZ.resize (numOfPaths);
+	m_materials.resize (numOfPaths);
+	size_t numOfShadowRays = numOfPaths * numOfShadowSlots;
+	m_shadowRays.resize (numOfShadowRays);
+	m_shadowTMax.resize (numOfShadowRays);
+	m_shadowR.resize (numOfShadowRays);
+	m_shadowG.resize (numOfShadowRays);
+	m_shadowB.resize (numOfShadowRays);
+	m_shadowValid.resize (numOfShadowRays);
+	m_shadowQueue.resize (numOfShadowRays);
+	m_offsets.resize (numOfShadowRays);
+	m_blockSums.resize (omp_get_max_threads () + 1);
+}
+
+void Wavefront::generate (const Camera & camera, const unsigned int * pixels, size_t width, size_t height) {
+	const CameraFrame frame = camera.computeFrame ();
+	#pragma omp for
+	for (long long p = 0; p < (long long)m_numOfPaths; p++) {
+		size_t pixel = pixels[p];
+		size_t i = pixel % width;
+		size_t j = pixel / width;
+		PixelSampler sampler (*m_sampler, i, j, m_sampleIndices[pixel]);
+		glm::vec2 offset = (m_sampleIndices[pixel] > 0 ? sampler.get2D (PIXEL_DIMENSION) : glm::vec2 (0.5f));
+		m_rays.set (p, frame.eye, frame.directionAt ((float(i) + offset.x) / width, 1.f - (float(j) + offset.y) / height));
+		m_throughputR[p] = m_throughputG[p] = m_throughputB[p] = 1.f;
+		m_brdfPdf[p] = 0.f;
+		m_occlusion[p] = 1.f;
+		m_pixels[p] = static_cast<unsigned int> (pixel);
+		m_queue[p] = static_cast<unsigned int> (p);
+		m_radiance[pixel] = glm::vec3 (0.f);
+		m_features[pixel] = SurfaceFeatures ();
+	}
+}
+
+void Wavefront::extend (const BVH & bvh) {
+	#pragma omp for schedule(dynamic, 64)
+	for (long long k = 0; k < (long long)m_numOfPaths; k++) {
+		size_t p = m_queue[k];
+		Ray ray = m_rays.ray (p);
+		// Keep the normalized direction, so that shading does not rebuild the ray
+		m_rays.set (p, ray.origin, ray.direction);
+		Hit hit (ray.origin, ray.direction, std::numeric_limits<float>::infinity ());
+		if (bvh.intersect (ray, hit)) {
+			m_hitT[k] = hit.t;
+			m_hitU[k] = hit.u;
+			m_hitV[k] = hit.v;
+			m_hitMesh[k] = hit.getMesh ();
+			m_hitSimp[k] = hit.getSimp ();
+		} else {
+			m_hitMesh[k] = -1;
+		}
+	}
+}
+
+void Wavefront::shade (const ShadingContext & context, const LightBVH & lightBVH, unsigned int bounce, bool continuePaths) {
+	#pragma omp for schedule(dynamic, 64)
+	for (long long k = 0; k < (long long)m_numOfPaths; k++) {
+		size_t p = m_queue[k];
+		glm::vec3 throughput (m_throughputR[p], m_throughputG[p], m_throughputB[p]);
+		m_alive[k] = 0;
+		for (size_t l = 0; l < m_numOfShadowSlots; l++)
+			m_shadowValid[k * m_numOfShadowSlots + l] = 0;
+		glm::vec3 direction = m_rays.direction (p);
+		if (m_hitMesh[k] < 0) {
+			float misWeight = (m_brdfPdf[p] > 0.f ? powerHeuristic (m_brdfPdf[p], environmentPdf (context, direction)) : 1.f);
+			m_radiance[m_pixels[p]] += (misWeight * m_occlusion[p]) * throughput * environmentRadiance (context, direction);
+			continue;
+		}
+		Hit hit (m_rays.origin (p), direction, m_hitT[k]);
+		hit.u = m_hitU[k];
+		hit.v = m_hitV[k];
+		hit.setMesh (m_hitMesh[k]);
+		hit.setSimp (m_hitSimp[k]);
+		SurfacePoint sp = surfacePoint (context, hit);
+		if (bounce == 0)
+			m_features[m_pixels[p]] = surfaceFeatures (sp, hit);
+		glm::vec3 wo = -direction;
+		m_normalX[k] = sp.normal.x; m_normalY[k] = sp.normal.y; m_normalZ[k] = sp.normal.z;
+		m_woX[k] = wo.x; m_woY[k] = wo.y; m_woZ[k] = wo.z;
+		m_materials[k] = sp.material;
+		PixelSampler sampler (*m_sampler, m_pixels[p] % m_width, m_pixels[p] / m_width, m_sampleIndices[m_pixels[p]]);
+		unsigned int dimension = bounceDimension (bounce);
+
+		// Queue one shadow ray per selected light source, carrying its potential irradiance
+		float u[MAX_LIGHT_SAMPLES];
+		unsigned int lights[MAX_LIGHT_SAMPLES];
+		float weights[MAX_LIGHT_SAMPLES];
+		for (unsigned int i = 0; i < m_numOfLightSamples; i++)
+			u[i] = sampler.get1D (dimension + LIGHT_SELECTION_DIMENSION + i);
+		unsigned int numOfSelectedLights = selectLights (sp, m_numOfLights, lightBVH, m_numOfLightSamples, u, lights, weights);
+		for (unsigned int i = 0; i < numOfSelectedLights; i++) {
+			const ShadingLight & light = context.lights[lights[i]];
+			glm::vec3 wi, irradiance;
+			float distance;
+			if (!lightIncidence (sp, light, wi, distance, irradiance))
+				continue;
+			glm::vec3 shadowOrigin = offsetRayOrigin (sp, wi);
+			queueShadowRay (k * m_numOfShadowSlots + i, shadowOrigin, wi, glm::distance (shadowOrigin, light.position), weights[i] * throughput * irradiance);
+		}
+
+		// Environment sample, in the last slot
+		glm::vec2 ue = sampler.get2D (dimension + ENVIRONMENT_DIMENSION);
+		glm::vec3 wi;
+		float environmentPdf;
+		glm::vec3 Le = sampleEnvironment (context, ue.x, ue.y, wi, environmentPdf);
+		glm::vec3 radiance;
+		if (environmentContribution (sp, Le, environmentPdf, wo, wi, continuePaths, radiance))
+			queueShadowRay (k * m_numOfShadowSlots + m_numOfLightSlots, offsetRayOrigin (sp, wi), wi, std::numeric_limits<float>::infinity (), throughput * radiance);
+
+		if (!continuePaths)
+			continue;
+		glm::vec3 weight;
+		float pdf;
+		glm::vec2 ub = sampler.get2D (dimension + BRDF_DIRECTION_DIMENSION);
+		if (!sampleBRDF (sp, wo, sampler.get1D (dimension + BRDF_LOBE_DIMENSION), ub.x, ub.y, wi, weight, pdf))
+			continue;
+		throughput *= weight;
+		if (!russianRoulette (bounce, sampler.get1D (dimension + RUSSIAN_ROULETTE_DIMENSION), throughput))
+			continue;
+		// The state of the path is no longer read by this bounce: it becomes that of the next one
+		m_rays.set (p, offsetRayOrigin (sp, wi), wi);
+		m_throughputR[p] = throughput.r;
+		m_throughputG[p] = throughput.g;
+		m_throughputB[p] = throughput.b;
+		m_brdfPdf[p] = pdf;
+		m_occlusion[p] = sp.occlusion;
+		m_alive[k] = 1;
+	}
+}
+
+void Wavefront::queueShadowRay (size_t slot, const glm::vec3 & origin, const glm::vec3 & direction, float tMax, const glm::vec3 & contribution) {
+	m_shadowRays.set (slot, origin, direction);
+	m_shadowTMax[slot] = tMax;
+	m_shadowR[slot] = contribution.r;
+	m_shadowG[slot] = contribution.g;
+	m_shadowB[slot] = contribution.b;
+	m_shadowValid[slot] = 1;
+}
+
+void Wavefront::shadow (const BVH & bvh) {
+	size_t numOfSlots = m_numOfPaths * m_numOfShadowSlots;
+	size_t numOfShadowRays = exclusiveScan (m_shadowValid, numOfSlots);
+	#pragma omp for
+	for (long long s = 0; s < (long long)numOfSlots; s++)
+		if (m_shadowValid[s])
+			m_shadowQueue[m_offsets[s]] = static_cast<unsigned int> (s);
+
+	// Each chunk of the queue is traced, then the BRDF of its unoccluded light slots is evaluated at once
+	long long numOfChunks = (numOfShadowRays + BRDF_BATCH_SIZE - 1) / BRDF_BATCH_SIZE;
+	#pragma omp for schedule(dynamic, 1)
+	for (long long c = 0; c < numOfChunks; c++) {
+		size_t first = c * BRDF_BATCH_SIZE;
+		size_t last = std::min (numOfShadowRays, first + BRDF_BATCH_SIZE);
+		BRDFBatch<BRDF_BATCH_SIZE> batch;
+		unsigned int slots[BRDF_BATCH_SIZE];
+		for (size_t q = first; q < last; q++) {
+			unsigned int s = m_shadowQueue[q];
+			if (bvh.occluded (m_shadowRays.ray (s), m_shadowTMax[s])) {
+				m_shadowValid[s] = 0;
+				continue;
+			}
+			if (s % m_numOfShadowSlots == m_numOfLightSlots)
+				continue; // The environment sample carries its whole contribution
+			size_t k = s / m_numOfShadowSlots;
+			slots[batch.add (glm::vec3 (m_normalX[k], m_normalY[k], m_normalZ[k]), m_materials[k], glm::vec3 (m_woX[k], m_woY[k], m_woZ[k]), glm::vec3 (m_shadowRays.dx[s], m_shadowRays.dy[s], m_shadowRays.dz[s]))] = s;
+		}
+		evaluateBRDFBatch (batch);
+		for (size_t i = 0; i < batch.size; i++) {
+			unsigned int s = slots[i];
+			m_shadowR[s] *= batch.r[i];
+			m_shadowG[s] *= batch.g[i];
+			m_shadowB[s] *= batch.b[i];
+		}
+	}
+
+	// Each path gathers its own unoccluded shadow rays, so that no two threads write the same pixel
+	#pragma omp for
+	for (long long k = 0; k < (long long)m_numOfPaths; k++)
+		for (size_t l = 0; l < m_numOfShadowSlots; l++) {
+			size_t s = k * m_numOfShadowSlots + l;
+			if (m_shadowValid[s])
+				m_radiance[m_pixels[m_queue[k]]] += glm::vec3 (m_shadowR[s], m_shadowG[s], m_shadowB[s]);
+		}
+}
+
+void Wavefront::compact () {
+	size_t numOfAlivePaths = exclusiveScan (m_alive, m_numOfPaths);
+	#pragma omp for
+	for (long long k = 0; k < (long long)m_numOfPaths; k++)
+		if (m_alive[k])
+			m_nextQueue[m_offsets[k]] = m_queue[k];
+	#pragma omp single
+	{
+		std::swap (m_queue, m_nextQueue);
+		m_numOfPaths = numOfAlivePaths;
+	}
+}
+
+bool Wavefront::render (const std::shared_ptr<Scene> scenePtr, const ShadingContext & context, const BVH & bvh, const LightBVH & lightBVH, unsigned int numOfLightSamples, unsigned int numOfBounces,
+						size_t width, size_t height, const std::vector<unsigned int> & pixels, const Sampler & sampler, const std::vector<unsigned int> & sampleIndices,
+						const std::atomic<bool> & cancel, std::vector<glm::vec3> & radiance, std::vector<SurfaceFeatures> & features) {
+	size_t numOfSamples = pixels.size ();
+	m_numOfLights = context.lights.size ();
+	m_numOfLightSamples = numOfLightSamples;
+	m_numOfLightSlots = std::min (m_numOfLights, size_t (numOfLightSamples));
+	m_numOfShadowSlots = m_numOfLightSlots + 1;
+	resize (std::min (m_waveSize, numOfSamples), m_numOfShadowSlots);
+	radiance.resize (width * height);
+	m_radiance = radiance.data ();
+	features.resize (width * height);
+	m_features = features.data ();
+	m_sampler = &sampler;
+	m_sampleIndices = sampleIndices.data ();
+	m_width = width;
+
+	for (size_t first = 0; first < numOfSamples && !cancel; first += m_waveSize) {
+		m_numOfPaths = std::min (m_waveSize, numOfSamples - first);
+		#pragma omp parallel
+		{
+			generate (*scenePtr->camera (), pixels.data () + first, width, height);
+			for (unsigned int bounce = 0; bounce <= numOfBounces; bounce++) {
+				// The cancel flag may change at any time: all the threads must take the same decision
+				#pragma omp single
+				m_stop = (m_numOfPaths == 0 || cancel);
+				if (m_stop)
+					break;
+				extend (bvh);
+				shade (context, lightBVH, bounce, bounce < numOfBounces);
+				shadow (bvh);
+				compact ();
+			}
+		}
+	}
+	m_radiance = nullptr;
+	m_features = nullptr;
+	m_sampler = nullptr;
+	return !cancel;
+}
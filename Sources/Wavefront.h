@@ -0,0 +1,120 @@
+// ----------------------------------------------
+// Polytechnique - INF584 "Image Synthesis"
+//
+// Base code for practical assignments.
+//
+// Copyright (C) 2022 Tamy Boubekeur
+// All rights reserved.
+// ----------------------------------------------
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+#include "Image.h"
+#include "BVH.h"
+#include "LightBVH.h"
+#include "Sampler.h"
+#include "Shading.h"
+#include "Ray.h"
+
+/// Wavefront path tracing engine (Laine et al. 2013). Instead of following each path to completion,
+/// a wave of paths goes through separate generate, extend, shade and shadow stages. Each stage runs
+/// in parallel over structure-of-arrays ray and hit buffers, and terminated paths are removed by
+/// stream compaction of the queue of active paths before the next bounce. Waves are kept small enough
+/// for their buffers to stay in cache from one stage to the next, and each wave runs in a single
+/// parallel region, the stages being separated by barriers only.
+class Wavefront {
+public:
+	inline Wavefront () {}
+	virtual ~Wavefront () {}
+
+	/// Maximum number of paths in flight. The image is processed in several waves above this size.
+	inline size_t waveSize () const { return m_waveSize; }
+	inline void setWaveSize (size_t size) { m_waveSize = std::max (size_t (1), size); }
+
+	/// Trace one sample for each listed pixel of a width x height frame, with up to numOfBounces indirect bounces
+	/// per path and numOfLightSamples lights picked from the light BVH, and write it to radiance, indexed by pixel,
+	/// along with the features of its primary hit.
+	/// Random numbers are drawn from the sampler for the sample index of each pixel, in sampleIndices; the primary rays
+	/// of sample 0 go through the pixel centers. Returns false if the render was interrupted by the cancel flag, leaving radiance incomplete.
+	bool render (const std::shared_ptr<Scene> scenePtr, const ShadingContext & context, const BVH & bvh, const LightBVH & lightBVH, unsigned int numOfLightSamples, unsigned int numOfBounces,
+				 size_t width, size_t height, const std::vector<unsigned int> & pixels, const Sampler & sampler, const std::vector<unsigned int> & sampleIndices,
+				 const std::atomic<bool> & cancel, std::vector<glm::vec3> & radiance, std::vector<SurfaceFeatures> & features);
+
+private:
+	/// Structure of arrays ray buffer
+	struct RayQueue {
+		std::vector<float> ox, oy, oz, dx, dy, dz;
+
+		void resize (size_t n);
+		inline Ray ray (size_t i) const { return Ray (origin (i), direction (i)); }
+		inline glm::vec3 origin (size_t i) const { return glm::vec3 (ox[i], oy[i], oz[i]); }
+		inline glm::vec3 direction (size_t i) const { return glm::vec3 (dx[i], dy[i], dz[i]); }
+		inline void set (size_t i, const glm::vec3 & o, const glm::vec3 & d) {
+			ox[i] = o.x; oy[i] = o.y; oz[i] = o.z;
+			dx[i] = d.x; dy[i] = d.y; dz[i] = d.z;
+		}
+	};
+
+	void resize (size_t numOfPaths, size_t numOfShadowSlots);
+	// The stages below are called by every thread of the parallel region of the wave, and share its work
+	void generate (const Camera & camera, const unsigned int * pixels, size_t width, size_t height);
+	void extend (const BVH & bvh);
+	void shade (const ShadingContext & context, const LightBVH & lightBVH, unsigned int bounce, bool continuePaths);
+	/// Store a shadow ray and the contribution it carries if unoccluded. For light slots, the contribution is the incident
+	/// irradiance only, multiplied by the BRDF in the shadow stage.
+	void queueShadowRay (size_t slot, const glm::vec3 & origin, const glm::vec3 & direction, float tMax, const glm::vec3 & contribution);
+	/// Trace the queued shadow rays, then evaluate the BRDF of the unoccluded light slots in batches spanning many paths.
+	void shadow (const BVH & bvh);
+	void compact ();
+	/// Exclusive prefix sum of the first n flags into m_offsets. Returns the number of set flags.
+	size_t exclusiveScan (const std::vector<unsigned char> & flags, size_t n);
+
+	size_t m_waveSize = size_t (1) << 14;
+	size_t m_numOfPaths = 0; // Active paths, listed by m_queue
+	bool m_stop = false; // Whether the wave is over, decided by a single thread for the whole team
+	const Sampler * m_sampler = nullptr; // Sampler and per pixel sample indices of the render in flight
+	const unsigned int * m_sampleIndices = nullptr;
+	size_t m_width = 0;
+	size_t m_numOfLights = 0;
+	unsigned int m_numOfLightSamples = 0;
+	size_t m_numOfLightSlots = 0; // Per path: one per selected light source
+	size_t m_numOfShadowSlots = 0; // Per path: the light slots, plus one environment sample
+
+	// State of the paths of the wave, indexed by path. The shade stage updates it in place for the next bounce.
+	RayQueue m_rays;
+	std::vector<float> m_throughputR, m_throughputG, m_throughputB;
+	std::vector<float> m_brdfPdf; // Density of the BRDF sample that generated the ray, 0 for camera rays
+	std::vector<float> m_occlusion; // Ambient occlusion of the vertex the ray left, 1 for camera rays
+	std::vector<unsigned int> m_pixels;
+
+	// Active paths, compacted after each bounce instead of their state. The buffers below are indexed by queue position.
+	std::vector<unsigned int> m_queue, m_nextQueue;
+	std::vector<unsigned char> m_alive; // Whether the path continues to the next bounce
+
+	// Closest hits of the active paths
+	std::vector<float> m_hitT, m_hitU, m_hitV;
+	std::vector<int> m_hitMesh, m_hitSimp;
+
+	// Shading points of the active paths, for the batched BRDF evaluations of the shadow stage
+	std::vector<float> m_normalX, m_normalY, m_normalZ;
+	std::vector<float> m_woX, m_woY, m_woZ;
+	std::vector<MaterialTerms> m_materials;
+
+	// Shadow rays, m_numOfShadowSlots slots per active path
+	RayQueue m_shadowRays;
+	std::vector<float> m_shadowTMax;
+	std::vector<float> m_shadowR, m_shadowG, m_shadowB;
+	std::vector<unsigned char> m_shadowValid;
+	std::vector<unsigned int> m_shadowQueue; // Compacted valid shadow slots
+
+	std::vector<unsigned int> m_offsets; // Scan scratch buffers
+	std::vector<unsigned int> m_blockSums;
+	glm::vec3 * m_radiance = nullptr; // Per pixel outputs of the render in flight
+	SurfaceFeatures * m_features = nullptr;
+};